@@ -0,0 +1,116 @@
+#! /usr/local/bin/python
+
+# Test network throughput, with a server built on the reactor module.
+#
+# Usage:
+# 1) on host_A: rthroughput -s [port]			# start a server
+# 2) on host_B: rthroughput -c  count host_A [port]	# start a client
+#
+# This is throughput.py with a different server: instead of calling
+# recv() from Python, it lets a reactor receive the data and cut it
+# into lines, and counts the lines in Python.  It serves any number
+# of clients at the same time, from one thread, until it is killed.
+# The client is the same as that of throughput.py, so either client
+# can be used with either server.
+#
+# The client performs one transfer of count*BUFSIZE bytes, sent as
+# lines of BUFSIZE bytes, and measures the time it takes (roundtrip!).
+
+
+import sys, time
+from socket import *
+import reactor
+
+MY_PORT = 50000 + 42
+
+BUFSIZE = 1024
+
+
+def main():
+	if len(sys.argv) < 2:
+		usage()
+	if sys.argv[1] == '-s':
+		server()
+	elif sys.argv[1] == '-c':
+		client()
+	else:
+		usage()
+
+
+def usage():
+	sys.stdout = sys.stderr
+	print 'Usage:    (on host_A) rthroughput -s [port]'
+	print 'and then: (on host_B) rthroughput -c count host_A [port]'
+	sys.exit(2)
+
+
+class Counter:
+
+	def __init__(self, addr):
+		self.addr = addr
+		self.lines = 0
+
+	def message(self, ch, data):
+		self.lines = self.lines + 1
+
+	def close(self, ch):
+		# The client has sent EOF; the reply is sent before the
+		# reactor closes the connection
+		ch.send('OK\n')
+		host, remoteport = self.addr
+		print 'Done with', host, 'port', remoteport,
+		print '(%d lines)' % self.lines
+
+
+def accept(ch, addr):
+	c = Counter(addr)
+	ch.set_handler(c.message, c.close)
+
+
+def server():
+	if len(sys.argv) > 2:
+		port = eval(sys.argv[2])
+	else:
+		port = MY_PORT
+	s = socket(AF_INET, SOCK_STREAM)
+	s.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1)
+	s.bind('', port)
+	s.listen(5)
+	r = reactor.reactor()
+	r.listen(s, '\n', None, None, accept)
+	print 'Server ready...'
+	r.run()
+
+
+def client():
+	if len(sys.argv) < 4:
+		usage()
+	count = int(eval(sys.argv[2]))
+	host = sys.argv[3]
+	if len(sys.argv) > 4:
+		port = eval(sys.argv[4])
+	else:
+		port = MY_PORT
+	testdata = 'x' * (BUFSIZE-1) + '\n'
+	t1 = time.time()
+	s = socket(AF_INET, SOCK_STREAM)
+	t2 = time.time()
+	s.connect(host, port)
+	t3 = time.time()
+	i = 0
+	while i < count:
+		i = i+1
+		s.send(testdata)
+	s.shutdown(1) # Send EOF
+	t4 = time.time()
+	data = s.recv(BUFSIZE)
+	t5 = time.time()
+	print data
+	print 'Raw timers:', t1, t2, t3, t4, t5
+	print 'Intervals:', t2-t1, t3-t2, t4-t3, t5-t4
+	print 'Total:', t5-t1
+	print 'Throughput:', round((BUFSIZE*count*0.001) / (t5-t1), 3),
+	print 'K/sec.'
+
+
+main()
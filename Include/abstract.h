@@ -424,6 +424,33 @@ xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/
 	 This is the equivalent of the Python statement: del o[key].
        */
 
+     int PyObject_AsReadBuffer Py_PROTO((PyObject *o, void **buffer));
+
+       /*
+	 Store the address of the memory holding the data of o in
+	 *buffer and return its size in bytes, for objects that
+	 support the buffer interface, such as arrays.  Returns -1
+	 on failure.  The memory stays valid, even while the
+	 interpreter lock is released, until the buffer is given
+	 back with PyObject_ReleaseBuffer(o); o can't be resized
+	 or closed before then.
+       */
+
+     int PyObject_AsWriteBuffer Py_PROTO((PyObject *o, void **buffer));
+
+       /*
+	 Like PyObject_AsReadBuffer(), for objects whose memory may be
+	 written to.  Returns -1 on failure.
+       */
+
+     void PyObject_ReleaseBuffer Py_PROTO((PyObject *o));
+
+       /*
+	 Give back a buffer obtained with PyObject_AsReadBuffer() or
+	 PyObject_AsWriteBuffer().  Each successful call of those
+	 must be matched by one call of this.
+       */
+
 
 /*  Number Protocol:*/
 
@@ -103,6 +103,11 @@ extern void PyEval_InitThreads Py_PROTO((void));
 extern PyObject *PyEval_SaveThread Py_PROTO((void));
 extern void PyEval_RestoreThread Py_PROTO((PyObject *));
 
+/* Fill in the interpreter lock's counters, as lock_stats() in
+   "thread.h" does; return 0 if there is no interpreter lock (as in
+   free-threaded builds) or it has no counters. */
+extern int PyEval_LockStats Py_PROTO((long *));
+
 #ifdef WITH_THREAD
 
 #define Py_BEGIN_ALLOW_THREADS { \
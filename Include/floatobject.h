@@ -56,6 +56,11 @@ extern double PyFloat_AsDouble Py_PROTO((PyObject *));
 /* Macro, trading safety for speed */
 #define PyFloat_AS_DOUBLE(op) ((op)->ob_fval)
 
+#ifdef WITH_FREE_THREAD
+/* Give a thread's float free list back when its thread state goes */
+extern void _PyFloat_ReleaseFreeList Py_PROTO((PyObject **));
+#endif
+
 #ifdef __cplusplus
 }
 #endif
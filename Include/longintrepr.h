@@ -45,7 +45,23 @@ PERFORMANCE OF THIS SOFTWARE.
    (at most MASK << SHIFT).
    Also, x_sub assumes that 'digit' is an unsigned type, and overflow
    is handled by taking the result mod 2**N for some N > SHIFT.
-   And, at some places it is assumed that MASK fits in an int, as well. */
+   And, at some places it is assumed that MASK fits in an int, as well.
+
+   On hosts with a 64-bit long, configuring with --with-big-digits
+   (WITH_BIG_DIGITS) makes a digit hold 30 bits instead, halving the
+   number of digits every long operation has to loop over.  The
+   marshal format always uses 15-bit digits, regardless. */
+
+#ifdef WITH_BIG_DIGITS
+
+typedef unsigned int digit;
+typedef unsigned int wdigit; /* digit widened to parameter size */
+typedef unsigned long twodigits; /* at least 64 bits, checked by configure */
+typedef long stwodigits; /* signed variant of twodigits */
+
+#define SHIFT	30
+
+#else /* !WITH_BIG_DIGITS */
 
 typedef unsigned short digit;
 typedef unsigned int wdigit; /* digit widened to parameter size */
@@ -53,6 +69,9 @@ typedef unsigned long twodigits;
 typedef long stwodigits; /* signed variant of twodigits */
 
 #define SHIFT	15
+
+#endif /* !WITH_BIG_DIGITS */
+
 #define BASE	((digit)1 << SHIFT)
 #define MASK	((int)(BASE - 1))
 
@@ -46,6 +46,7 @@ long PyMarshal_ReadLongFromFile Py_PROTO((FILE *));
 int PyMarshal_ReadShortFromFile Py_PROTO((FILE *));
 PyObject *PyMarshal_ReadObjectFromFile Py_PROTO((FILE *));
 PyObject *PyMarshal_ReadObjectFromString Py_PROTO((char *, int));
+PyObject *PyMarshal_ReadObjectFromMappedFile Py_PROTO((FILE *));
 
 #ifdef __cplusplus
 }
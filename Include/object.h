@@ -189,6 +189,24 @@ typedef struct {
 	objobjargproc mp_ass_subscript;
 } PyMappingMethods;
 
+/* Objects that keep their data in one block of memory, such as arrays,
+   can give access to it through the buffer suite.  The get functions
+   store the address of the data in *ptr and return its size in bytes,
+   or return -1 with an exception set.  bf_getwritebuffer is NULL for
+   objects that can't be changed.  After a successful get, the object
+   keeps its data where it is (refusing to be resized, say) until
+   bf_releasebuffer is called, if the object has one. */
+
+typedef int (*getreadbufferproc) Py_PROTO((PyObject *, void **));
+typedef int (*getwritebufferproc) Py_PROTO((PyObject *, void **));
+typedef void (*releasebufferproc) Py_PROTO((PyObject *));
+
+typedef struct {
+	getreadbufferproc bf_getreadbuffer;
+	getwritebufferproc bf_getwritebuffer;
+	releasebufferproc bf_releasebuffer;
+} PyBufferProcs;
+
 typedef void (*destructor) Py_PROTO((PyObject *));
 typedef int (*printfunc) Py_PROTO((PyObject *, FILE *, int));
 typedef PyObject *(*getattrfunc) Py_PROTO((PyObject *, char *));
@@ -227,8 +245,9 @@ typedef struct _typeobject {
 	getattrofunc tp_getattro;
 	setattrofunc tp_setattro;
 
+	PyBufferProcs *tp_as_buffer;
+
 	/* Space for future expansion */
-	long tp_xxx3;
 	long tp_xxx4;
 
 	char *tp_doc; /* Documentation string */
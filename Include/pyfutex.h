@@ -0,0 +1,70 @@
+#ifndef Py_PYFUTEX_H
+#define Py_PYFUTEX_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "config.h"
+
+/*
+** Futex locks
+**
+** Where Linux futexes and the GCC atomic builtins are available,
+** Py_FUTEX_LOCKS is defined and PyFutex is a lock that is taken with
+** one compare-and-swap when it is free.  A thread that finds it held
+** spins for a while, as long as spinning has lately paid off for that
+** lock, and only then sleeps in the kernel; releasing a lock nobody
+** waits for doesn't enter the kernel either.  The PyMutex type and the
+** locks of thread.h are made of these where they can be.
+**
+** void PyFutex_INIT(PyFutex *)
+** int PyFutex_TryLock(PyFutex *)
+** void PyFutex_Lock(PyFutex *)
+** int PyFutex_LockTimed(PyFutex *, long usec)
+** void PyFutex_Unlock(PyFutex *)
+**
+**    TryLock and LockTimed return whether they got the lock; LockTimed
+**    waits at most usec microseconds, or forever if usec is negative.
+**    Any thread may release the lock.
+**
+** The counters are only changed by the thread that has just taken the
+** lock, so they need no locking of their own.
+*/
+
+#if defined(HAVE_LINUX_FUTEX_H) && defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+
+#define Py_FUTEX_LOCKS
+
+typedef struct {
+	volatile int f_state;	/* 0 free, 1 held, 2 held and waited for */
+	int f_spin;		/* Average spins needed lately */
+	long f_locks;		/* Times taken */
+	long f_contended;	/* ... after finding it held */
+	long f_sleeps;		/* Times a thread slept waiting for it */
+} PyFutex;
+
+#define PyFutex_INIT(f) \
+	((f)->f_state = (f)->f_spin = 0, \
+	 (f)->f_locks = (f)->f_contended = (f)->f_sleeps = 0)
+#define PyFutex_TryLock(f) \
+	(__sync_bool_compare_and_swap(&(f)->f_state, 0, 1) ? \
+	 ((f)->f_locks++, 1) : 0)
+#define PyFutex_Lock(f) \
+	((void)(PyFutex_TryLock(f) || _PyFutex_Lock((f), -1L)))
+#define PyFutex_LockTimed(f, usec) \
+	(PyFutex_TryLock(f) || ((usec) != 0 && _PyFutex_Lock((f), (usec))))
+#define PyFutex_Unlock(f) \
+	((void)(__sync_bool_compare_and_swap(&(f)->f_state, 1, 0) || \
+		(_PyFutex_Wake(f), 0)))
+
+/* The slow paths; see thread.c */
+extern int _PyFutex_Lock(PyFutex *, long);
+extern void _PyFutex_Wake(PyFutex *);
+
+#endif /* HAVE_LINUX_FUTEX_H && __GNUC__ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* !Py_PYFUTEX_H */
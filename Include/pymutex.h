@@ -15,14 +15,67 @@ extern "C" {
 **    These macros are used to mark a critical section in the code.  They
 **    use a single non-reentrant lock, so care must be taken.
 **
+** void Py_SUBSYS_LOCK(PyMutex *)
+** void Py_SUBSYS_UNLOCK(PyMutex *)
+**
+**    The same, with one of the subsystem mutexes declared below, so that
+**    critical sections of unrelated subsystems don't wait for each other.
+**    Frequently used ones should have a mutex of their own; the critical
+**    section lock is left for the rest.  None of them is reentrant, so
+**    a critical section mustn't call code that may take its own mutex.
+**
 **    When free threading is not enabled, these macros evaluate to nothing.
+**
+** int Py_AtomicCAS(long *p, long old, long new)
+**
+**    If *p equals old, set it to new and return 1, else return 0, as one
+**    atomic operation that is also a full memory barrier.
+**
+** void Py_MemoryBarrier(void)
+**
+**    Keep the compiler and processor from moving memory accesses across
+**    this point.
+**
+**    Without free threading, and without compiler support for them,
+**    these are plain operations, and Py_ATOMIC_PLAIN is defined: only
+**    the thread holding the interpreter lock may use them then.
 */
 
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+
+#define Py_AtomicCAS(p, old, new) \
+	__sync_bool_compare_and_swap((p), (old), (new))
+#define Py_MemoryBarrier()	__sync_synchronize()
+#define _Py_ATOMIC_BUILTINS
+
+#else
+#ifdef WITH_FREE_THREAD
+
+/* Done with a mutex; see pymutex.c */
+extern int _Py_AtomicCAS Py_PROTO((long *, long, long));
+extern void _Py_MemoryBarrier Py_PROTO((void));
+#define Py_AtomicCAS(p, old, new)	_Py_AtomicCAS((long *)(p), old, new)
+#define Py_MemoryBarrier()	_Py_MemoryBarrier()
+#define _Py_NEED_ATOMIC_FUNCS
+
+#else
+
+#define Py_AtomicCAS(p, old, new) \
+	(*(p) == (old) ? (*(p) = (new), 1) : 0)
+#define Py_MemoryBarrier()
+#define Py_ATOMIC_PLAIN
+
+#endif /* WITH_FREE_THREAD */
+#endif /* __GNUC__ */
+
+
 #ifndef WITH_FREE_THREAD
 
 #define Py_CRIT_LOCK()
 #define Py_CRIT_UNLOCK()
+#define Py_SUBSYS_LOCK(pm)
+#define Py_SUBSYS_UNLOCK(pm)
 
 
 #else /* WITH_FREE_THREAD */
@@ -45,25 +98,84 @@ extern DL_IMPORT(PyMutex *) _Py_RefMutex;
 extern DL_IMPORT(PyMutex *) _Py_ListMutex;
 extern DL_IMPORT(PyMutex *) _Py_MappingMutex;
 extern DL_IMPORT(PyMutex *) _Py_CritMutex;
+extern DL_IMPORT(PyMutex *) _Py_IntMutex;	/* int free list */
+extern DL_IMPORT(PyMutex *) _Py_FloatMutex;	/* float orphan blocks */
+extern DL_IMPORT(PyMutex *) _Py_TupleMutex;	/* tuple free lists */
+extern DL_IMPORT(PyMutex *) _Py_FrameMutex;	/* frame free list */
+extern DL_IMPORT(PyMutex *) _Py_AttrMutex;	/* attribute name cache */
+extern DL_IMPORT(PyMutex *) _Py_PendingMutex;	/* pending calls */
+extern DL_IMPORT(PyMutex *) _Py_ImportMutex;	/* import caches */
+extern DL_IMPORT(PyMutex *) _Py_TraceMutex;	/* trace/profile functions */
+
+/* the mutexes above by name, for reports; ends with a NULL name */
+struct _Py_NamedMutex
+{
+    char *	name;
+    PyMutex **	mutex;
+};
+extern DL_IMPORT(struct _Py_NamedMutex) _Py_NamedMutexes[];
 
 #define Py_CRIT_LOCK()		PyMutex_Lock(_Py_CritMutex)
 #define Py_CRIT_UNLOCK()	PyMutex_Unlock(_Py_CritMutex)
+#define Py_SUBSYS_LOCK(pm)	PyMutex_Lock(pm)
+#define Py_SUBSYS_UNLOCK(pm)	PyMutex_Unlock(pm)
+
+
+/* fill in stats[3] with the number of times the mutex was taken, the
+   times it was found held, and the times a thread slept waiting for it;
+   returns 0 if the mutex doesn't count these */
+extern int PyMutex_Stats Py_PROTO((PyMutex *, long *));
 
 
 #ifdef _POSIX_THREADS
 
+#include "pyfutex.h"
+
+#ifdef Py_FUTEX_LOCKS
+
+/* spin, then sleep on a futex; uncontended use stays out of the kernel */
+struct PyMutex_s
+{
+    PyFutex		fut;
+};
+#define _PYMUTEX_INIT(pm)	PyFutex_INIT(&(pm)->fut)
+#define _PYMUTEX_FREE(pm)
+
+#define PyMutex_Lock(pm)	PyFutex_Lock(&(pm)->fut)
+#define PyMutex_Unlock(pm)	PyFutex_Unlock(&(pm)->fut)
+
+#define _PYMUTEX_STATS(pm, stats) \
+	((stats)[0] = (pm)->fut.f_locks, \
+	 (stats)[1] = (pm)->fut.f_contended, \
+	 (stats)[2] = (pm)->fut.f_sleeps, 1)
+
+#else /* !Py_FUTEX_LOCKS */
+
 #include <pthread.h>
 
+/* a failed trylock counts as contention; sleeps aren't seen */
 struct PyMutex_s
 {
     pthread_mutex_t	mut;
+    long		locks;
+    long		contended;
 };
-#define _PYMUTEX_INIT(pm)	pthread_mutex_init(&(pm)->mut, NULL)
+#define _PYMUTEX_INIT(pm) \
+	((pm)->locks = (pm)->contended = 0, pthread_mutex_init(&(pm)->mut, NULL))
 #define _PYMUTEX_FREE(pm)	pthread_mutex_destroy(&(pm)->mut)
 
-#define PyMutex_Lock(pm)	pthread_mutex_lock(&(pm)->mut)
+#define PyMutex_Lock(pm) \
+	(pthread_mutex_trylock(&(pm)->mut) == 0 ? (void)(pm)->locks++ : \
+	 (pthread_mutex_lock(&(pm)->mut), (pm)->locks++, \
+	  (void)(pm)->contended++))
 #define PyMutex_Unlock(pm)	pthread_mutex_unlock(&(pm)->mut)
 
+#define _PYMUTEX_STATS(pm, stats) \
+	((stats)[0] = (pm)->locks, (stats)[1] = (pm)->contended, \
+	 (stats)[2] = 0, 1)
+
+#endif /* !Py_FUTEX_LOCKS */
+
 /* PTHREADS uses the default versions of Py_SafeXXXX() */
 
 /* these mutexes will (probably) deadlock a thread */
@@ -89,6 +201,8 @@ struct PyMutex_s
 #define PyMutex_Lock(pm)	EnterCriticalSection(&(pm)->cs)
 #define PyMutex_Unlock(pm)	LeaveCriticalSection(&(pm)->cs)
 
+#define _PYMUTEX_STATS(pm, stats)	0
+
 /* we'll say sizeof(int) == sizeof(long) */
 #define Py_SafeIncr(pint)	InterlockedIncrement((long *)(pint))
 #define Py_SafeDecr(pint)	InterlockedDecrement((long *)(pint))
@@ -98,6 +212,17 @@ struct PyMutex_s
 
 #endif /* NT_THREADS */
 
+/*
+** Reference counts are the most frequently changed shared data of all;
+** don't take a mutex for them when the compiler can do it atomically
+*/
+#if !defined(Py_SafeIncr) && defined(_Py_ATOMIC_BUILTINS)
+
+#define Py_SafeIncr(pint)	__sync_add_and_fetch((pint), 1)
+#define Py_SafeDecr(pint)	__sync_sub_and_fetch((pint), 1)
+
+#endif /* _Py_ATOMIC_BUILTINS */
+
 /*
 ** If definitions weren't provided, then provide some defaults
 */
@@ -134,6 +134,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #define number_methods PyNumberMethods
 #define sequence_methods PySequenceMethods
 #define mapping_methods PyMappingMethods
+#define buffer_procs PyBufferProcs
 #define OB_HEAD PyObject_HEAD
 #define OB_VARHEAD PyObject_VAR_HEAD
 #define OB_HEAD_INIT PyObject_HEAD_INIT
@@ -332,6 +333,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #define printtraceback PyErr_PrintTraceBack
 #define restore_thread PyEval_RestoreThread
 #define save_thread PyEval_SaveThread
+#define interpreter_lock_stats PyEval_LockStats
 #define tb_fetch PyTraceBack_Fetch
 #define tb_here PyTraceBack_Here
 #define tb_print PyTraceBack_Print
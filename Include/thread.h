@@ -14,6 +14,7 @@
 
 typedef void *type_lock;
 typedef void *type_sema;
+typedef void *type_rwlock;
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,8 @@ int acquire_lock Py_PROTO((type_lock, int));
 #define WAIT_LOCK	1
 #define NOWAIT_LOCK	0
 void release_lock Py_PROTO((type_lock));
+int acquire_lock_timed Py_PROTO((type_lock, long));
+int lock_stats Py_PROTO((type_lock, long *));
 
 type_sema allocate_sema Py_PROTO((int));
 void free_sema Py_PROTO((type_sema));
@@ -38,6 +41,12 @@ int down_sema Py_PROTO((type_sema, int));
 #define WAIT_SEMA	1
 #define NOWAIT_SEMA	0
 void up_sema Py_PROTO((type_sema));
+int down_sema_timed Py_PROTO((type_sema, long));
+
+type_rwlock allocate_rwlock Py_PROTO((void));
+void free_rwlock Py_PROTO((type_rwlock));
+int acquire_rwlock Py_PROTO((type_rwlock, int, long));
+int release_rwlock Py_PROTO((type_rwlock));
 
 #ifndef NO_EXIT_PROG
 void exit_prog Py_PROTO((int));
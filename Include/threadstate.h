@@ -29,6 +29,8 @@ typedef struct PyThreadState_s
 
     int				c_error;		/* complexobject.c */
 
+    PyObject *			float_free_list;	/* floatobject.c */
+
 } PyThreadState;
 
 extern PyThreadState *PyThreadState_Get Py_PROTO((void));
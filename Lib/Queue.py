@@ -10,9 +10,8 @@ class Queue:
 		import thread
 		self._init(maxsize)
 		self.mutex = thread.allocate_lock()
-		self.esema = thread.allocate_lock()
-		self.esema.acquire_lock()
-		self.fsema = thread.allocate_lock()
+		self.not_empty = thread.allocate_condition(self.mutex)
+		self.not_full = thread.allocate_condition(self.mutex)
 
 	# Get an approximation of the queue size (not reliable!)
 	def qsize(self):
@@ -35,56 +34,42 @@ class Queue:
 		self.mutex.release_lock()
 		return n
 
-	# Put a new item into the queue
+	# Put a new item into the queue,
+	# blocking if necessary until there is room
 	def put(self, item):
-		self.fsema.acquire_lock()
 		self.mutex.acquire_lock()
-		was_empty = self._empty()
-		self._put(item)
-		if was_empty:
-			self.esema.release_lock()
-		if not self._full():
-			self.fsema.release_lock()
-		self.mutex.release_lock()
+		try:
+			while self._full():
+				self.not_full.wait()
+			self._put(item)
+			self.not_empty.notify()
+		finally:
+			self.mutex.release_lock()
 
 	# Get an item from the queue,
 	# blocking if necessary until one is available
 	def get(self):
-		self.esema.acquire_lock()
 		self.mutex.acquire_lock()
-		was_full = self._full()
-		item = self._get()
-		if was_full:
-			self.fsema.release_lock()
-		if not self._empty():
-			self.esema.release_lock()
-		self.mutex.release_lock()
+		try:
+			while self._empty():
+				self.not_empty.wait()
+			item = self._get()
+			self.not_full.notify()
+		finally:
+			self.mutex.release_lock()
 		return item
 
 	# Get an item from the queue if one is immediately available,
-	# raise Empty if the queue is empty or temporarily unavailable
+	# raise Empty if the queue is empty
 	def get_nowait(self):
-		locked = self.esema.acquire_lock(0)
 		self.mutex.acquire_lock()
-		if self._empty():
-			# The queue is empyt -- we can't have esema
-			self.mutex.release_lock()
-			raise Empty
-		if not locked:
-			locked = self.esema.acquire_lock(0)
-			if not locked:
-				# Somebody else has esema
-				# but we have mutex --
-				# go out of their way
-				self.mutex.release_lock()
+		try:
+			if self._empty():
 				raise Empty
-		was_full = self._full()
-		item = self._get()
-		if was_full:
-			self.fsema.release_lock()
-		if not self._empty():
-			self.esema.release_lock()
-		self.mutex.release_lock()
+			item = self._get()
+			self.not_full.notify()
+		finally:
+			self.mutex.release_lock()
 		return item
 
 	# XXX Need to define put_nowait() as well.
@@ -14,6 +14,7 @@ import sys
 import time
 import socket
 import string
+import types
 import posixpath
 import SocketServer
 import BaseHTTPServer
@@ -103,10 +104,18 @@ class SimpleHTTPRequestHandler(BaseHTTPServer.BaseHTTPRequestHandler):
 	The only reason for overriding this would be to change
 	the block size or perhaps to replace newlines by CRLF
 	-- note however that this the default server uses this
-	to copy binary data as well.
+	to copy binary data as well.  When copying a real file to
+	self.wfile, the socket's sendfile() method is used if it
+	exists, so the data doesn't pass through Python at all.
 
 	"""
 
+	if outputfile is self.wfile and type(source) is types.FileType \
+	   and hasattr(self.connection, 'sendfile'):
+	    # Let the kernel copy the file to the socket
+	    self.wfile.flush()
+	    self.connection.sendfile(source)
+	    return
 	BLOCKSIZE = 8192
 	while 1:
 	    data = source.read(BLOCKSIZE)
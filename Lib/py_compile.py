@@ -20,10 +20,16 @@ def compile(file, cfile = None):
 	codeobject = __builtin__.compile(codestring, file, 'exec')
 	if not cfile:
 		cfile = file + 'c'
+	# Don't overwrite an old file in place, it may be mapped into
+	# the memory of a running interpreter
+	try:
+		os.unlink(cfile)
+	except os.error:
+		pass
 	fc = open(cfile, 'wb')
 	fc.write(MAGIC)
 	wr_long(fc, timestamp)
-	marshal.dump(codeobject, fc)
+	marshal.dump(codeobject, fc, marshal.version)
 	fc.close()
 	if os.name == 'mac':
 		import macfs
@@ -0,0 +1,70 @@
+# Testing array.readinto()
+
+from test_support import *
+import array
+
+print 'array test suite:'
+
+data = array.array('h', range(10))
+f = open(TESTFN, 'wb')
+data.tofile(f)
+f.close()
+
+try:
+	# The whole file fits
+	a = array.array('h', [-1]*12)
+	f = open(TESTFN, 'rb')
+	n = a.readinto(f)
+	if n <> 10 or a.tolist() <> range(10) + [-1, -1]:
+		raise TestFailed, 'readinto whole file: %d, %s' % (n, `a`)
+	if a.readinto(f) <> 0:
+		raise TestFailed, 'readinto at end of file'
+	f.close()
+
+	# Blocks, the last one short, each from a start offset
+	a = array.array('h', [-1]*6)
+	f = open(TESTFN, 'rb')
+	got = []
+	while 1:
+		n = a.readinto(f, 2)
+		if n == 0:
+			break
+		if a[:2].tolist() <> [-1, -1]:
+			raise TestFailed, 'readinto wrote before start'
+		got = got + a[2:2+n].tolist()
+	f.close()
+	if got <> range(10):
+		raise TestFailed, 'readinto in blocks: ' + `got`
+
+	# At most n items
+	a = array.array('h', [-1]*6)
+	f = open(TESTFN, 'rb')
+	n = a.readinto(f, 1, 3)
+	if n <> 3 or a.tolist() <> [-1, 0, 1, 2, -1, -1]:
+		raise TestFailed, 'readinto with count: %d, %s' % (n, `a`)
+	f.close()
+
+	# Start out of range
+	f = open(TESTFN, 'rb')
+	for start in (-1, 7):
+		try:
+			a.readinto(f, start)
+		except IndexError:
+			pass
+		else:
+			raise TestFailed, 'readinto start %d' % start
+	if a.readinto(f, 6) <> 0:
+		raise TestFailed, 'readinto at end of array'
+	f.close()
+
+	# A read error raises IOError
+	f = open(TESTFN, 'ab')
+	try:
+		a.readinto(f)
+	except IOError:
+		pass
+	else:
+		raise TestFailed, 'readinto from a file open for writing'
+	f.close()
+finally:
+	unlink(TESTFN)
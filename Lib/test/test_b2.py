@@ -34,6 +34,43 @@ try:
 	if fp.read(1000) <> 'YYY'*100: raise TestFailed, 'read(1000) # truncate'
 finally:
 	fp.close()
+fp = open(TESTFN, 'r')
+try:
+	lines = fp.readlines()
+	if len(lines) <> 5 or lines[2] <> 'The quick brown fox jumps over the lazy dog.\n':
+		raise TestFailed, 'readlines()'
+	if lines[4] <> 'XXX'*100 + 'YYY'*100: raise TestFailed, 'readlines() # last'
+	fp.seek(0)
+	if fp.readlines(1) + fp.readlines() <> lines:
+		raise TestFailed, 'readlines(sizehint)'
+	fp.seek(0)
+	i = 0
+	for line in fp.xreadlines():
+		if line <> lines[i]: raise TestFailed, 'xreadlines()'
+		i = i+1
+	if i <> 5: raise TestFailed, 'xreadlines() # count'
+finally:
+	fp.close()
+# writelines() of many strings, buffered and unbuffered
+import os, string
+fn = TESTFN + 'w'
+for bufsize in -1, 0:
+	fp = open(fn, 'w', bufsize)
+	try:
+		fp.write('head\n')
+		fp.writelines(lines*1000)
+		fp.writelines(['', 'x', '', 'y\n'])
+		fp.write('tail\n')
+	finally:
+		fp.close()
+	fp = open(fn, 'r')
+	try:
+		if fp.read() <> 'head\n' + string.joinfields(lines*1000, '') + \
+				'xy\ntail\n':
+			raise TestFailed, 'writelines()'
+	finally:
+		fp.close()
+os.unlink(fn)
 
 print 'ord'
 if ord(' ') <> 32: raise TestFailed, 'ord(\' \')'
@@ -308,6 +308,16 @@ elif 0: pass
 elif 0: pass
 elif 0: pass
 else: pass
+# Branches on constant tests are dropped; names stored there stay local
+x = 'global'
+def f():
+	if 0: x = 1
+	elif 1: y = 2
+	else: y = 3
+	try: x
+	except NameError: return y
+	raise TestFailed, 'dropped if branch'
+if f() <> 2: raise TestFailed, 'constant elif'
 
 print 'while_stmt' # 'while' test ':' suite ['else' ':' suite]
 while 0: pass
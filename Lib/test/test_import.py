@@ -0,0 +1,176 @@
+# Testing the directory listing cache used by import
+
+from test_support import *
+import imp, os, sys, time, tempfile
+
+print 'import test suite:'
+
+def write(dir, name):
+	f = open(os.path.join(dir, name + '.py'), 'w')
+	f.write('where = %s\n' % `dir`)
+	f.close()
+
+def found(name):
+	try:
+		m = __import__(name)
+	except ImportError:
+		return None
+	unload(name)
+	return m
+
+def cleanup(dir):
+	for name in os.listdir(dir):
+		if name not in (os.curdir, os.pardir):
+			os.unlink(os.path.join(dir, name))
+	os.rmdir(dir)
+
+now = int(time.time())
+cwd = os.getcwd()
+dirs = []
+for i in range(4):
+	dirs.append(tempfile.mktemp())
+	os.mkdir(dirs[i])
+a, b, c, d = tuple(dirs)
+path = sys.path[:]
+sys.path.insert(0, '')
+try:
+	# cache_stats() counts listings and the fopen() calls they save
+	os.chdir(a)
+	avoided, listed = imp.cache_stats()
+	if found('imptest_none') is not None:
+		raise TestFailed, 'imported a missing module'
+	avoided2, listed2 = imp.cache_stats()
+	cached = listed2 > listed
+	if cached and avoided2 <= avoided:
+		raise TestFailed, 'cache_stats: no fopen() calls avoided'
+
+	# Two directories with the same mtime, both current in turn
+	write(a, 'imptest_a')
+	write(b, 'imptest_b')
+	for dir in a, b:
+		os.utime(dir, (now-100, now-100))
+	m = found('imptest_a')
+	if m is None or m.where <> a:
+		raise TestFailed, 'import from current directory'
+	os.chdir(b)
+	m = found('imptest_b')
+	if m is None or m.where <> b:
+		raise TestFailed, 'listing of old current directory reused'
+	if found('imptest_a') is not None:
+		raise TestFailed, 'imported from old current directory'
+	os.chdir(cwd)
+
+	# A module created in the second the directory was last changed
+	# (as seen from a listing taken in that second) is found
+	sys.path[0] = c
+	os.utime(c, (now+100, now+100))
+	if found('imptest_c') is not None:
+		raise TestFailed, 'imported a missing module'
+	write(c, 'imptest_c')
+	os.utime(c, (now+100, now+100))
+	m = found('imptest_c')
+	if m is None or m.where <> c:
+		raise TestFailed, 'new module in a just changed directory'
+
+	# A module added without changing the mtime is found after
+	# invalidate_caches()
+	sys.path[0] = d
+	os.utime(d, (now-100, now-100))
+	if found('imptest_d') is not None:
+		raise TestFailed, 'imported a missing module'
+	write(d, 'imptest_d')
+	os.utime(d, (now-100, now-100))
+	if cached and found('imptest_d') is not None:
+		raise TestFailed, 'directory listing not cached'
+	imp.invalidate_caches()
+	m = found('imptest_d')
+	if m is None or m.where <> d:
+		raise TestFailed, 'invalidate_caches'
+finally:
+	os.chdir(cwd)
+	sys.path[:] = path
+	for dir in dirs:
+		cleanup(dir)
+
+# Module archives ($PYTHONARCHIVE) are opened once per process, so
+# they are tried in a child interpreter
+
+def findfile(path, names):
+	for dir in path:
+		for name in names:
+			file = os.path.join(dir, name)
+			if os.path.exists(file):
+				return file
+	return None
+
+python = findfile((os.curdir, os.path.join(sys.exec_prefix, 'bin')),
+		  ('python',))
+tools = os.path.join(os.pardir, os.path.join('Tools', 'scripts'))
+tools = findfile(sys.path, (tools, os.path.join(os.pardir, tools)))
+if python is None or tools is None:
+	print 'interpreter or Tools/scripts not found; archives not tested'
+	raise SystemExit
+
+sys.path.insert(0, tools)
+try:
+	import pyarchive
+finally:
+	del sys.path[0]
+
+def child(archive, names):
+	cmd = 'import imp\n'
+	for name in names:
+		cmd = cmd + 'try:\n\timport %s; print %s.x,\n' % (name, name)
+		cmd = cmd + 'except ImportError: print None,\n'
+		cmd = cmd + 'print imp.is_archived(%s)\n' % `name`
+	p = os.popen('PYTHONARCHIVE=%s %s -c "%s"' % (archive, python, cmd))
+	result = p.read()
+	p.close()
+	return result
+
+dir = tempfile.mktemp()
+os.mkdir(dir)
+archive = os.path.join(dir, 'test.pya')
+try:
+	modules = {}
+	names = []
+	for i in range(5):
+		name = 'arctest_%d' % i
+		names.append(name)
+		modules[name] = os.path.join(dir, name + '.py')
+		f = open(modules[name], 'w')
+		f.write('x = %d\n' % (i*i))
+		f.close()
+	pyarchive.writearchive(archive, modules)
+	for name in names:
+		os.unlink(modules[name])
+	good = child(archive, names)
+	if good <> '0 1\n1 1\n4 1\n9 1\n16 1\n':
+		raise TestFailed, 'import from archive gave ' + `good`
+	none = 'None 0\n' * len(names)
+
+	f = open(archive, 'rb')
+	data = f.read()
+	f.close()
+	n = len(names)
+	index = 12 + 12*n
+	tests = [
+		('bad archive magic', 'XXXX' + data[4:]),
+		('bad pyc magic',
+		 data[:4] + chr(ord(data[4])^1) + data[5:]),
+		('truncated index', data[:index-5]),
+		('truncated code', data[:-1]),
+		('index entries out of order',
+		 data[:12] + data[24:36] + data[12:24] + data[36:]),
+		('name inside the index',
+		 data[:12] + pyarchive.long4(8) + data[16:]),
+		]
+	for what, contents in tests:
+		f = open(archive, 'wb')
+		f.write(contents)
+		f.close()
+		result = child(archive, names)
+		if result <> none:
+			raise TestFailed, what + ' not rejected: ' + `result`
+finally:
+	cleanup(dir)
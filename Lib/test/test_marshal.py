@@ -0,0 +1,130 @@
+# Testing marshal
+
+from test_support import *
+import marshal, sys
+
+print 'marshal test suite:'
+
+def check(x, what):
+	y = marshal.loads(marshal.dumps(x))
+	if y <> x or type(y) <> type(x):
+		raise TestFailed, what + ': ' + `x` + ' read back as ' + `y`
+
+for x in (0, 1, -1, 0x7fffffff, -0x7fffffff-1, 3L, -(1L<<40), 0.5, 'ab',
+	  (1, 'a'), [2, (3,)], {'x': 4}, None):
+	check(x, 'round trip')
+
+# Floats and complex numbers keep every bit
+third = 1.0
+third = third/3
+for x in (third, 0.1, -2.5e-300*third, 1e300/third, complex(third, -0.1)):
+	check(x, 'float round trip')
+
+# Plain ints that need more than 32 bits, where a long has that many
+big = sys.maxint
+if big > 0x7fffffff:
+	x = 1
+	for i in range(32): x = x*2
+	for x in (x, x-1, x/4*3, -x/2-1, big, -big-1, big/3):
+		check(x, 'int over 32 bits')
+
+# Whatever the host, a 64-bit int keeps its value; it becomes a long
+# int where a plain int has only 32 bits
+if marshal.loads('I\000\136\320\262\000\000\000\000') <> 3000000000L:
+	raise TestFailed, '64-bit int'
+if marshal.loads('I\377\377\377\177\377\377\377\377') <> -2147483649L:
+	raise TestFailed, 'negative 64-bit int'
+
+# Constants folded by the compiler read back right from the .pyc
+import os, tempfile
+dir = tempfile.mktemp()
+os.mkdir(dir)
+fn = os.path.join(dir, 'marshalfold.py')
+f = open(fn, 'w')
+f.write('x = 1<<40\ny = 65536*65536\nz = 2**40\nw = -2147483649\n')
+f.write('v = -2147483648\nu = 3000000000\n')
+f.write('t = 1.0/3\ns = 0.1 + 0.2\nr = 2j/3 - 0.1\n')
+f.close()
+one, tenth = 1.0, 0.1
+sys.path.insert(0, dir)
+try:
+	for i in range(2):
+		import marshalfold
+		m = marshalfold
+		del marshalfold
+		unload('marshalfold')
+		if m.x <> 1L<<40 or m.y <> 1L<<32 or m.z <> 1L<<40 or \
+		   m.w <> -2147483649L or m.v <> -2147483648L or \
+		   m.u <> 3000000000L:
+			raise TestFailed, 'folded constants, import %d' % (i+1)
+		if m.t <> one/3 or m.s <> tenth + 0.2 or \
+		   m.r <> 2j*one/3 - tenth:
+			raise TestFailed, 'folded floats, import %d' % (i+1)
+		if i == 0 and not os.path.exists(fn + 'c'):
+			raise TestFailed, 'no .pyc written'
+finally:
+	del sys.path[0]
+	for name in (fn, fn + 'c'):
+		try: os.unlink(name)
+		except os.error: pass
+	os.rmdir(dir)
+
+# load() from a file, both below the size where the file gets mapped
+# and above it; the file stays positioned after each object
+for n in (10, 100000):
+	x = ['a'*n, 1, 2.5]
+	f = open(TESTFN, 'wb')
+	marshal.dump(x, f)
+	marshal.dump(7, f)
+	f.close()
+	f = open(TESTFN, 'rb')
+	try:
+		if marshal.load(f) <> x or marshal.load(f) <> 7:
+			raise TestFailed, 'load from file of %d bytes' % n
+	finally:
+		f.close()
+		os.unlink(TESTFN)
+
+# Version 1 writes repeated strings and shared tuples only once
+t = (1, 'spam')
+x = [t, t, 'eggs'*10, 'eggs'*10, ('eggs'*10, t)]
+s0 = marshal.dumps(x)
+s1 = marshal.dumps(x, 1)
+if len(s1) >= len(s0):
+	raise TestFailed, 'version 1 not smaller than version 0'
+y = marshal.loads(s1)
+if y <> x:
+	raise TestFailed, 'version 1 round trip: ' + `y`
+if y[0] is not y[1] or y[4][1] is not y[0] or y[2] is not y[3]:
+	raise TestFailed, 'version 1 does not share repeated objects'
+y = marshal.loads(s0)
+if y <> x or y[0] is y[1]:
+	raise TestFailed, 'version 0 round trip: ' + `y`
+
+# Neither version can write a list or dictionary that contains itself
+l = [1]
+l.append(l)
+d = {}
+d['d'] = (d,)
+for x in (l, d, [(l,)]):
+	for version in (0, 1):
+		try:
+			marshal.dumps(x, version)
+		except ValueError:
+			pass
+		else:
+			raise TestFailed, 'wrote recursive value in version %d' % \
+			      version
+del l[1], d['d']
+
+# A reference to an object not read yet, or to a tuple from inside
+# itself, is bad data
+for s in ('r\000\000\000\000', '\250\002\000\000\000Nr\001\000\000\000',
+	  'r\377\377\377\377', '\250\001\000\000\000r\000\000\000\000'):
+	try:
+		marshal.loads(s)
+	except ValueError, msg:
+		if msg <> 'bad marshal data (reference)':
+			raise TestFailed, 'bad reference gave ' + `msg`
+	else:
+		raise TestFailed, 'bad reference not rejected: ' + `s`
@@ -0,0 +1,97 @@
+# Testing mmap module
+
+from test_support import *
+import mmap, os, sys, tempfile, struct, string
+
+print 'mmap test suite:'
+
+fn = tempfile.mktemp()
+f = open(fn, 'w')
+f.write('abc\n' + struct.pack('i', 4711) + '\n' + 'x'*1000 + 'xyz\n')
+f.close()
+
+f = open(fn, 'r')
+m = mmap.mmap(f)
+f.close()
+if len(m) <> m.size() or m.size() <> 1013: raise TestFailed, 'mmap size'
+if m[0] <> 'a' or m[-1] <> '\n' or m[:3] <> 'abc': raise TestFailed, 'mmap item'
+if struct.unpack('i', m[4:8]) <> (4711,): raise TestFailed, 'mmap struct'
+if m.find('xyz') <> 1009 or m.find('q') <> -1 or m.find('c', 3) <> -1:
+	raise TestFailed, 'mmap find'
+if m.readline() <> 'abc\n' or m.tell() <> 4: raise TestFailed, 'mmap readline'
+m.seek(-4, 2)
+if m.read() <> 'xyz\n' or m.read() <> '': raise TestFailed, 'mmap read'
+try:
+	m[0] = 'b'
+except TypeError: pass
+else: raise TestFailed, 'assignment to read-only mmap'
+m.close()
+try:
+	m.read()
+except ValueError: pass
+else: raise TestFailed, 'read from closed mmap'
+
+f = open(fn, 'r+')
+m = mmap.mmap(f.fileno(), 4, 'w')
+m[0] = 'A'
+m[1:3] = 'BC'
+m.flush()
+m.close()
+c = mmap.mmap(f, 0, 'c')
+c.write('def')
+if c[:4] <> 'def\n': raise TestFailed, 'copy-on-write mmap'
+c.close()
+if f.read(4) <> 'ABC\n': raise TestFailed, 'write through mmap'
+for length, what in ((2000, 'greater'), (-1, 'negative')):
+	try:
+		m = mmap.mmap(f, length)
+	except ValueError, msg:
+		if string.find(msg, what) < 0:
+			raise TestFailed, 'mmap length %d: %s' % (length, msg)
+	else: raise TestFailed, 'mmap length %d' % length
+
+# close() while other threads use the mapping
+try:
+	import thread
+except ImportError:
+	thread = None
+if thread:
+	m = mmap.mmap(f)
+	done = thread.allocate_lock()
+	mutex = thread.allocate_lock()
+	left = 4
+	failures = []
+	def user():
+		global left
+		try:
+			try:
+				while 1:
+					if m[:1000][:3] <> 'ABC' or \
+					   m.find('xyz') <> 1009:
+						raise TestFailed, \
+						      'mmap read in thread'
+					m.read()
+					m.seek(0)
+			except ValueError:
+				pass
+			except:
+				failures.append((sys.exc_type, sys.exc_value))
+		finally:
+			mutex.acquire()
+			left = left - 1
+			if left == 0:
+				done.release()
+			mutex.release()
+	done.acquire()
+	for i in range(4):
+		thread.start_new_thread(user, ())
+	import time
+	time.sleep(0.1)
+	m.close()
+	done.acquire()
+	if failures:
+		raise failures[0][0], failures[0][1]
+	if not m.closed: raise TestFailed, 'closed mmap'
+f.close()
+
+os.unlink(fn)
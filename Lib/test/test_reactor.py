@@ -0,0 +1,74 @@
+# Testing reactor module
+
+from test_support import *
+import reactor
+from socket import *
+
+print 'reactor test suite:'
+
+# A server that answers lines; the client is a channel in the same reactor
+r = reactor.reactor()
+s = socket(AF_INET, SOCK_STREAM)
+s.bind('127.0.0.1', 0)
+s.listen(5)
+port = s.getsockname()[1]
+
+def server_message(ch, data):
+	if data == 'big':
+		ch.send('y'*1000000 + '\n')
+	elif data[:4] == 'size':
+		ch.set_terminator(eval(data[4:]))
+		ch.send('ok\n')
+	else:
+		ch.set_terminator('\r\n')
+		ch.send('got ' + data + '\n')
+def server_close(ch):
+	ch.send('bye\n')
+accepted = []
+def server_accept(ch, addr):
+	accepted.append(addr[0])
+lch = r.listen(s, '\r\n', server_message, server_close, server_accept)
+
+replies = []
+def client_message(ch, data):
+	replies.append(data)
+	if len(replies) == 3:
+		ch.send('size3\r\nabcnext\r\n')
+	elif len(replies) == 6:
+		cs.shutdown(1)
+def client_close(ch):
+	replies.append('closed')
+	r.stop()
+cs = socket(AF_INET, SOCK_STREAM)
+cs.connect('127.0.0.1', port)
+c = r.channel(cs, '\n', client_message, client_close)
+c.send('one\r\ntw')
+c.send('o\r\n')
+c.send('big\r\n')
+
+fired = []
+r.call_later(0.01, fired.append, (1,))
+r.cancel(r.call_later(0, fired.append, (2,)))
+r.run(10)
+if accepted <> ['127.0.0.1']: raise TestFailed, 'onaccept'
+if replies <> ['got one', 'got two', 'y'*1000000, 'ok', 'got abc',
+	       'got next', 'bye', 'closed']:
+	raise TestFailed, 'messages'
+if not c.closed or len(r.channels()) <> 1: raise TestFailed, 'close'
+if fired <> [1]: raise TestFailed, 'timers'
+
+# Exceptions in handlers come out of run()
+def fail():
+	raise KeyError, 'timer'
+r.call_later(0, fail)
+try:
+	r.run(10)
+except KeyError: pass
+else: raise TestFailed, 'exception in timer'
+
+r.close()
+if not lch.closed or r.channels() <> []: raise TestFailed, 'reactor close'
+try:
+	c.send('x')
+except ValueError: pass
+else: raise TestFailed, 'send on closed channel'
@@ -20,4 +20,34 @@ def test():
 			continue
 		print 'Heh?'
 
+def test_poll():
+	import select
+	import os
+	if not hasattr(select, 'poll'):
+		return
+	print 'poll'
+	r, w = os.pipe()
+	p = select.poll()
+	p.register(r, select.POLLIN)
+	p.register(w)
+	if p.poll(0) <> [(w, select.POLLOUT)]:
+		print 'poll(0) should find the pipe writable only'
+	p.unregister(w)
+	os.write(w, 'x')
+	if p.poll(None) <> [(r, select.POLLIN)]:
+		print 'poll() should find the pipe readable'
+	p.modify(r, select.POLLOUT)
+	if p.poll(100) <> []:
+		print 'poll(100) should time out'
+	try:
+		p.unregister(w)
+	except select.error:
+		pass
+	else:
+		print 'unregister() of an unknown descriptor should fail'
+	p.close()
+	os.close(r)
+	os.close(w)
+
+test_poll()
 test()
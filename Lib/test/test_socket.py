@@ -0,0 +1,193 @@
+# Testing receiving into buffers with socket objects
+
+from test_support import *
+from socket import *
+import array
+
+print 'socket test suite:'
+
+r = socket(AF_INET, SOCK_DGRAM)
+r.bind('127.0.0.1', 0)
+addr = r.getsockname()
+s = socket(AF_INET, SOCK_DGRAM)
+s.bind('127.0.0.1', 0)
+
+# Small messages asked for with a large bufsize
+for i in range(20):
+	msg = `i` * 100
+	s.sendto(msg, addr)
+	data, frm = r.recvfrom(65536)
+	if data <> msg or frm <> s.getsockname(): raise TestFailed, 'recvfrom'
+s.sendto('x' * 3000, addr)
+if r.recvfrom(65536)[0] <> 'x' * 3000: raise TestFailed, 'recvfrom large'
+
+a = array.array('c', '-' * 10)
+s.sendto('abc', addr)
+if r.recv_into(a) <> 3 or a.tostring() <> 'abc-------':
+	raise TestFailed, 'recv_into'
+s.sendto('defgh', addr)
+n, frm = r.recvfrom_into(a, 2)
+if n <> 2 or frm <> s.getsockname() or a.tostring() <> 'dec-------':
+	raise TestFailed, 'recvfrom_into'
+try:
+	r.recv_into(a, 11)
+except ValueError: pass
+else: raise TestFailed, 'recv_into beyond buffer'
+try:
+	r.recv_into('abc')
+except TypeError: pass
+else: raise TestFailed, 'recv_into string'
+
+# The buffer stays put while another thread waits in recv_into()
+try:
+	import thread
+except ImportError:
+	thread = None
+if thread:
+	import time
+	done = thread.allocate_lock()
+	got = []
+	def receiver(buf):
+		got.append(r.recv_into(buf))
+		done.release()
+	done.acquire()
+	thread.start_new_thread(receiver, (a,))
+	time.sleep(0.2)
+	try:
+		a.append('x')
+	except RuntimeError: pass
+	else: raise TestFailed, 'array resized during recv_into'
+	s.sendto('xyz', addr)
+	done.acquire()
+	a.append('x')
+	if got <> [3] or a.tostring() <> 'xyz-------x':
+		raise TestFailed, 'recv_into while resizing'
+	try:
+		import mmap
+	except ImportError:
+		mmap = None
+	if mmap:
+		import os, tempfile
+		fn = tempfile.mktemp()
+		f = open(fn, 'w+')
+		f.write('-' * 10)
+		f.flush()
+		m = mmap.mmap(f, 10, 'w')
+		thread.start_new_thread(receiver, (m,))
+		time.sleep(0.2)
+		m.close()
+		s.sendto('uvw', addr)
+		done.acquire()
+		f.seek(0)
+		if got[1] <> 3 or f.read() <> 'uvw-------' or not m.closed:
+			raise TestFailed, 'recv_into while closing'
+		f.close()
+		os.unlink(fn)
+
+r.close()
+s.close()
+
+# sendfile() over a connected pair of stream sockets
+if hasattr(socket(AF_INET, SOCK_STREAM), 'sendfile'):
+	import os, tempfile
+	fn = tempfile.mktemp()
+	f = open(fn, 'w')
+	f.write('0123456789' * 10000)
+	f.close()
+	l = socket(AF_INET, SOCK_STREAM)
+	l.bind('127.0.0.1', 0)
+	l.listen(1)
+	s = socket(AF_INET, SOCK_STREAM)
+	s.connect(l.getsockname())
+	c, addr = l.accept()
+	f = open(fn, 'r')
+	f.read(5)
+	if s.sendfile(f, 10, 3) <> 3 or f.tell() <> 5:
+		raise TestFailed, 'sendfile with offset'
+	if s.sendfile(f) <> 100000 - 5 or f.read() <> '':
+		raise TestFailed, 'sendfile from position'
+	f.close()
+	s.close()
+	data = ''
+	while 1:
+		buf = c.recv(65536)
+		if not buf: break
+		data = data + buf
+	if data <> '012' + ('0123456789' * 10000)[5:]:
+		raise TestFailed, 'sendfile data'
+	c.close()
+	l.close()
+	os.unlink(fn)
+
+# sendv() over a connected pair of stream sockets, with more buffers
+# than one sendmsg() call takes
+if hasattr(socket(AF_INET, SOCK_STREAM), 'sendv'):
+	l = socket(AF_INET, SOCK_STREAM)
+	l.bind('127.0.0.1', 0)
+	l.listen(1)
+	s = socket(AF_INET, SOCK_STREAM)
+	s.connect(l.getsockname())
+	c, addr = l.accept()
+	bufs = ['abc', '', 'x' * 5000]
+	for i in range(2000):
+		bufs.append(`i`)
+	sent = ''
+	for buf in bufs:
+		sent = sent + buf
+	if s.sendv(bufs) <> len(sent): raise TestFailed, 'sendv count'
+	if s.sendv(('tail',)) <> 4: raise TestFailed, 'sendv tuple'
+	if s.sendv([]) <> 0: raise TestFailed, 'sendv nothing'
+	for bad in (['abc', 1], [None], 5):
+		try:
+			s.sendv(bad)
+		except TypeError: pass
+		else: raise TestFailed, 'sendv of ' + `bad`
+	s.close()
+	data = ''
+	while 1:
+		buf = c.recv(65536)
+		if not buf: break
+		data = data + buf
+	if data <> sent + 'tail': raise TestFailed, 'sendv data'
+	c.close()
+	l.close()
+
+# Host name lookups, from a hosts file instead of the resolver
+import os, tempfile, time
+fn = tempfile.mktemp()
+f = open(fn, 'w')
+f.write('# Test hosts\n10.0.0.1\tAlpha alpha.test  # first\n10.0.0.2 beta\n')
+f.close()
+sethostsfile(fn)
+if gethostbyname('ALPHA') <> '10.0.0.1' or gethostbyname('alpha.test') <> '10.0.0.1' \
+   or gethostbyname('beta') <> '10.0.0.2':
+	raise TestFailed, 'hosts file'
+try:
+	gethostbyname('gamma')
+except error: pass
+else: raise TestFailed, 'unknown host'
+f = open(fn, 'w')
+f.write('10.0.0.3 alpha\n10.0.0.4 gamma\n')
+f.close()
+if gethostbyname('alpha') <> '10.0.0.1': raise TestFailed, 'cached address'
+try:
+	gethostbyname('gamma')
+except error: pass
+else: raise TestFailed, 'cached failure'
+flushdnscache()
+if gethostbyname('alpha') <> '10.0.0.3' or gethostbyname('gamma') <> '10.0.0.4':
+	raise TestFailed, 'flushdnscache'
+f = open(fn, 'w')
+f.write('10.0.0.5 alpha\n10.0.0.6 delta\n')
+f.close()
+setdnscache(0)
+if gethostbyname('alpha') <> '10.0.0.5': raise TestFailed, 'cache disabled'
+setdnscache(60)
+prefetch('delta')
+time.sleep(0.5)
+f = open(fn, 'w')
+f.write('10.0.0.7 delta\n')
+f.close()
+if gethostbyname('delta') <> '10.0.0.6': raise TestFailed, 'prefetch'
+sethostsfile()
+os.unlink(fn)
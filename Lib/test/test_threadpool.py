@@ -0,0 +1,110 @@
+# Testing thread pools and futures
+
+from test_support import *
+import thread, time
+
+print 'thread pool test suite:'
+
+def square(x):
+	return x*x
+
+p = thread.pool(4)
+fs = []
+for i in range(100):
+	fs.append(p.submit(square, (i,)))
+for i in range(100):
+	if fs[i].result() <> i*i: raise TestFailed, 'result'
+if not fs[0].done(): raise TestFailed, 'done'
+
+# Exceptions come out of result(), every time it's called
+def fail():
+	raise KeyError, 'task'
+f = p.submit(fail)
+for i in range(2):
+	try:
+		f.result()
+	except KeyError, v:
+		if v <> 'task': raise TestFailed, 'exception value'
+	else: raise TestFailed, 'exception in task'
+
+# Waiting with a timeout
+lock = thread.allocate_lock()
+lock.acquire()
+f = p.submit(lock.acquire)
+if f.wait(0.05) or f.done(): raise TestFailed, 'wait timeout'
+try:
+	f.result(0)
+except thread.error: pass
+else: raise TestFailed, 'result timeout'
+lock.release()
+if not f.wait(10) or f.result() is not None: raise TestFailed, 'wait'
+lock.release()
+
+p.shutdown()
+try:
+	p.submit(square, (1,))
+except thread.error: pass
+else: raise TestFailed, 'submit after shutdown'
+
+# A bounded queue blocks submit() until there's room; shutdown() lets
+# the queued tasks finish
+done = []
+p = thread.pool(1, 2)
+lock.acquire()
+p.submit(lock.acquire)
+p.submit(done.append, (1,))
+p.submit(done.append, (2,))
+def unblock():
+	time.sleep(0.1)
+	lock.release()
+thread.start_new_thread(unblock, ())
+t = time.time()
+p.submit(done.append, (3,))
+if time.time() - t < 0.05: raise TestFailed, 'bounded queue'
+p.shutdown()
+if done <> [1, 2, 3]: raise TestFailed, 'shutdown'
+
+# A task can't wait for its own pool to shut down, but can close it
+p = thread.pool(2)
+f = p.submit(p.shutdown)
+try:
+	f.result(10)
+except thread.error, msg:
+	if msg == 'timed out': raise TestFailed, 'shutdown(1) from a task hangs'
+else: raise TestFailed, 'shutdown(1) from a task'
+if p.submit(square, (3,)).result(10) <> 9:
+	raise TestFailed, 'pool closed by failed shutdown'
+if p.submit(p.shutdown, (0,)).result(10) is not None:
+	raise TestFailed, 'shutdown(0) from a task'
+p.shutdown()
+
+# A pool that is dropped without shutdown() runs the tasks already
+# queued, and then its workers exit
+def nthreads():
+	try:
+		f = open('/proc/self/status')
+	except IOError:
+		return None
+	for line in f.readlines():
+		if line[:8] == 'Threads:':
+			return eval(line[8:])
+	return None
+
+before = nthreads()
+p = thread.pool(3)
+lock = thread.allocate_lock()
+lock.acquire()
+fs = [p.submit(lock.acquire)]
+for i in range(5):
+	fs.append(p.submit(square, (i,)))
+del p
+lock.release()
+for i in range(5):
+	if fs[i+1].result(10) <> i*i: raise TestFailed, 'task of dropped pool'
+lock.release()
+if before is not None:
+	for i in range(100):
+		if nthreads() == before: break
+		time.sleep(0.05)
+	else:
+		raise TestFailed, 'workers of dropped pool still running'
@@ -0,0 +1,78 @@
+# Testing thread queue objects
+
+from test_support import *
+import thread, time
+
+print 'thread queue test suite:'
+
+q = thread.allocate_queue(3)
+for i in range(4):
+	q.put(i)
+if q.qsize() <> 4: raise TestFailed, 'rounded size'
+try:
+	q.put(4, 0)
+except thread.error: pass
+else: raise TestFailed, 'put on full queue'
+try:
+	q.put(4, 0.05)
+except thread.error: pass
+else: raise TestFailed, 'put timeout'
+if q.get() <> 0 or q.get(0) <> 1: raise TestFailed, 'get'
+if q.get_many(5) <> [2, 3]: raise TestFailed, 'get_many'
+t = time.time()
+try:
+	q.get(0.05)
+except thread.error: pass
+else: raise TestFailed, 'get timeout'
+if time.time() - t < 0.04: raise TestFailed, 'get timeout too short'
+if q.get_many(0) <> [] or q.qsize() <> 0: raise TestFailed, 'empty'
+try:
+	thread.allocate_queue(0)
+except ValueError: pass
+else: raise TestFailed, 'queue size'
+
+# Items left in a queue are released with it
+x = []
+q.put(x)
+del q
+import sys
+if sys.getrefcount(x) <> 2: raise TestFailed, 'dealloc'
+
+# Blocking get and put, with several producers and consumers
+NPROD = NCONS = 4
+N = 2000
+q = thread.allocate_queue(8)
+done = thread.allocate_queue(NPROD + NCONS)
+totals = []
+def producer(i):
+	for j in range(N):
+		q.put(i*N + j)
+	done.put(None)
+def consumer():
+	sum = 0
+	while 1:
+		items = q.get_many(10)
+		for i in range(len(items)):
+			x = items[i]
+			if x is None:
+				# Pass on the stop signals meant for others
+				for x in items[i+1:]:
+					q.put(x)
+				totals.append(sum)
+				done.put(None)
+				return
+			sum = sum + x
+for i in range(NCONS):
+	thread.start_new_thread(consumer, ())
+for i in range(NPROD):
+	thread.start_new_thread(producer, (i,))
+for i in range(NPROD):
+	done.get(30)
+for i in range(NCONS):
+	q.put(None)
+for i in range(NCONS):
+	done.get(30)
+sum = 0
+for x in totals:
+	sum = sum + x
+if sum <> (NPROD*N - 1) * NPROD*N / 2: raise TestFailed, 'items lost'
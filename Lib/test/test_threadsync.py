@@ -0,0 +1,99 @@
+# Testing semaphores, conditions and reader-writer locks
+
+from test_support import *
+import thread, time
+
+print 'thread synchronization test suite:'
+
+# Timeouts
+l = thread.allocate_lock()
+if l.acquire(1, 0.01) <> 1: raise TestFailed, 'lock acquire'
+t = time.time()
+if l.acquire(1, 0.05) <> 0 or time.time() - t < 0.04:
+	raise TestFailed, 'lock timeout'
+if l.acquire(0) <> 0: raise TestFailed, 'lock nowait'
+l.release()
+
+s = thread.allocate_semaphore(2)
+s.acquire()
+if s.acquire(0) <> 1 or s.acquire(1, 0.01) <> 0: raise TestFailed, 'semaphore'
+s.release()
+if s.acquire(1, 0.01) <> 1: raise TestFailed, 'semaphore release'
+
+# A condition: consumers wait for items, the producer notifies
+c = thread.allocate_condition()
+items = []
+got = []
+done = thread.allocate_semaphore(0)
+def consumer():
+	c.acquire()
+	while not items:
+		c.wait()
+	got.append(items[0])
+	del items[0]
+	c.release()
+	done.release()
+for i in range(3):
+	thread.start_new_thread(consumer, ())
+for i in range(3):
+	c.acquire()
+	items.append(i)
+	c.notify()
+	c.release()
+for i in range(3):
+	if done.acquire(1, 10) <> 1: raise TestFailed, 'notify'
+got.sort()
+if got <> [0, 1, 2]: raise TestFailed, 'condition'
+c.acquire()
+if c.wait(0.01) <> 0: raise TestFailed, 'wait timeout'
+c.notify_all()
+c.release()
+try:
+	c.wait()
+except thread.error: pass
+else: raise TestFailed, 'wait without the lock'
+
+# Readers share a rwlock; a writer excludes them
+rw = thread.allocate_rwlock()
+rw.acquire_read()
+if rw.acquire_read(0) <> 1 or rw.acquire_write(1, 0.01) <> 0:
+	raise TestFailed, 'rwlock readers'
+rw.release()
+rw.release()
+rw.acquire_write()
+if rw.acquire_read(1, 0.01) <> 0 or rw.acquire_write(0) <> 0:
+	raise TestFailed, 'rwlock writer'
+def reader():
+	rw.acquire_read()
+	rw.release()
+	done.release()
+thread.start_new_thread(reader, ())
+if done.acquire(1, 0.05) <> 0: raise TestFailed, 'reader not blocked'
+rw.release()
+if done.acquire(1, 10) <> 1: raise TestFailed, 'reader woken'
+rw = thread.allocate_rwlock()
+try:
+	rw.release()
+except thread.error: pass
+else: raise TestFailed, 'release unlocked rwlock'
+if rw.acquire_write(0) <> 1: raise TestFailed, 'rwlock after bad release'
+rw.release()
+
+# Queue uses conditions
+import Queue
+q = Queue.Queue(2)
+def producer():
+	for i in range(100):
+		q.put(i)
+thread.start_new_thread(producer, ())
+for i in range(100):
+	if q.get() <> i: raise TestFailed, 'Queue'
+try:
+	q.get_nowait()
+except Queue.Empty: pass
+else: raise TestFailed, 'Queue.get_nowait'
+
+# Lock counters, if there are any
+for name, stats in thread.lock_stats().items():
+	locks, contended, sleeps = stats
+	if contended > locks or locks < 0: raise TestFailed, 'lock_stats ' + name
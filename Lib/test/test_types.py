@@ -71,6 +71,15 @@ if not -24 < -12: raise TestFailed, 'int op'
 xsize, ysize, zsize = 238, 356, 4
 if not (xsize*ysize*zsize == zsize*xsize*ysize == 338912):
 	raise TestFailed, 'int mul commutativity'
+# Constant expressions are folded by the compiler
+if 2*3+1 <> 7 or -(3) <> -3 or ~5 <> -6 or 3^5|8&12 <> 14 or 1<<3 <> 8:
+	raise TestFailed, 'folded int constant'
+if -2**2 <> -4 or 7%3 <> 1 or 7/2 <> 3 or 'ab'*2 <> 'abab':
+	raise TestFailed, 'folded constant'
+try:
+	x = 1/0
+except ZeroDivisionError: pass
+else: raise TestFailed, 'folded 1/0'
 print '6.4.2 Long integers'
 if 12L + 24L <> 36L: raise TestFailed, 'long op'
 if 12L + (-24L) <> -12L: raise TestFailed, 'long op'
@@ -78,6 +87,17 @@ if (-12L) + 24L <> 12L: raise TestFailed, 'long op'
 if (-12L) + (-24L) <> -36L: raise TestFailed, 'long op'
 if not 12L < 24L: raise TestFailed, 'long op'
 if not -24L < -12L: raise TestFailed, 'long op'
+x = 7L ** 3000
+y = 3L ** 4000 + 1
+if (x+y)*(x-y) <> x*x - y*y: raise TestFailed, 'big long mul'
+if x*x <> 7L ** 6000: raise TestFailed, 'big long square'
+for z in (7L ** 10, -7L ** 100, 2L ** 1000 - 1, 7L ** 500, -y):
+	if z*z <> z*(z+0L): raise TestFailed, 'long square'
+if x*17L*y <> (x*y)*17L: raise TestFailed, 'lopsided long mul'
+if eval(`x`) <> x or eval(`-y`) <> -y: raise TestFailed, 'big long repr'
+if eval(hex(x)) <> x or eval(oct(-y)) <> -y: raise TestFailed, 'big long hex/oct'
+if pow(x, 1001L, y) <> x**1001L % y: raise TestFailed, 'big long pow'
+if pow(-x, 99L, -y) <> (-x)**99L % -y: raise TestFailed, 'big long pow'
 print '6.4.3 Floating point numbers'
 if 12.0 + 24.0 <> 36.0: raise TestFailed, 'float op'
 if 12.0 + (-24.0) <> -12.0: raise TestFailed, 'float op'
@@ -111,6 +131,9 @@ if 0*(1,2,3) <> (): raise TestFailed, 'tuple repetition 0*'
 if min((1,2)) <> 1 or max((1,2)) <> 2: raise TestFailed, 'min/max tuple'
 if 0 in (0,1,2) and 1 in (0,1,2) and 2 in (0,1,2) and 3 not in (0,1,2): pass
 else: raise TestFailed, 'in/not in tuple'
+x, y = (1, (2, 3)), (1.0, (2, 3.0))
+if type(y[0]) <> type(1.0) or type(y[1][1]) <> type(1.0):
+	raise TestFailed, 'equal tuple constants merged'
 
 print '6.5.3 Lists'
 if len([]) <> 0: raise TestFailed, 'len([])'
@@ -37,6 +37,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "allobjects.h"
 #include "modsupport.h"
 #include "ceval.h"
+#include "pymutex.h"
 #ifdef STDC_HEADERS
 #include <stddef.h>
 #else
@@ -56,6 +57,7 @@ typedef struct arrayobject {
 	OB_VARHEAD
 	char *ob_item;
 	struct arraydescr *ob_descr;
+	long ob_exports;	/* Buffers handed out and not released */
 } arrayobject;
 
 staticforward typeobject Arraytype;
@@ -274,6 +276,7 @@ newarrayobject(size, descr)
 	op->ob_type = &Arraytype;
 	op->ob_size = size;
 	op->ob_descr = descr;
+	op->ob_exports = 0;
 	NEWREF(op);
 	return (object *) op;
 }
@@ -307,6 +310,21 @@ getarrayitem(op, i)
 	return (*ap->ob_descr->getitem)(ap, i);
 }
 
+/* The items mustn't move while a buffer handed out is in use, since
+   its user may be working on it without the interpreter lock */
+
+static int
+array_resizable(a)
+	arrayobject *a;
+{
+	if (a->ob_exports > 0) {
+		err_setstr(RuntimeError,
+			   "can't resize an array while its buffer is in use");
+		return 0;
+	}
+	return 1;
+}
+
 static int
 ins1(self, where, v)
 	arrayobject *self;
@@ -320,6 +338,8 @@ ins1(self, where, v)
 	}
 	if ((*self->ob_descr->setitem)(self, -1, v) < 0)
 		return -1;
+	if (!array_resizable(self))
+		return -1;
 	items = self->ob_item;
 	RESIZE(items, char, (self->ob_size+1) * self->ob_descr->itemsize);
 	if (items == NULL) {
@@ -539,6 +559,8 @@ array_ass_slice(a, ilow, ihigh, v)
 		ihigh = a->ob_size;
 	item = a->ob_item;
 	d = n - (ihigh-ilow);
+	if (d != 0 && !array_resizable(a))
+		return -1;
 	if (d < 0) { /* Delete -d items */
 		memmove(item + (ihigh+d)*a->ob_descr->itemsize,
 			item + ihigh*a->ob_descr->itemsize,
@@ -797,6 +819,8 @@ array_fromfile(self, args)
 		err_setstr(TypeError, "arg1 must be open file");
 		return NULL;
 	}
+	if (n > 0 && !array_resizable(self))
+		return NULL;
 	if (n > 0) {
 		char *item = self->ob_item;
 		int itemsize = self->ob_descr->itemsize;
@@ -822,6 +846,37 @@ array_fromfile(self, args)
 	return None;
 }
 
+static object *
+array_readinto(self, args)
+	arrayobject *self;
+	object *args;
+{
+	object *f;
+	int start = 0, n = -1;
+	int itemsize = self->ob_descr->itemsize;
+	FILE *fp;
+	if (!newgetargs(args, "O|ii:readinto", &f, &start, &n))
+		return NULL;
+	fp = getfilefile(f);
+	if (fp == NULL) {
+		err_setstr(TypeError, "arg1 must be open file");
+		return NULL;
+	}
+	if (start < 0 || start > self->ob_size) {
+		err_setstr(IndexError, "readinto start out of range");
+		return NULL;
+	}
+	if (n < 0 || n > self->ob_size - start)
+		n = self->ob_size - start;
+	n = fread(self->ob_item + start*itemsize, itemsize, n, fp);
+	if (ferror(fp)) {
+		err_errno(IOError);
+		clearerr(fp);
+		return NULL;
+	}
+	return newintobject((long)n);
+}
+
 static object *
 array_tofile(self, args)
 	arrayobject *self;
@@ -863,6 +918,8 @@ array_fromlist(self, args)
 		return NULL;
 	}
 	n = getlistsize(list);
+	if (n > 0 && !array_resizable(self))
+		return NULL;
 	if (n > 0) {
 		char *item = self->ob_item;
 		int i;
@@ -924,6 +981,8 @@ array_fromstring(self, args)
 		return NULL;
 	}
 	n = n / itemsize;
+	if (n > 0 && !array_resizable(self))
+		return NULL;
 	if (n > 0) {
 		char *item = self->ob_item;
 		RESIZE(item, char, (self->ob_size + n) * itemsize);
@@ -960,6 +1019,7 @@ static struct methodlist array_methods[] = {
 /*	{"index",	(method)array_index},*/
 	{"insert",	(method)array_insert},
 	{"read",	(method)array_fromfile},
+	{"readinto",	(method)array_readinto, 1},
 /*	{"remove",	(method)array_remove},*/
 	{"reverse",	(method)array_reverse},
 /*	{"sort",	(method)array_sort},*/
@@ -1079,6 +1139,35 @@ static sequence_methods array_as_sequence = {
 	(intintobjargproc)array_ass_slice,	/*sq_ass_slice*/
 };
 
+static int
+array_buffer(a, ptr)
+	arrayobject *a;
+	void **ptr;
+{
+	long n;
+	do {
+		n = a->ob_exports;
+	} while (!Py_AtomicCAS(&a->ob_exports, n, n+1));
+	*ptr = (void *)a->ob_item;
+	return a->ob_size * a->ob_descr->itemsize;
+}
+
+static void
+array_releasebuffer(a)
+	arrayobject *a;
+{
+	long n;
+	do {
+		n = a->ob_exports;
+	} while (!Py_AtomicCAS(&a->ob_exports, n, n-1));
+}
+
+static buffer_procs array_as_buffer = {
+	(getreadbufferproc)array_buffer, /*bf_getreadbuffer*/
+	(getwritebufferproc)array_buffer, /*bf_getwritebuffer*/
+	(releasebufferproc)array_releasebuffer, /*bf_releasebuffer*/
+};
+
 statichere typeobject Arraytype = {
 	OB_HEAD_INIT(&Typetype)
 	0,
@@ -1094,6 +1183,12 @@ statichere typeobject Arraytype = {
 	0,				/*tp_as_number*/
 	&array_as_sequence,		/*tp_as_sequence*/
 	0,				/*tp_as_mapping*/
+	0,				/*tp_hash*/
+	0,				/*tp_call*/
+	0,				/*tp_str*/
+	0,				/*tp_getattro*/
+	0,				/*tp_setattro*/
+	&array_as_buffer,		/*tp_as_buffer*/
 };
 
 
@@ -76,6 +76,7 @@ Other environment variables:\n\
 PYTHONSTARTUP: file executed on interactive startup (no default)\n\
 PYTHONPATH   : colon-separated list of directories prefixed to the\n\
                default module search path.  The result is sys.path.\n\
+PYTHONARCHIVE: module archive searched before sys.path (no default)\n\
 ";
 
 
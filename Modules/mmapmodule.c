@@ -0,0 +1,679 @@
+/***********************************************************
+Copyright 1991-1995 by Stichting Mathematisch Centrum, Amsterdam,
+The Netherlands.
+
+                        All Rights Reserved
+
+Permission to use, copy, modify, and distribute this software and its
+documentation for any purpose and without fee is hereby granted,
+provided that the above copyright notice appear in all copies and that
+both that copyright notice and this permission notice appear in
+supporting documentation, and that the names of Stichting Mathematisch
+Centrum or CWI or Corporation for National Research Initiatives or
+CNRI not be used in advertising or publicity pertaining to
+distribution of the software without specific, written prior
+permission.
+
+While CWI is the initial source for this software, a modified version
+is made available by the Corporation for National Research Initiatives
+(CNRI) at the Internet address ftp://ftp.python.org.
+
+STICHTING MATHEMATISCH CENTRUM AND CNRI DISCLAIM ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL STICHTING MATHEMATISCH
+CENTRUM OR CNRI BE LIABLE FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL
+DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+
+******************************************************************/
+
+/* mmap module -- memory-mapped files.
+
+   mmap.mmap(file, [length, [mode]]) maps a file, given as a file object
+   or a file descriptor, into memory.  The mapping behaves as a mutable
+   sequence of characters of fixed length: indexing gives one-character
+   strings and slicing gives strings, so only the bytes asked for are
+   copied out of the file.  It also has file-like methods (read,
+   readline, seek, tell, write) operating on a position of its own, and
+   find(), which searches the mapping in place.
+
+   The mode is 'r' for a read-only mapping (the default), 'w' for a
+   mapping through which the file is written, or 'c' for a private
+   copy-on-write mapping whose changes don't go to the file. */
+
+#include "allobjects.h"
+#include "modsupport.h"
+#include "ceval.h"
+#include "pymutex.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FAILED
+#define MAP_FAILED ((char *)-1)
+#endif
+
+static object *MmapError;
+
+typedef struct {
+	OB_HEAD
+	char *m_data;
+	int m_size;
+	int m_pos;		/* Position for read(), write() etc. */
+	int m_writable;
+	long m_users;		/* Uses and the CLOSED bit; see below */
+} mmapobject;
+
+staticforward typeobject Mmaptype;
+
+#define is_mmapobject(v) ((v)->ob_type == &Mmaptype)
+
+/* m_users counts the calls using the mapped memory, in steps of USE,
+   and has the CLOSED bit set by close().  The memory is only unmapped
+   once the mapping is closed and no call uses it any more, so a close()
+   from another thread can't pull it away from under a call that runs
+   without the interpreter lock: in free-threaded builds, or with the
+   lock released.  Calls that only look at m_pos or m_size don't count
+   as uses. */
+
+#define CLOSED	1L
+#define USE	2L
+
+#define mmap_closed(m) (((m)->m_users & CLOSED) != 0)
+
+static void
+mmap_done(m)
+	mmapobject *m;
+{
+	long u;
+	do {
+		u = m->m_users;
+	} while (!Py_AtomicCAS(&m->m_users, u, u - USE));
+	if (u - USE == CLOSED)
+		munmap(m->m_data, (size_t)m->m_size);
+}
+
+/* Return the address of the mapped memory, which stays valid until the
+   matching mmap_done(), or NULL with an exception set */
+
+static char *
+mmap_use(m)
+	mmapobject *m;
+{
+	long u;
+	do {
+		u = m->m_users;
+		if (u & CLOSED) {
+			err_setstr(ValueError,
+				   "I/O operation on closed mapping");
+			return NULL;
+		}
+	} while (!Py_AtomicCAS(&m->m_users, u, u + USE));
+	return m->m_data;
+}
+
+static int
+mmap_check(m)
+	mmapobject *m;
+{
+	if (mmap_closed(m)) {
+		err_setstr(ValueError, "I/O operation on closed mapping");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+mmap_check_writable(m)
+	mmapobject *m;
+{
+	if (!mmap_check(m))
+		return 0;
+	if (!m->m_writable) {
+		err_setstr(TypeError, "mapping is read-only");
+		return 0;
+	}
+	return 1;
+}
+
+static void
+mmap_unmap(m)
+	mmapobject *m;
+{
+	long u;
+	do {
+		u = m->m_users;
+		if (u & CLOSED)
+			return;
+	} while (!Py_AtomicCAS(&m->m_users, u, u | CLOSED));
+	if (u == 0)
+		munmap(m->m_data, (size_t)m->m_size);
+}
+
+/* Methods */
+
+static void
+mmap_dealloc(m)
+	mmapobject *m;
+{
+	mmap_unmap(m);
+	DEL(m);
+}
+
+static object *
+mmap_close(m, args)
+	mmapobject *m;
+	object *args;
+{
+	if (!newgetargs(args, ":close"))
+		return NULL;
+	mmap_unmap(m);
+	INCREF(None);
+	return None;
+}
+
+/* The search is that of strop.find(): look for the first character,
+   here with memchr(), and compare the rest where it matches */
+
+static object *
+mmap_find(m, args)
+	mmapobject *m;
+	object *args;
+{
+	char *data, *sub, *s, *p = NULL, *end;
+	int n, i = 0;
+
+	if (!newgetargs(args, "s#|i:find", &sub, &n, &i))
+		return NULL;
+	if (!mmap_check(m))
+		return NULL;
+	if (i < 0)
+		i += m->m_size;
+	if (i < 0)
+		i = 0;
+	if (n == 0)
+		return newintobject((long)(i <= m->m_size ? i : -1));
+	if (i > m->m_size - n)
+		return newintobject(-1L);
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	s = data + i;
+	end = data + m->m_size - n + 1;
+	while (s < end && (p = memchr(s, sub[0], end - s)) != NULL) {
+		if (n == 1 || memcmp(p+1, sub+1, n-1) == 0)
+			break;
+		s = p+1;
+	}
+	mmap_done(m);
+	if (s >= end || p == NULL)
+		return newintobject(-1L);
+	return newintobject((long)(p - data));
+}
+
+static object *
+mmap_flush(m, args)
+	mmapobject *m;
+	object *args;
+{
+	char *data;
+	int res;
+
+	if (!newgetargs(args, ":flush"))
+		return NULL;
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	if (m->m_writable) {
+		BGN_SAVE
+		res = msync(data, (size_t)m->m_size, MS_SYNC);
+		END_SAVE
+		if (res != 0) {
+			mmap_done(m);
+			return err_errno(MmapError);
+		}
+	}
+	mmap_done(m);
+	INCREF(None);
+	return None;
+}
+
+static object *
+mmap_read(m, args)
+	mmapobject *m;
+	object *args;
+{
+	char *data;
+	int n = -1, pos = m->m_pos;
+	object *v;
+
+	if (!newgetargs(args, "|i:read", &n))
+		return NULL;
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	if (n < 0 || n > m->m_size - pos)
+		n = m->m_size - pos;
+	v = newsizedstringobject(data + pos, n);
+	mmap_done(m);
+	if (v != NULL)
+		m->m_pos = pos + n;
+	return v;
+}
+
+static object *
+mmap_readline(m, args)
+	mmapobject *m;
+	object *args;
+{
+	char *data, *start, *p;
+	int n, pos = m->m_pos;
+	object *v;
+
+	if (!newgetargs(args, ":readline"))
+		return NULL;
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	start = data + pos;
+	n = m->m_size - pos;
+	if ((p = memchr(start, '\n', n)) != NULL)
+		n = p+1 - start;
+	v = newsizedstringobject(start, n);
+	mmap_done(m);
+	if (v != NULL)
+		m->m_pos = pos + n;
+	return v;
+}
+
+static object *
+mmap_seek(m, args)
+	mmapobject *m;
+	object *args;
+{
+	int pos, whence = 0;
+
+	if (!newgetargs(args, "i|i:seek", &pos, &whence))
+		return NULL;
+	if (!mmap_check(m))
+		return NULL;
+	if (whence == 1)
+		pos += m->m_pos;
+	else if (whence == 2)
+		pos += m->m_size;
+	else if (whence != 0) {
+		err_setstr(ValueError, "bad whence argument");
+		return NULL;
+	}
+	if (pos < 0 || pos > m->m_size) {
+		err_setstr(ValueError, "seek out of range");
+		return NULL;
+	}
+	m->m_pos = pos;
+	INCREF(None);
+	return None;
+}
+
+static object *
+mmap_size(m, args)
+	mmapobject *m;
+	object *args;
+{
+	if (!newgetargs(args, ":size"))
+		return NULL;
+	if (!mmap_check(m))
+		return NULL;
+	return newintobject((long)m->m_size);
+}
+
+static object *
+mmap_tell(m, args)
+	mmapobject *m;
+	object *args;
+{
+	if (!newgetargs(args, ":tell"))
+		return NULL;
+	if (!mmap_check(m))
+		return NULL;
+	return newintobject((long)m->m_pos);
+}
+
+static object *
+mmap_write(m, args)
+	mmapobject *m;
+	object *args;
+{
+	char *data, *s;
+	int n, pos = m->m_pos;
+
+	if (!newgetargs(args, "s#:write", &s, &n))
+		return NULL;
+	if (!mmap_check_writable(m))
+		return NULL;
+	if (n > m->m_size - pos) {
+		err_setstr(ValueError, "data out of range");
+		return NULL;
+	}
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	memcpy(data + pos, s, n);
+	mmap_done(m);
+	m->m_pos = pos + n;
+	INCREF(None);
+	return None;
+}
+
+static struct methodlist mmap_methods[] = {
+	{"close",	(method)mmap_close,	1},
+	{"find",	(method)mmap_find,	1},
+	{"flush",	(method)mmap_flush,	1},
+	{"read",	(method)mmap_read,	1},
+	{"readline",	(method)mmap_readline,	1},
+	{"seek",	(method)mmap_seek,	1},
+	{"size",	(method)mmap_size,	1},
+	{"tell",	(method)mmap_tell,	1},
+	{"write",	(method)mmap_write,	1},
+	{NULL,		NULL}		/* sentinel */
+};
+
+static object *
+mmap_getattr(m, name)
+	mmapobject *m;
+	char *name;
+{
+	if (strcmp(name, "closed") == 0)
+		return newintobject((long)mmap_closed(m));
+	return findmethod(mmap_methods, (object *)m, name);
+}
+
+/* Sequence methods */
+
+static int
+mmap_length(m)
+	mmapobject *m;
+{
+	if (!mmap_check(m))
+		return -1;
+	return m->m_size;
+}
+
+static object *
+mmap_item(m, i)
+	mmapobject *m;
+	int i;
+{
+	char *data;
+	object *v;
+
+	if (!mmap_check(m))
+		return NULL;
+	if (i < 0 || i >= m->m_size) {
+		err_setstr(IndexError, "mmap index out of range");
+		return NULL;
+	}
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	v = newsizedstringobject(data + i, 1);
+	mmap_done(m);
+	return v;
+}
+
+static object *
+mmap_slice(m, i, j)
+	mmapobject *m;
+	int i, j;
+{
+	char *data;
+	object *v;
+
+	if (i < 0)
+		i = 0;
+	if (j > m->m_size)
+		j = m->m_size;
+	if (j < i)
+		j = i;
+	if ((data = mmap_use(m)) == NULL)
+		return NULL;
+	v = newsizedstringobject(data + i, j - i);
+	mmap_done(m);
+	return v;
+}
+
+static int
+mmap_ass_item(m, i, v)
+	mmapobject *m;
+	int i;
+	object *v;
+{
+	char *data;
+
+	if (!mmap_check_writable(m))
+		return -1;
+	if (i < 0 || i >= m->m_size) {
+		err_setstr(IndexError, "mmap assignment index out of range");
+		return -1;
+	}
+	if (v == NULL || !is_stringobject(v) || getstringsize(v) != 1) {
+		err_setstr(IndexError,
+			   "mmap assignment must be a single-character string");
+		return -1;
+	}
+	if ((data = mmap_use(m)) == NULL)
+		return -1;
+	data[i] = getstringvalue(v)[0];
+	mmap_done(m);
+	return 0;
+}
+
+static int
+mmap_ass_slice(m, i, j, v)
+	mmapobject *m;
+	int i, j;
+	object *v;
+{
+	char *data;
+
+	if (!mmap_check_writable(m))
+		return -1;
+	if (i < 0)
+		i = 0;
+	if (j > m->m_size)
+		j = m->m_size;
+	if (j < i)
+		j = i;
+	if (v == NULL || !is_stringobject(v)) {
+		err_setstr(IndexError,
+			   "mmap slice assignment must be a string");
+		return -1;
+	}
+	if (getstringsize(v) != j - i) {
+		err_setstr(IndexError,
+			   "mmap slice assignment is wrong size");
+		return -1;
+	}
+	if ((data = mmap_use(m)) == NULL)
+		return -1;
+	memcpy(data + i, getstringvalue(v), j - i);
+	mmap_done(m);
+	return 0;
+}
+
+static object *
+mmap_concat(m, v)
+	mmapobject *m;
+	object *v;
+{
+	err_setstr(TypeError, "mmaps don't support concatenation");
+	return NULL;
+}
+
+static object *
+mmap_repeat(m, n)
+	mmapobject *m;
+	int n;
+{
+	err_setstr(TypeError, "mmaps don't support repeat operation");
+	return NULL;
+}
+
+static sequence_methods mmap_as_sequence = {
+	(inquiry)mmap_length,		/*sq_length*/
+	(binaryfunc)mmap_concat,	/*sq_concat*/
+	(intargfunc)mmap_repeat,	/*sq_repeat*/
+	(intargfunc)mmap_item,		/*sq_item*/
+	(intintargfunc)mmap_slice,	/*sq_slice*/
+	(intobjargproc)mmap_ass_item,	/*sq_ass_item*/
+	(intintobjargproc)mmap_ass_slice, /*sq_ass_slice*/
+};
+
+/* A buffer handed out counts as a use until it is released */
+
+static int
+mmap_readbuffer(m, ptr)
+	mmapobject *m;
+	void **ptr;
+{
+	if ((*ptr = (void *)mmap_use(m)) == NULL)
+		return -1;
+	return m->m_size;
+}
+
+static int
+mmap_writebuffer(m, ptr)
+	mmapobject *m;
+	void **ptr;
+{
+	if (!mmap_check_writable(m))
+		return -1;
+	return mmap_readbuffer(m, ptr);
+}
+
+static buffer_procs mmap_as_buffer = {
+	(getreadbufferproc)mmap_readbuffer,	/*bf_getreadbuffer*/
+	(getwritebufferproc)mmap_writebuffer,	/*bf_getwritebuffer*/
+	(releasebufferproc)mmap_done,		/*bf_releasebuffer*/
+};
+
+statichere typeobject Mmaptype = {
+	OB_HEAD_INIT(&Typetype)
+	0,			/*ob_size*/
+	"mmap",			/*tp_name*/
+	sizeof(mmapobject),	/*tp_basicsize*/
+	0,			/*tp_itemsize*/
+	/* methods */
+	(destructor)mmap_dealloc, /*tp_dealloc*/
+	0,			/*tp_print*/
+	(getattrfunc)mmap_getattr, /*tp_getattr*/
+	0,			/*tp_setattr*/
+	0,			/*tp_compare*/
+	0,			/*tp_repr*/
+	0,			/*tp_as_number*/
+	&mmap_as_sequence,	/*tp_as_sequence*/
+	0,			/*tp_as_mapping*/
+	0,			/*tp_hash*/
+	0,			/*tp_call*/
+	0,			/*tp_str*/
+	0,			/*tp_getattro*/
+	0,			/*tp_setattro*/
+	&mmap_as_buffer,	/*tp_as_buffer*/
+};
+
+/* Module functions */
+
+static object *
+new_mmap(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	object *file;
+	int fd, length = 0;
+	char *mode = "r";
+	int prot, flags;
+	struct stat st;
+	char *data;
+	FILE *fp;
+	mmapobject *m;
+
+	if (!newgetargs(args, "O|is:mmap", &file, &length, &mode))
+		return NULL;
+	if (length < 0) {
+		err_setstr(ValueError, "mmap length cannot be negative");
+		return NULL;
+	}
+	if ((fp = getfilefile(file)) != NULL)
+		fd = fileno(fp);
+	else if (is_intobject(file))
+		fd = getintvalue(file);
+	else {
+		err_setstr(TypeError,
+			   "mmap() requires a file or a file descriptor");
+		return NULL;
+	}
+	if (strcmp(mode, "r") == 0) {
+		prot = PROT_READ;
+		flags = MAP_SHARED;
+	}
+	else if (strcmp(mode, "w") == 0) {
+		prot = PROT_READ | PROT_WRITE;
+		flags = MAP_SHARED;
+	}
+	else if (strcmp(mode, "c") == 0) {
+		prot = PROT_READ | PROT_WRITE;
+		flags = MAP_PRIVATE;
+	}
+	else {
+		err_setstr(ValueError, "mmap mode must be 'r', 'w' or 'c'");
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0)
+		return err_errno(MmapError);
+	if (length > st.st_size) {
+		err_setstr(ValueError, "mmap length is greater than file size");
+		return NULL;
+	}
+	if (length == 0) {
+		if (st.st_size > INT_MAX) {
+			err_setstr(OverflowError, "file too large to mmap");
+			return NULL;
+		}
+		length = st.st_size;
+	}
+	if (length == 0) {
+		err_setstr(ValueError, "cannot mmap an empty file");
+		return NULL;
+	}
+	m = NEWOBJ(mmapobject, &Mmaptype);
+	if (m == NULL)
+		return NULL;
+	m->m_data = NULL;
+	m->m_users = CLOSED;
+	m->m_size = length;
+	m->m_pos = 0;
+	m->m_writable = prot & PROT_WRITE;
+	data = (char *) mmap(0, (size_t)length, prot, flags, fd, (off_t)0);
+	if (data == (char *)MAP_FAILED) {
+		DECREF(m);
+		return err_errno(MmapError);
+	}
+	m->m_data = data;
+	m->m_users = 0;
+	return (object *)m;
+}
+
+static struct methodlist mmap_functions[] = {
+	{"mmap",	new_mmap,	1},
+	{NULL,		NULL}		/* sentinel */
+};
+
+void
+initmmap()
+{
+	object *m, *d;
+
+	m = initmodule("mmap", mmap_functions);
+	d = getmoduledict(m);
+	MmapError = newstringobject("mmap.error");
+	if (MmapError == NULL || dictinsert(d, "error", MmapError) != 0)
+		fatal("can't define mmap.error");
+}
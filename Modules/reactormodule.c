@@ -0,0 +1,1513 @@
+/***********************************************************
+Copyright 1991-1995 by Stichting Mathematisch Centrum, Amsterdam,
+The Netherlands.
+
+                        All Rights Reserved
+
+Permission to use, copy, modify, and distribute this software and its
+documentation for any purpose and without fee is hereby granted,
+provided that the above copyright notice appear in all copies and that
+both that copyright notice and this permission notice appear in
+supporting documentation, and that the names of Stichting Mathematisch
+Centrum or CWI or Corporation for National Research Initiatives or
+CNRI not be used in advertising or publicity pertaining to
+distribution of the software without specific, written prior
+permission.
+
+While CWI is the initial source for this software, a modified version
+is made available by the Corporation for National Research Initiatives
+(CNRI) at the Internet address ftp://ftp.python.org.
+
+STICHTING MATHEMATISCH CENTRUM AND CNRI DISCLAIM ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL STICHTING MATHEMATISCH
+CENTRUM OR CNRI BE LIABLE FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL
+DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+
+******************************************************************/
+
+/* reactor module -- an event loop for socket servers.
+
+   A reactor watches a set of non-blocking sockets, called channels,
+   and does the accept(), recv() and send() calls itself.  Python code
+   is only called when something complete has happened:
+
+   - a listening channel accepted a connection: onaccept(ch, addr)
+   - a connection received a complete message: onmessage(ch, data)
+   - the peer closed the connection, or it failed: onclose(ch)
+   - a timer expired: func(*args)
+
+   Received data is collected in a buffer per channel and cut into
+   messages by the channel's terminator: a string (e.g. '\r\n'; it is
+   not included in the message), a byte count, or None (deliver
+   whatever arrived).  ch.send() queues data; what the socket doesn't
+   take at once is sent when it becomes writable, several strings per
+   writev() call.
+
+   Readiness is waited for with epoll where available, else select().
+   A reactor and its channels are meant to be used by one thread. */
+
+#include "allobjects.h"
+#include "modsupport.h"
+#include "ceval.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include "mytime.h"
+#else
+#include "myselect.h" /* Also includes mytime.h */
+#endif
+
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#ifndef IOV_MAX
+#ifdef UIO_MAXIOV
+#define IOV_MAX UIO_MAXIOV
+#else
+#define IOV_MAX 16
+#endif
+#endif
+#endif
+
+#ifndef EWOULDBLOCK
+#define EWOULDBLOCK EAGAIN
+#endif
+
+#define READ_CHUNK 16384	/* Minimum free space for a recv() */
+#define ACCEPT_MAX 64		/* Connections accepted per event */
+
+/* Events a channel waits for */
+#define EV_READ 1
+#define EV_WRITE 2
+
+static object *ReactorError;
+
+typedef struct reactorobject reactorobject;
+
+typedef struct {
+	OB_HEAD
+	reactorobject *c_reactor;	/* NULL when closed */
+	int c_fd;
+	object *c_sock;		/* Socket object passed in, or NULL */
+	int c_listening;
+	int c_closing;		/* Close when the output is sent */
+	int c_events;		/* EV_READ|EV_WRITE being waited for */
+	object *c_terminator;	/* String, int or None */
+	object *c_onmessage;
+	object *c_onclose;	/* May be None */
+	object *c_onaccept;	/* Listening channels only; may be None */
+	char *c_in;		/* Input buffer */
+	int c_start, c_end;	/* Unconsumed data is c_in[c_start:c_end] */
+	int c_scanned;		/* No terminator starts before this */
+	int c_insize;
+	object **c_out;		/* Queue of strings to send */
+	int c_outlen, c_outsize;
+	int c_outpos;		/* Bytes of c_out[0] already sent */
+} channelobject;
+
+struct timer {
+	double when;
+	long id;
+	object *func;		/* NULL when cancelled */
+	object *args;
+};
+
+struct ready {
+	int fd;
+	int events;
+};
+
+struct reactorobject {
+	OB_HEAD
+	channelobject **r_chans;	/* Open channels by descriptor */
+	int r_nchans;
+	int r_count;		/* Number of open channels */
+	struct timer *r_timers;	/* Heap ordered by (when, id) */
+	int r_ntimers, r_timerssize;
+	long r_nextid;
+	struct ready *r_ready;
+	int r_nready;
+	int r_running, r_stop;
+#ifdef HAVE_SYS_EPOLL_H
+	int r_epfd;
+	struct epoll_event *r_events;
+	int r_nevents;
+#endif
+};
+
+staticforward typeobject Reactortype;
+staticforward typeobject Channeltype;
+
+#define is_channelobject(v) ((v)->ob_type == &Channeltype)
+
+static double
+floattime()
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval t;
+#ifdef GETTIMEOFDAY_NO_TZ
+	if (gettimeofday(&t) == 0)
+		return (double)t.tv_sec + t.tv_usec*0.000001;
+#else
+	if (gettimeofday(&t, (struct timezone *)NULL) == 0)
+		return (double)t.tv_sec + t.tv_usec*0.000001;
+#endif
+#endif
+	return (double)time((time_t *)NULL);
+}
+
+static object *
+call_noargs(o, name)
+	object *o;
+	char *name;
+{
+	object *func, *res;
+
+	if ((func = getattr(o, name)) == NULL)
+		return NULL;
+	res = call_object(func, (object *)NULL);
+	DECREF(func);
+	return res;
+}
+
+static int
+setnonblocking(fd)
+	int fd;
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -1;
+	return 0;
+}
+
+/* Waiting for events.  Only these functions differ between epoll and
+   select(). */
+
+static int
+backend_init(r)
+	reactorobject *r;
+{
+#ifdef HAVE_SYS_EPOLL_H
+	r->r_events = NULL;
+	r->r_nevents = 0;
+	r->r_epfd = epoll_create(FD_SETSIZE);
+	return r->r_epfd < 0 ? -1 : 0;
+#else
+	return 0;
+#endif
+}
+
+static void
+backend_free(r)
+	reactorobject *r;
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (r->r_epfd >= 0)
+		close(r->r_epfd);
+	if (r->r_events != NULL)
+		DEL(r->r_events);
+#endif
+}
+
+/* Tell the backend what a channel now waits for; old is what it
+   waited for before, -1 for a new channel.  Return 0, or -1 with
+   errno set. */
+static int
+backend_set(r, fd, old, events)
+	reactorobject *r;
+	int fd, old, events;
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event ev;
+	int op;
+
+	memset((char *)&ev, '\0', sizeof ev);
+	ev.data.fd = fd;
+	if (events & EV_READ)
+		ev.events |= EPOLLIN;
+	if (events & EV_WRITE)
+		ev.events |= EPOLLOUT;
+	if (old < 0)
+		op = EPOLL_CTL_ADD;
+	else if (events < 0)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+	return epoll_ctl(r->r_epfd, op, fd, &ev);
+#else
+	if (fd >= FD_SETSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/* Wait at most ms milliseconds (forever if negative) and fill
+   r_ready.  Called without the interpreter lock.  Return the number
+   of ready channels, or -1 with errno set. */
+static int
+backend_wait(r, ms)
+	reactorobject *r;
+	int ms;
+{
+#ifdef HAVE_SYS_EPOLL_H
+	int i, n;
+
+	n = epoll_wait(r->r_epfd, r->r_events, r->r_nevents, ms);
+	for (i = 0; i < n; i++) {
+		int ev = r->r_events[i].events;
+		r->r_ready[i].fd = r->r_events[i].data.fd;
+		r->r_ready[i].events =
+			(ev & (EPOLLIN|EPOLLERR|EPOLLHUP) ? EV_READ : 0) |
+			(ev & EPOLLOUT ? EV_WRITE : 0);
+	}
+	return n;
+#else
+	fd_set rset, wset;
+	struct timeval tv, *tvp = NULL;
+	int fd, n, max = 0;
+
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	for (fd = 0; fd < r->r_nchans; fd++) {
+		channelobject *ch = r->r_chans[fd];
+		if (ch == NULL)
+			continue;
+		if (ch->c_events & EV_READ)
+			FD_SET(fd, &rset);
+		if (ch->c_events & EV_WRITE)
+			FD_SET(fd, &wset);
+		max = fd + 1;
+	}
+	if (ms >= 0) {
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		tvp = &tv;
+	}
+	if (select(max, &rset, &wset, (fd_set *)NULL, tvp) < 0)
+		return -1;
+	n = 0;
+	for (fd = 0; fd < max; fd++) {
+		int ev = (FD_ISSET(fd, &rset) ? EV_READ : 0) |
+			(FD_ISSET(fd, &wset) ? EV_WRITE : 0);
+		if (ev) {
+			r->r_ready[n].fd = fd;
+			r->r_ready[n].events = ev;
+			n++;
+		}
+	}
+	return n;
+#endif
+}
+
+/* Make sure r_ready (and the epoll buffer) can hold all channels */
+static int
+backend_reserve(r)
+	reactorobject *r;
+{
+	int n = r->r_count > 0 ? r->r_count : 1;
+	struct ready *p;
+
+	if (n <= r->r_nready)
+		return 0;
+	p = r->r_ready;
+	RESIZE(p, struct ready, n);
+	if (p == NULL)
+		return -1;
+	r->r_ready = p;
+#ifdef HAVE_SYS_EPOLL_H
+	{
+		struct epoll_event *q = r->r_events;
+		RESIZE(q, struct epoll_event, n);
+		if (q == NULL)
+			return -1;
+		r->r_events = q;
+		r->r_nevents = n;
+	}
+#endif
+	r->r_nready = n;
+	return 0;
+}
+
+/* Channels */
+
+/* Register a new channel with the reactor.  The fd must not be in
+   use by another channel. */
+static channelobject *
+newchannelobject(r, fd, sock, listening)
+	reactorobject *r;
+	int fd;
+	object *sock;
+	int listening;
+{
+	channelobject *ch;
+
+	if (fd >= r->r_nchans) {
+		int i, n = r->r_nchans > 0 ? r->r_nchans : 64;
+		channelobject **p = r->r_chans;
+		while (n <= fd)
+			n *= 2;
+		RESIZE(p, channelobject *, n);
+		if (p == NULL)
+			return (channelobject *)err_nomem();
+		for (i = r->r_nchans; i < n; i++)
+			p[i] = NULL;
+		r->r_chans = p;
+		r->r_nchans = n;
+	}
+	if (r->r_chans[fd] != NULL) {
+		err_setstr(ValueError, "descriptor already has a channel");
+		return NULL;
+	}
+	if (setnonblocking(fd) < 0 ||
+	    backend_set(r, fd, -1, EV_READ) < 0)
+		return (channelobject *)err_errno(ReactorError);
+	ch = NEWOBJ(channelobject, &Channeltype);
+	if (ch == NULL) {
+		backend_set(r, fd, EV_READ, -1);
+		return NULL;
+	}
+	INCREF(r);
+	ch->c_reactor = r;
+	ch->c_fd = fd;
+	XINCREF(sock);
+	ch->c_sock = sock;
+	ch->c_listening = listening;
+	ch->c_closing = 0;
+	ch->c_events = EV_READ;
+	INCREF(None);
+	ch->c_terminator = None;
+	INCREF(None);
+	ch->c_onmessage = None;
+	INCREF(None);
+	ch->c_onclose = None;
+	INCREF(None);
+	ch->c_onaccept = None;
+	ch->c_in = NULL;
+	ch->c_start = ch->c_end = ch->c_scanned = ch->c_insize = 0;
+	ch->c_out = NULL;
+	ch->c_outlen = ch->c_outsize = ch->c_outpos = 0;
+	/* The table's reference */
+	INCREF(ch);
+	r->r_chans[fd] = ch;
+	r->r_count++;
+	return ch;
+}
+
+static void
+drop_output(ch)
+	channelobject *ch;
+{
+	int i;
+
+	for (i = 0; i < ch->c_outlen; i++)
+		DECREF(ch->c_out[i]);
+	ch->c_outlen = ch->c_outpos = 0;
+}
+
+/* Unregister and close a channel.  Nothing is called back. */
+static void
+close_channel(ch)
+	channelobject *ch;
+{
+	reactorobject *r = ch->c_reactor;
+	object *sock;
+
+	if (r == NULL)
+		return;
+	backend_set(r, ch->c_fd, ch->c_events, -1);
+	ch->c_reactor = NULL;
+	ch->c_events = 0;
+	drop_output(ch);
+	sock = ch->c_sock;
+	ch->c_sock = NULL;
+	if (sock == NULL)
+		close(ch->c_fd);
+	else {
+		/* Close it the way its owner would */
+		object *res = call_noargs(sock, "close");
+		if (res == NULL)
+			err_clear();
+		XDECREF(res);
+		DECREF(sock);
+	}
+	r->r_chans[ch->c_fd] = NULL;
+	r->r_count--;
+	DECREF(ch);		/* The table's reference */
+	DECREF(r);
+}
+
+/* Bring the backend up to date with what the channel waits for */
+static int
+update_events(ch)
+	channelobject *ch;
+{
+	int events = 0;
+
+	if (!ch->c_closing)
+		events |= EV_READ;
+	if (ch->c_outlen > 0)
+		events |= EV_WRITE;
+	if (events != ch->c_events) {
+		if (backend_set(ch->c_reactor, ch->c_fd,
+				ch->c_events, events) < 0)
+			return -1;
+		ch->c_events = events;
+	}
+	return 0;
+}
+
+/* Send as much of the output queue as the socket takes.  Return 0,
+   or -1 with errno set if the connection failed. */
+static int
+flush_output(ch)
+	channelobject *ch;
+{
+	int n, k, i;
+
+	while (ch->c_outlen > 0) {
+#ifdef HAVE_WRITEV
+		struct iovec iov[IOV_MAX];
+		n = ch->c_outlen < IOV_MAX ? ch->c_outlen : IOV_MAX;
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = getstringvalue(ch->c_out[i]);
+			iov[i].iov_len = getstringsize(ch->c_out[i]);
+		}
+		iov[0].iov_base = (char *)iov[0].iov_base + ch->c_outpos;
+		iov[0].iov_len -= ch->c_outpos;
+		k = writev(ch->c_fd, iov, n);
+#else
+		k = send(ch->c_fd, getstringvalue(ch->c_out[0]) + ch->c_outpos,
+			 getstringsize(ch->c_out[0]) - ch->c_outpos, 0);
+#endif
+		if (k < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		/* Drop the strings that were sent completely */
+		k += ch->c_outpos;
+		for (i = 0; i < ch->c_outlen &&
+			    k >= getstringsize(ch->c_out[i]); i++) {
+			k -= getstringsize(ch->c_out[i]);
+			DECREF(ch->c_out[i]);
+		}
+		ch->c_outlen -= i;
+		memmove((char *)ch->c_out, (char *)(ch->c_out + i),
+			ch->c_outlen * sizeof(object *));
+		ch->c_outpos = k;
+	}
+	return 0;
+}
+
+/* Call a handler with the channel and maybe another argument.  The
+   channel may be closed by the handler.  Return 0, or -1 with an
+   exception set. */
+static int
+call_handler(func, ch, arg)
+	object *func;
+	channelobject *ch;
+	object *arg;
+{
+	object *args, *res;
+
+	if (func == None)
+		return 0;
+	if (arg == NULL)
+		args = mkvalue("(O)", ch);
+	else
+		args = mkvalue("(OO)", ch, arg);
+	if (args == NULL)
+		return -1;
+	/* The handler may be replaced while it runs */
+	INCREF(func);
+	res = call_object(func, args);
+	DECREF(func);
+	DECREF(args);
+	if (res == NULL)
+		return -1;
+	DECREF(res);
+	return 0;
+}
+
+/* The connection is gone or failed: close it and tell the handler */
+static int
+lost_channel(ch)
+	channelobject *ch;
+{
+	close_channel(ch);
+	return call_handler(ch->c_onclose, ch, (object *)NULL);
+}
+
+/* The peer closed its side: the handler can still send a reply */
+static int
+eof_channel(ch)
+	channelobject *ch;
+{
+	if (call_handler(ch->c_onclose, ch, (object *)NULL) < 0)
+		return -1;
+	if (ch->c_reactor == NULL)
+		return 0;
+	ch->c_closing = 1;
+	if (ch->c_outlen == 0)
+		close_channel(ch);
+	else if (update_events(ch) < 0)
+		return lost_channel(ch);
+	return 0;
+}
+
+/* Cut the buffered input into messages and deliver them */
+static int
+deliver_input(ch)
+	channelobject *ch;
+{
+	object *term, *msg;
+	char *p, *s, *end;
+	int n, tlen;
+
+	while (ch->c_reactor != NULL && !ch->c_closing) {
+		n = ch->c_end - ch->c_start;
+		term = ch->c_terminator;
+		tlen = 0;
+		if (term == None) {
+			if (n == 0)
+				break;
+		}
+		else if (is_intobject(term)) {
+			long size = getintvalue(term);
+			if (size <= 0 || n < size)
+				break;
+			n = size;
+		}
+		else {
+			/* Search the new data, and what could be part of
+			   a terminator before it */
+			s = getstringvalue(term);
+			tlen = getstringsize(term);
+			p = ch->c_in + ch->c_scanned;
+			end = ch->c_in + ch->c_end - tlen + 1;
+			while (p < end &&
+			       (p = memchr(p, s[0], end - p)) != NULL) {
+				if (memcmp(p, s, tlen) == 0)
+					break;
+				p++;
+			}
+			if (p == NULL || p >= end) {
+				n = ch->c_end - tlen + 1;
+				ch->c_scanned = n > ch->c_start ? n :
+								ch->c_start;
+				break;
+			}
+			n = p - (ch->c_in + ch->c_start);
+		}
+		msg = newsizedstringobject(ch->c_in + ch->c_start, n);
+		if (msg == NULL)
+			return -1;
+		ch->c_start += n + tlen;
+		ch->c_scanned = ch->c_start;
+		n = call_handler(ch->c_onmessage, ch, msg);
+		DECREF(msg);
+		if (n < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* The socket is readable: receive what is there */
+static int
+read_channel(ch)
+	channelobject *ch;
+{
+	int n;
+
+	if (ch->c_start > 0) {
+		/* Move the unconsumed data to the front */
+		n = ch->c_end - ch->c_start;
+		memmove(ch->c_in, ch->c_in + ch->c_start, n);
+		ch->c_scanned -= ch->c_start;
+		ch->c_start = 0;
+		ch->c_end = n;
+	}
+	if (ch->c_insize - ch->c_end < READ_CHUNK) {
+		char *p = ch->c_in;
+		n = ch->c_end + READ_CHUNK;
+		if (n < 2*ch->c_insize)
+			n = 2*ch->c_insize;
+		RESIZE(p, char, n);
+		if (p == NULL) {
+			err_nomem();
+			return -1;
+		}
+		ch->c_in = p;
+		ch->c_insize = n;
+	}
+	n = recv(ch->c_fd, ch->c_in + ch->c_end, ch->c_insize - ch->c_end, 0);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 0;
+		return lost_channel(ch);
+	}
+	if (n == 0)
+		return eof_channel(ch);
+	ch->c_end += n;
+	return deliver_input(ch);
+}
+
+/* The socket is writable: send queued output */
+static int
+write_channel(ch)
+	channelobject *ch;
+{
+	if (flush_output(ch) < 0)
+		return lost_channel(ch);
+	if (ch->c_outlen == 0 && ch->c_closing) {
+		close_channel(ch);
+		return 0;
+	}
+	if (update_events(ch) < 0)
+		return lost_channel(ch);
+	return 0;
+}
+
+static object *
+makeaddr(addr, addrlen)
+	struct sockaddr *addr;
+	int addrlen;
+{
+	if (addr->sa_family == AF_INET) {
+		struct sockaddr_in *a = (struct sockaddr_in *)addr;
+		return mkvalue("(si)", inet_ntoa(a->sin_addr),
+			       (int)ntohs(a->sin_port));
+	}
+	INCREF(None);
+	return None;
+}
+
+/* A listening socket is readable: accept the waiting connections */
+static int
+accept_channel(lch)
+	channelobject *lch;
+{
+	reactorobject *r = lch->c_reactor;
+	channelobject *ch;
+	char addrbuf[256];
+	object *addr;
+	int i, fd, addrlen, res;
+
+	for (i = 0; i < ACCEPT_MAX && lch->c_reactor != NULL; i++) {
+		addrlen = sizeof addrbuf;
+		fd = accept(lch->c_fd, (struct sockaddr *)addrbuf, &addrlen);
+		if (fd < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINTR || errno == ECONNABORTED)
+				return 0;
+			err_errno(ReactorError);
+			return -1;
+		}
+		ch = newchannelobject(r, fd, (object *)NULL, 0);
+		if (ch == NULL) {
+			close(fd);
+			return -1;
+		}
+		DECREF(ch->c_terminator);
+		INCREF(lch->c_terminator);
+		ch->c_terminator = lch->c_terminator;
+		DECREF(ch->c_onmessage);
+		INCREF(lch->c_onmessage);
+		ch->c_onmessage = lch->c_onmessage;
+		DECREF(ch->c_onclose);
+		INCREF(lch->c_onclose);
+		ch->c_onclose = lch->c_onclose;
+		res = 0;
+		if (lch->c_onaccept != None) {
+			addr = makeaddr((struct sockaddr *)addrbuf, addrlen);
+			if (addr == NULL)
+				res = -1;
+			else {
+				res = call_handler(lch->c_onaccept, ch, addr);
+				DECREF(addr);
+			}
+		}
+		DECREF(ch);
+		if (res < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* Channel methods */
+
+static int
+channel_check(ch)
+	channelobject *ch;
+{
+	if (ch->c_reactor == NULL) {
+		err_setstr(ValueError, "operation on closed channel");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check_terminator(term)
+	object *term;
+{
+	if (term == None || is_intobject(term) ||
+	    (is_stringobject(term) && getstringsize(term) > 0))
+		return 1;
+	err_setstr(TypeError,
+		   "terminator must be a non-empty string, an int or None");
+	return 0;
+}
+
+static int
+check_handler(func)
+	object *func;
+{
+	if (func == None || callable(func))
+		return 1;
+	err_setstr(TypeError, "handler must be callable or None");
+	return 0;
+}
+
+static object *
+channel_send(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	object *data;
+
+	if (!newgetargs(args, "S:send", &data))
+		return NULL;
+	if (!channel_check(ch))
+		return NULL;
+	if (ch->c_closing) {
+		err_setstr(ValueError, "send() on closing channel");
+		return NULL;
+	}
+	if (getstringsize(data) == 0) {
+		INCREF(None);
+		return None;
+	}
+	if (ch->c_outlen >= ch->c_outsize) {
+		object **p = ch->c_out;
+		int n = ch->c_outsize > 0 ? 2*ch->c_outsize : 16;
+		RESIZE(p, object *, n);
+		if (p == NULL)
+			return err_nomem();
+		ch->c_out = p;
+		ch->c_outsize = n;
+	}
+	INCREF(data);
+	ch->c_out[ch->c_outlen++] = data;
+	/* Try to send it now.  If the connection failed, the error
+	   shows when the reactor next finds the socket writable. */
+	if (ch->c_outlen == 1)
+		(void) flush_output(ch);
+	if (update_events(ch) < 0)
+		return err_errno(ReactorError);
+	INCREF(None);
+	return None;
+}
+
+static object *
+channel_close(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	if (!newgetargs(args, ":close"))
+		return NULL;
+	if (ch->c_reactor != NULL) {
+		ch->c_closing = 1;
+		if (ch->c_outlen == 0)
+			close_channel(ch);
+		else if (update_events(ch) < 0) {
+			close_channel(ch);
+			return err_errno(ReactorError);
+		}
+	}
+	INCREF(None);
+	return None;
+}
+
+static object *
+channel_abort(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	if (!newgetargs(args, ":abort"))
+		return NULL;
+	close_channel(ch);
+	INCREF(None);
+	return None;
+}
+
+static object *
+channel_set_terminator(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	object *term;
+
+	if (!newgetargs(args, "O:set_terminator", &term))
+		return NULL;
+	if (!check_terminator(term))
+		return NULL;
+	DECREF(ch->c_terminator);
+	INCREF(term);
+	ch->c_terminator = term;
+	ch->c_scanned = ch->c_start;
+	INCREF(None);
+	return None;
+}
+
+static object *
+channel_set_handler(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	object *onmessage, *onclose = NULL;
+
+	if (!newgetargs(args, "O|O:set_handler", &onmessage, &onclose))
+		return NULL;
+	if (!check_handler(onmessage) ||
+	    (onclose != NULL && !check_handler(onclose)))
+		return NULL;
+	DECREF(ch->c_onmessage);
+	INCREF(onmessage);
+	ch->c_onmessage = onmessage;
+	if (onclose != NULL) {
+		DECREF(ch->c_onclose);
+		INCREF(onclose);
+		ch->c_onclose = onclose;
+	}
+	INCREF(None);
+	return None;
+}
+
+static object *
+channel_fileno(ch, args)
+	channelobject *ch;
+	object *args;
+{
+	if (!newgetargs(args, ":fileno"))
+		return NULL;
+	if (!channel_check(ch))
+		return NULL;
+	return newintobject((long)ch->c_fd);
+}
+
+static struct methodlist channel_methods[] = {
+	{"abort",		(method)channel_abort,		1},
+	{"close",		(method)channel_close,		1},
+	{"fileno",		(method)channel_fileno,		1},
+	{"send",		(method)channel_send,		1},
+	{"set_handler",		(method)channel_set_handler,	1},
+	{"set_terminator",	(method)channel_set_terminator,	1},
+	{NULL,			NULL}		/* sentinel */
+};
+
+static object *
+channel_getattr(ch, name)
+	channelobject *ch;
+	char *name;
+{
+	if (strcmp(name, "closed") == 0)
+		return newintobject((long)(ch->c_reactor == NULL));
+	if (strcmp(name, "pending") == 0) {
+		long n = 0;
+		int i;
+		for (i = 0; i < ch->c_outlen; i++)
+			n += getstringsize(ch->c_out[i]);
+		return newintobject(n - ch->c_outpos);
+	}
+	return findmethod(channel_methods, (object *)ch, name);
+}
+
+static void
+channel_dealloc(ch)
+	channelobject *ch;
+{
+	/* Open channels are referenced by their reactor */
+	drop_output(ch);
+	if (ch->c_out != NULL)
+		DEL(ch->c_out);
+	if (ch->c_in != NULL)
+		DEL(ch->c_in);
+	XDECREF(ch->c_sock);
+	XDECREF(ch->c_terminator);
+	XDECREF(ch->c_onmessage);
+	XDECREF(ch->c_onclose);
+	XDECREF(ch->c_onaccept);
+	DEL(ch);
+}
+
+static object *
+channel_repr(ch)
+	channelobject *ch;
+{
+	char buf[100];
+	sprintf(buf, "<%s channel, fd=%d>",
+		ch->c_reactor == NULL ? "closed" :
+		ch->c_listening ? "listening" : "open", ch->c_fd);
+	return newstringobject(buf);
+}
+
+statichere typeobject Channeltype = {
+	OB_HEAD_INIT(&Typetype)
+	0,			/*ob_size*/
+	"channel",		/*tp_name*/
+	sizeof(channelobject),	/*tp_basicsize*/
+	0,			/*tp_itemsize*/
+	/* methods */
+	(destructor)channel_dealloc, /*tp_dealloc*/
+	0,			/*tp_print*/
+	(getattrfunc)channel_getattr, /*tp_getattr*/
+	0,			/*tp_setattr*/
+	0,			/*tp_compare*/
+	(reprfunc)channel_repr,	/*tp_repr*/
+};
+
+/* Timers */
+
+#define TIMER_BEFORE(a, b) \
+	((a)->when < (b)->when || ((a)->when == (b)->when && (a)->id < (b)->id))
+
+static void
+timer_siftdown(r, i)
+	reactorobject *r;
+	int i;
+{
+	struct timer *h = r->r_timers, t;
+	int child;
+
+	t = h[i];
+	while ((child = 2*i + 1) < r->r_ntimers) {
+		if (child + 1 < r->r_ntimers &&
+		    TIMER_BEFORE(&h[child+1], &h[child]))
+			child++;
+		if (!TIMER_BEFORE(&h[child], &t))
+			break;
+		h[i] = h[child];
+		i = child;
+	}
+	h[i] = t;
+}
+
+static void
+timer_siftup(r, i)
+	reactorobject *r;
+	int i;
+{
+	struct timer *h = r->r_timers, t;
+	int parent;
+
+	t = h[i];
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!TIMER_BEFORE(&t, &h[parent]))
+			break;
+		h[i] = h[parent];
+		i = parent;
+	}
+	h[i] = t;
+}
+
+/* Remove the earliest timer; the caller owns its references */
+static struct timer
+timer_pop(r)
+	reactorobject *r;
+{
+	struct timer t;
+
+	t = r->r_timers[0];
+	r->r_timers[0] = r->r_timers[--r->r_ntimers];
+	if (r->r_ntimers > 0)
+		timer_siftdown(r, 0);
+	return t;
+}
+
+/* Drop cancelled timers from the front of the heap */
+static void
+timer_prune(r)
+	reactorobject *r;
+{
+	while (r->r_ntimers > 0 && r->r_timers[0].func == NULL)
+		(void) timer_pop(r);
+}
+
+/* Call the timers that are due */
+static int
+run_timers(r)
+	reactorobject *r;
+{
+	struct timer t;
+	object *res;
+	double now = floattime();
+
+	timer_prune(r);
+	while (r->r_ntimers > 0 && r->r_timers[0].when <= now) {
+		t = timer_pop(r);
+		res = call_object(t.func, t.args);
+		DECREF(t.func);
+		DECREF(t.args);
+		if (res == NULL)
+			return -1;
+		DECREF(res);
+		timer_prune(r);
+	}
+	return 0;
+}
+
+static void
+clear_timers(r)
+	reactorobject *r;
+{
+	struct timer t;
+
+	while (r->r_ntimers > 0) {
+		t = r->r_timers[--r->r_ntimers];
+		XDECREF(t.func);
+		XDECREF(t.args);
+	}
+}
+
+/* Reactor methods */
+
+static int
+getfd(o)
+	object *o;
+{
+	object *res;
+	int fd;
+
+	if (is_intobject(o))
+		return getintvalue(o);
+	res = call_noargs(o, "fileno");
+	if (res == NULL)
+		return -1;
+	if (!is_intobject(res)) {
+		DECREF(res);
+		err_setstr(TypeError, "fileno() must return an int");
+		return -1;
+	}
+	fd = getintvalue(res);
+	DECREF(res);
+	return fd;
+}
+
+/* Make a channel for a socket given as an object with a fileno()
+   method, which is closed when the channel is closed, or as an int,
+   which the channel then owns. */
+static channelobject *
+sockchannel(r, sock, listening)
+	reactorobject *r;
+	object *sock;
+	int listening;
+{
+	int fd = getfd(sock);
+
+	if (fd < 0) {
+		if (!err_occurred())
+			err_setstr(ValueError, "negative file descriptor");
+		return NULL;
+	}
+	return newchannelobject(r, fd, is_intobject(sock) ? NULL : sock,
+				listening);
+}
+
+static object *
+reactor_channel(r, args)
+	reactorobject *r;
+	object *args;
+{
+	object *sock, *term, *onmessage, *onclose = None;
+	channelobject *ch;
+
+	if (!newgetargs(args, "OOO|O:channel",
+			&sock, &term, &onmessage, &onclose))
+		return NULL;
+	if (!check_terminator(term) || !check_handler(onmessage) ||
+	    !check_handler(onclose))
+		return NULL;
+	if ((ch = sockchannel(r, sock, 0)) == NULL)
+		return NULL;
+	DECREF(ch->c_terminator);
+	INCREF(term);
+	ch->c_terminator = term;
+	DECREF(ch->c_onmessage);
+	INCREF(onmessage);
+	ch->c_onmessage = onmessage;
+	DECREF(ch->c_onclose);
+	INCREF(onclose);
+	ch->c_onclose = onclose;
+	return (object *)ch;
+}
+
+static object *
+reactor_listen(r, args)
+	reactorobject *r;
+	object *args;
+{
+	object *sock, *term, *onmessage, *onclose = None, *onaccept = None;
+	channelobject *ch;
+
+	if (!newgetargs(args, "OOO|OO:listen",
+			&sock, &term, &onmessage, &onclose, &onaccept))
+		return NULL;
+	if (!check_terminator(term) || !check_handler(onmessage) ||
+	    !check_handler(onclose) || !check_handler(onaccept))
+		return NULL;
+	if ((ch = sockchannel(r, sock, 1)) == NULL)
+		return NULL;
+	DECREF(ch->c_terminator);
+	INCREF(term);
+	ch->c_terminator = term;
+	DECREF(ch->c_onmessage);
+	INCREF(onmessage);
+	ch->c_onmessage = onmessage;
+	DECREF(ch->c_onclose);
+	INCREF(onclose);
+	ch->c_onclose = onclose;
+	DECREF(ch->c_onaccept);
+	INCREF(onaccept);
+	ch->c_onaccept = onaccept;
+	return (object *)ch;
+}
+
+static object *
+reactor_call_later(r, args)
+	reactorobject *r;
+	object *args;
+{
+	double delay;
+	object *func, *fargs = NULL;
+	struct timer *t;
+	long id;
+
+	if (!newgetargs(args, "dO|O:call_later", &delay, &func, &fargs))
+		return NULL;
+	if (!callable(func)) {
+		err_setstr(TypeError, "call_later() requires a callable");
+		return NULL;
+	}
+	if (fargs == NULL)
+		fargs = newtupleobject(0);
+	else if (is_tupleobject(fargs))
+		INCREF(fargs);
+	else {
+		err_setstr(TypeError, "call_later() arguments must be a tuple");
+		return NULL;
+	}
+	if (fargs == NULL)
+		return NULL;
+	if (r->r_ntimers >= r->r_timerssize) {
+		struct timer *p = r->r_timers;
+		int n = r->r_timerssize > 0 ? 2*r->r_timerssize : 16;
+		RESIZE(p, struct timer, n);
+		if (p == NULL) {
+			DECREF(fargs);
+			return err_nomem();
+		}
+		r->r_timers = p;
+		r->r_timerssize = n;
+	}
+	t = &r->r_timers[r->r_ntimers++];
+	t->when = floattime() + delay;
+	t->id = id = r->r_nextid++;
+	INCREF(func);
+	t->func = func;
+	t->args = fargs;
+	timer_siftup(r, r->r_ntimers - 1);
+	return newintobject(id);
+}
+
+static object *
+reactor_cancel(r, args)
+	reactorobject *r;
+	object *args;
+{
+	long id;
+	int i;
+
+	if (!newgetargs(args, "l:cancel", &id))
+		return NULL;
+	for (i = 0; i < r->r_ntimers; i++) {
+		struct timer *t = &r->r_timers[i];
+		if (t->id == id && t->func != NULL) {
+			/* Leave it in the heap; it is dropped when due */
+			DECREF(t->func);
+			DECREF(t->args);
+			t->func = t->args = NULL;
+			INCREF(None);
+			return None;
+		}
+	}
+	err_setstr(ValueError, "no such timer");
+	return NULL;
+}
+
+/* Wait for and handle one round of events; return -1 on errors */
+static int
+run_once(r, deadline)
+	reactorobject *r;
+	double deadline;	/* Negative for none */
+{
+	double until = deadline, now;
+	int ms, n, i;
+
+	timer_prune(r);
+	if (r->r_ntimers > 0 &&
+	    (until < 0 || r->r_timers[0].when < until))
+		until = r->r_timers[0].when;
+	if (until < 0)
+		ms = -1;
+	else {
+		now = floattime();
+		ms = until <= now ? 0 : (int)((until - now) * 1000.0 + 0.999);
+	}
+	if (backend_reserve(r) < 0) {
+		err_nomem();
+		return -1;
+	}
+	BGN_SAVE
+	n = backend_wait(r, ms);
+	END_SAVE
+	if (n < 0) {
+		if (errno != EINTR) {
+			err_errno(ReactorError);
+			return -1;
+		}
+		return sigcheck();
+	}
+	for (i = 0; i < n; i++) {
+		struct ready *rd = &r->r_ready[i];
+		channelobject *ch;
+		int res = 0;
+		if (rd->fd >= r->r_nchans ||
+		    (ch = r->r_chans[rd->fd]) == NULL)
+			continue;	/* Closed by an earlier handler */
+		INCREF(ch);
+		if (ch->c_listening)
+			res = accept_channel(ch);
+		else {
+			if (rd->events & EV_WRITE)
+				res = write_channel(ch);
+			if (res == 0 && (rd->events & EV_READ) &&
+			    ch->c_reactor != NULL && !ch->c_closing)
+				res = read_channel(ch);
+		}
+		DECREF(ch);
+		if (res < 0)
+			return -1;
+	}
+	return run_timers(r);
+}
+
+static object *
+reactor_run(r, args)
+	reactorobject *r;
+	object *args;
+{
+	double timeout = -1.0, deadline = -1.0;
+	int res = 0;
+
+	if (!newgetargs(args, "|d:run", &timeout))
+		return NULL;
+	if (r->r_running) {
+		err_setstr(RuntimeError, "reactor is already running");
+		return NULL;
+	}
+	if (timeout >= 0)
+		deadline = floattime() + timeout;
+	r->r_running = 1;
+	r->r_stop = 0;
+	while (!r->r_stop) {
+		timer_prune(r);
+		if (r->r_count == 0 && r->r_ntimers == 0)
+			break;
+		if ((res = run_once(r, deadline)) < 0)
+			break;
+		if (deadline >= 0 && floattime() >= deadline)
+			break;
+	}
+	r->r_running = 0;
+	if (res < 0)
+		return NULL;
+	INCREF(None);
+	return None;
+}
+
+static object *
+reactor_stop(r, args)
+	reactorobject *r;
+	object *args;
+{
+	if (!newgetargs(args, ":stop"))
+		return NULL;
+	r->r_stop = 1;
+	INCREF(None);
+	return None;
+}
+
+static object *
+reactor_close(r, args)
+	reactorobject *r;
+	object *args;
+{
+	int fd;
+
+	if (!newgetargs(args, ":close"))
+		return NULL;
+	INCREF(r);
+	for (fd = 0; fd < r->r_nchans; fd++) {
+		if (r->r_chans[fd] != NULL)
+			close_channel(r->r_chans[fd]);
+	}
+	clear_timers(r);
+	DECREF(r);
+	INCREF(None);
+	return None;
+}
+
+static object *
+reactor_channels(r, args)
+	reactorobject *r;
+	object *args;
+{
+	object *list;
+	int fd;
+
+	if (!newgetargs(args, ":channels"))
+		return NULL;
+	if ((list = newlistobject(0)) == NULL)
+		return NULL;
+	for (fd = 0; fd < r->r_nchans; fd++) {
+		if (r->r_chans[fd] != NULL &&
+		    addlistitem(list, (object *)r->r_chans[fd]) < 0) {
+			DECREF(list);
+			return NULL;
+		}
+	}
+	return list;
+}
+
+static struct methodlist reactor_methods[] = {
+	{"call_later",	(method)reactor_call_later,	1},
+	{"cancel",	(method)reactor_cancel,		1},
+	{"channel",	(method)reactor_channel,	1},
+	{"channels",	(method)reactor_channels,	1},
+	{"close",	(method)reactor_close,		1},
+	{"listen",	(method)reactor_listen,		1},
+	{"run",		(method)reactor_run,		1},
+	{"stop",	(method)reactor_stop,		1},
+	{NULL,		NULL}		/* sentinel */
+};
+
+static object *
+reactor_getattr(r, name)
+	reactorobject *r;
+	char *name;
+{
+	return findmethod(reactor_methods, (object *)r, name);
+}
+
+static void
+reactor_dealloc(r)
+	reactorobject *r;
+{
+	/* Open channels hold a reference, so there are none left */
+	clear_timers(r);
+	if (r->r_timers != NULL)
+		DEL(r->r_timers);
+	if (r->r_chans != NULL)
+		DEL(r->r_chans);
+	if (r->r_ready != NULL)
+		DEL(r->r_ready);
+	backend_free(r);
+	DEL(r);
+}
+
+statichere typeobject Reactortype = {
+	OB_HEAD_INIT(&Typetype)
+	0,			/*ob_size*/
+	"reactor",		/*tp_name*/
+	sizeof(reactorobject),	/*tp_basicsize*/
+	0,			/*tp_itemsize*/
+	/* methods */
+	(destructor)reactor_dealloc, /*tp_dealloc*/
+	0,			/*tp_print*/
+	(getattrfunc)reactor_getattr, /*tp_getattr*/
+	0,			/*tp_setattr*/
+	0,			/*tp_compare*/
+	0,			/*tp_repr*/
+};
+
+/* Module functions */
+
+static object *
+new_reactor(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	reactorobject *r;
+
+	if (!newgetargs(args, ":reactor"))
+		return NULL;
+	r = NEWOBJ(reactorobject, &Reactortype);
+	if (r == NULL)
+		return NULL;
+	r->r_chans = NULL;
+	r->r_nchans = r->r_count = 0;
+	r->r_timers = NULL;
+	r->r_ntimers = r->r_timerssize = 0;
+	r->r_nextid = 1;
+	r->r_ready = NULL;
+	r->r_nready = 0;
+	r->r_running = r->r_stop = 0;
+	if (backend_init(r) < 0) {
+		err_errno(ReactorError);
+		DECREF(r);
+		return NULL;
+	}
+	/* Let send() report a closed connection as an error */
+#ifdef SIGPIPE
+	(void) signal(SIGPIPE, SIG_IGN);
+#endif
+	return (object *)r;
+}
+
+static struct methodlist reactor_functions[] = {
+	{"reactor",	new_reactor,	1},
+	{NULL,		NULL}		/* sentinel */
+};
+
+void
+initreactor()
+{
+	object *m, *d;
+
+	m = initmodule("reactor", reactor_functions);
+	d = getmoduledict(m);
+	ReactorError = newstringobject("reactor.error");
+	if (ReactorError == NULL || dictinsert(d, "error", ReactorError) != 0)
+		fatal("can't define reactor.error");
+}
@@ -33,6 +33,8 @@ PERFORMANCE OF THIS SOFTWARE.
 Under Unix, the file descriptors are small integers.
 Under Win32, select only exists for sockets, and sockets may
 have any value except INVALID_SOCKET.
+Where Linux epoll(7) is available, there is also a poll object that
+keeps the set of file descriptors between calls.
 */
 
 #include "allobjects.h"
@@ -48,6 +50,15 @@ have any value except INVALID_SOCKET.
 #define SOCKET int
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <errno.h>
+#include "pymutex.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#endif
+
 static object *SelectError;
 
 typedef struct {	/* list of Python objects and their file descriptor */
@@ -225,8 +236,318 @@ select_select(self, args)
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+
+/* Poll objects.  The file descriptors and the events to wait for are
+   registered once, with the kernel, instead of being passed on every
+   call as for select(); poll() takes time proportional to the number
+   of ready descriptors, and there is no FD_SETSIZE limit. */
+
+typedef struct {
+    OB_HEAD
+    int epfd;			/* -1 when closed */
+    int count;			/* Number of descriptors registered */
+    int running;		/* poll() in progress, using events */
+    struct epoll_event *events;	/* Buffer for epoll_wait() */
+    int nevents;
+} pollobject;
+
+staticforward typeobject Polltype;
+
+#define DEFAULT_EVENTS (EPOLLIN | EPOLLPRI | EPOLLOUT)
+
+/* Convert an int or an object with a fileno() method to a descriptor */
+static int
+obj2fd(o)
+    object *o;
+{
+    object *filenomethod, *fno;
+    int fd;
+
+    if ( is_intobject(o) )
+	fd = getintvalue(o);
+    else if ( (filenomethod = getattr(o, "fileno")) != NULL ) {
+	fno = call_object(filenomethod, NULL);
+	DECREF(filenomethod);
+	if ( fno == NULL )
+	    return -1;
+	if ( !is_intobject(fno) ) {
+	    DECREF(fno);
+	    err_badarg();
+	    return -1;
+	}
+	fd = getintvalue(fno);
+	DECREF(fno);
+    } else {
+	err_badarg();
+	return -1;
+    }
+    if ( fd < 0 ) {
+	err_setstr(ValueError, "negative file descriptor");
+	return -1;
+    }
+    return fd;
+}
+
+static int
+poll_check(self)
+    pollobject *self;
+{
+    if ( self->epfd < 0 ) {
+	err_setstr(ValueError, "I/O operation on closed poll object");
+	return 0;
+    }
+    return 1;
+}
+
+/* Add, change or remove a descriptor, keeping count up to date */
+static object *
+poll_ctl(self, op, o, events)
+    pollobject *self;
+    int op;
+    object *o;
+    int events;
+{
+    struct epoll_event ev;
+    int fd, res;
+
+    if ( (fd = obj2fd(o)) < 0 || !poll_check(self) )
+	return NULL;
+    memset((char *)&ev, '\0', sizeof ev);
+    ev.events = events;
+    ev.data.fd = fd;
+    res = epoll_ctl(self->epfd, op, fd, &ev);
+    if ( res < 0 && op == EPOLL_CTL_ADD && errno == EEXIST )
+	res = epoll_ctl(self->epfd, op = EPOLL_CTL_MOD, fd, &ev);
+    if ( res < 0 )
+	return err_errno(SelectError);
+    Py_CRIT_LOCK();
+    if ( op == EPOLL_CTL_ADD )
+	self->count++;
+    else if ( op == EPOLL_CTL_DEL && self->count > 0 )
+	self->count--;
+    Py_CRIT_UNLOCK();
+    INCREF(None);
+    return None;
+}
+
+static object *
+poll_register(self, args)
+    pollobject *self;
+    object *args;
+{
+    object *o;
+    int events = DEFAULT_EVENTS;
+
+    if ( !newgetargs(args, "O|i:register", &o, &events) )
+	return NULL;
+    return poll_ctl(self, EPOLL_CTL_ADD, o, events);
+}
+
+static object *
+poll_modify(self, args)
+    pollobject *self;
+    object *args;
+{
+    object *o;
+    int events;
+
+    if ( !newgetargs(args, "Oi:modify", &o, &events) )
+	return NULL;
+    return poll_ctl(self, EPOLL_CTL_MOD, o, events);
+}
+
+static object *
+poll_unregister(self, args)
+    pollobject *self;
+    object *args;
+{
+    object *o;
+
+    if ( !newgetargs(args, "O:unregister", &o) )
+	return NULL;
+    return poll_ctl(self, EPOLL_CTL_DEL, o, 0);
+}
+
+static object *
+poll_poll(self, args)
+    pollobject *self;
+    object *args;
+{
+    object *tout = None, *list, *v;
+    double timeout;
+    int ms, n, i, running;
+
+    if ( !newgetargs(args, "|O:poll", &tout) )
+	return NULL;
+    if ( tout == None )
+	ms = -1;
+    else {
+	if ( !getargs(tout, "d;timeout must be a number or None", &timeout) )
+	    return NULL;
+	ms = timeout < 0 ? -1 : (int)timeout;
+    }
+    if ( !poll_check(self) )
+	return NULL;
+
+    /* The event buffer is shared, so only one thread can poll */
+    Py_CRIT_LOCK();
+    running = self->running;
+    self->running = 1;
+    n = self->count > 0 ? self->count : 1;
+    Py_CRIT_UNLOCK();
+    if ( running ) {
+	err_setstr(RuntimeError, "concurrent poll() invocation");
+	return NULL;
+    }
+    if ( n > self->nevents ) {
+	struct epoll_event *p = self->events;
+	RESIZE(p, struct epoll_event, n);
+	if ( p == NULL ) {
+	    self->running = 0;
+	    return err_nomem();
+	}
+	self->events = p;
+	self->nevents = n;
+    }
+
+    BGN_SAVE
+    n = epoll_wait(self->epfd, self->events, self->nevents, ms);
+    END_SAVE
+
+    list = NULL;
+    if ( n < 0 )
+	err_errno(SelectError);
+    else if ( (list = newlistobject(n)) != NULL ) {
+	for ( i = 0; i < n; i++ ) {
+	    v = mkvalue("(ii)", self->events[i].data.fd,
+			(int)self->events[i].events);
+	    if ( v == NULL ) {
+		DECREF(list);
+		list = NULL;
+		break;
+	    }
+	    setlistitem(list, i, v);
+	}
+    }
+    self->running = 0;
+    return list;
+}
+
+static object *
+poll_fileno(self, args)
+    pollobject *self;
+    object *args;
+{
+    if ( !newgetargs(args, ":fileno") || !poll_check(self) )
+	return NULL;
+    return newintobject((long)self->epfd);
+}
+
+static object *
+poll_close(self, args)
+    pollobject *self;
+    object *args;
+{
+    if ( !newgetargs(args, ":close") )
+	return NULL;
+    if ( self->epfd >= 0 ) {
+	close(self->epfd);
+	self->epfd = -1;
+    }
+    INCREF(None);
+    return None;
+}
+
+static struct methodlist poll_methods[] = {
+    { "close",		(method)poll_close,		1 },
+    { "fileno",		(method)poll_fileno,		1 },
+    { "modify",		(method)poll_modify,		1 },
+    { "poll",		(method)poll_poll,		1 },
+    { "register",	(method)poll_register,		1 },
+    { "unregister",	(method)poll_unregister,	1 },
+    { NULL,		NULL }		/* sentinel */
+};
+
+static void
+poll_dealloc(self)
+    pollobject *self;
+{
+    if ( self->epfd >= 0 )
+	close(self->epfd);
+    if ( self->events != NULL )
+	DEL(self->events);
+    DEL(self);
+}
+
+static object *
+poll_getattr(self, name)
+    pollobject *self;
+    char *name;
+{
+    return findmethod(poll_methods, (object *)self, name);
+}
+
+statichere typeobject Polltype = {
+    OB_HEAD_INIT(&Typetype)
+    0,				/*ob_size*/
+    "poll",			/*tp_name*/
+    sizeof(pollobject),		/*tp_basicsize*/
+    0,				/*tp_itemsize*/
+    /* methods */
+    (destructor)poll_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    (getattrfunc)poll_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+};
+
+static object *
+select_poll(self, args)
+    object *self;
+    object *args;
+{
+    pollobject *p;
+
+    if ( !newgetargs(args, ":poll") )
+	return NULL;
+    p = NEWOBJ(pollobject, &Polltype);
+    if ( p == NULL )
+	return NULL;
+    p->count = 0;
+    p->running = 0;
+    p->events = NULL;
+    p->nevents = 0;
+    p->epfd = epoll_create(FD_SETSIZE);
+    if ( p->epfd < 0 ) {
+	DECREF(p);
+	return err_errno(SelectError);
+    }
+    return (object *)p;
+}
+
+/* Constants for the event masks; EPOLLIN etc. equal POLLIN etc. */
+static void
+insint(d, name, value)
+    object *d;
+    char *name;
+    int value;
+{
+    object *v = newintobject((long)value);
+    if ( v == NULL || dictinsert(d, name, v) )
+	fatal("Cannot define select constants");
+    DECREF(v);
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 static struct methodlist select_methods[] = {
     { "select",	select_select },
+#ifdef HAVE_SYS_EPOLL_H
+    { "poll",	select_poll,	1 },
+#endif
     { 0,	0 },
 };
 
@@ -240,4 +561,17 @@ initselect()
 	SelectError = newstringobject("select.error");
 	if ( SelectError == NULL || dictinsert(d, "error", SelectError) )
 	  fatal("Cannot define select.error");
+#ifdef HAVE_SYS_EPOLL_H
+	insint(d, "POLLIN", EPOLLIN);
+	insint(d, "POLLPRI", EPOLLPRI);
+	insint(d, "POLLOUT", EPOLLOUT);
+	insint(d, "POLLERR", EPOLLERR);
+	insint(d, "POLLHUP", EPOLLHUP);
+#ifdef EPOLLET
+	insint(d, "EPOLLET", EPOLLET);
+#endif
+#ifdef EPOLLONESHOT
+	insint(d, "EPOLLONESHOT", EPOLLONESHOT);
+#endif
+#endif
 }
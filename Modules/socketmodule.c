@@ -45,6 +45,10 @@ Module interface:
 - socket.error: exception raised for socket specific errors
 - socket.gethostbyname(hostname) --> host IP address (string: 'dd.dd.dd.dd')
 - socket.gethostbyaddr(IP address) --> (hostname, [alias, ...], [IP addr, ...])
+- socket.prefetch(hostname) --> None; look hostname up in the background
+- socket.setdnscache(ttl [, negative_ttl]) --> None
+- socket.flushdnscache() --> None
+- socket.sethostsfile([filename]) --> None; resolve from filename instead
 - socket.gethostname() --> host name (string: 'spam' or 'spam.domain.com')
 - socket.getservbyname(servicename, protocolname) --> port number
 - socket.socket(family, type [, proto]) --> new socket object
@@ -74,8 +78,12 @@ Socket methods:
 - s.makefile([mode[, bufsize]]) --> file object
 - s.recv(buflen [,flags]) --> string
 - s.recvfrom(buflen [,flags]) --> string, sockaddr
+- s.recv_into(buffer [,nbytes [,flags]]) --> nbytes
+- s.recvfrom_into(buffer [,nbytes [,flags]]) --> nbytes, sockaddr
 - s.send(string [,flags]) --> nbytes
 - s.sendto(string, [flags,] sockaddr) --> nbytes
+- s.sendv(list of strings [,flags]) --> nbytes
+- s.sendfile(file [,offset [,count]]) --> nbytes
 - s.setblocking(0 | 1) --> None
 - s.setsockopt(level, optname, value) --> None
 - s.shutdown(how) --> None
@@ -84,10 +92,12 @@ Socket methods:
 */
 
 #include "Python.h"
+#include "pymutex.h"
 
 #include <sys/types.h>
 #include "mytime.h"
 
+#include <ctype.h>
 #include <signal.h>
 #ifndef MS_WINDOWS
 #include <netdb.h>
@@ -98,6 +108,25 @@ Socket methods:
 #include <winsock.h>
 #include <fcntl.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SENDMSG
+#include <sys/uio.h>
+#ifndef IOV_MAX
+#ifdef UIO_MAXIOV
+#define IOV_MAX UIO_MAXIOV
+#else
+#define IOV_MAX 16
+#endif
+#endif
+#endif
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#define USE_SENDFILE
+#endif
+
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #else
@@ -208,6 +237,10 @@ typedef struct {
 		struct sockaddr_un un;
 #endif
 	} sock_addr;
+	char *sock_rbuf;	/* Receive buffer for short messages */
+	int sock_rbufsize;
+	long sock_rbufbusy;	/* In use by recv() or recvfrom() */
+	int sock_recvavg;	/* Average size of recent messages */
 } PySocketSockObject;
 
 
@@ -235,23 +268,247 @@ BUILD_FUNC_DEF_4(PySocketSock_New,int,fd, int,family, int,type, int,proto)
 		s->sock_family = family;
 		s->sock_type = type;
 		s->sock_proto = proto;
+		s->sock_rbuf = NULL;
+		s->sock_rbufsize = 0;
+		s->sock_rbufbusy = 0;
+		s->sock_recvavg = -1;
 	}
 	return s;
 }
 
 
-/* Convert a string specifying a host name or one of a few symbolic
-   names to a numeric IP address.  This usually calls gethostbyname()
-   to do the work; the names "" and "<broadcast>" are special.
-   Return the length (should always be 4 bytes), or negative if
-   an error occurred; then an exception is raised. */
+/* Host name lookups.  Looking up a name can take a long time, and
+   programs tend to look up the same few names over and over, so the
+   answers are cached for dns_ttl seconds, and failures for dns_negttl
+   seconds.  The resolver is called without the interpreter lock;
+   resolver_lock keeps other threads out while gethostbyname() or
+   gethostbyaddr() returns static data.  socket.prefetch() looks a name up on a background
+   thread, so that a later connect() finds it in the cache.  For
+   testing, socket.sethostsfile() replaces the resolver by a file in
+   the format of /etc/hosts. */
+
+#define DNS_BUCKETS 64		/* Size of the hash table */
+#define DNS_MAXENTRIES 512	/* The cache is flushed when it gets this big */
+#define DNS_MAXNAME 256		/* Longer names are never found */
+
+struct dnsentry {
+	struct dnsentry *next;
+	char *name;		/* In lower case */
+	struct in_addr addr;
+	char *error;		/* Static message, or NULL if found */
+	time_t expires;
+};
+
+struct dnsrequest {
+	struct dnsrequest *next;
+	char name[DNS_MAXNAME];
+};
+
+static struct dnsentry *dns_cache[DNS_BUCKETS];
+static int dns_entries = 0;
+static int dns_ttl = 60;
+static int dns_negttl = 10;
+static char *dns_hostsfile = NULL;	/* Replaces the resolver if set */
+static struct dnsrequest *dns_queue = NULL; /* Names to prefetch */
+static int dns_prefetching = 0;		/* The prefetch thread is running */
+
+#ifdef WITH_THREAD
+#include "thread.h"
+static type_lock dns_lock;		/* Protects the cache and queue */
+static type_lock resolver_lock;		/* Held while resolving */
+#define DNS_LOCK(lock)		acquire_lock(lock, WAIT_LOCK)
+#define DNS_UNLOCK(lock)	release_lock(lock)
+#else
+#define DNS_LOCK(lock)
+#define DNS_UNLOCK(lock)
+#endif
+
+
+/* Parse a dotted decimal address.  Return 1 if name is one. */
 
 static int
-BUILD_FUNC_DEF_2(setipaddr, char*,name, struct sockaddr_in *,addr_ret)
+BUILD_FUNC_DEF_2(dotted_addr, char *,name, struct in_addr *,addr)
 {
-	struct hostent *hp;
 	int d1, d2, d3, d4;
 	char ch;
+	if (sscanf(name, "%d.%d.%d.%d%c", &d1, &d2, &d3, &d4, &ch) == 4 &&
+	    0 <= d1 && d1 <= 255 && 0 <= d2 && d2 <= 255 &&
+	    0 <= d3 && d3 <= 255 && 0 <= d4 && d4 <= 255) {
+		addr->s_addr = htonl(
+			((long) d1 << 24) | ((long) d2 << 16) |
+			((long) d3 << 8) | ((long) d4 << 0));
+		return 1;
+	}
+	return 0;
+}
+
+
+/* Copy a host name to key in lower case.  Return 0 if it's too long. */
+
+static int
+BUILD_FUNC_DEF_2(dns_key, char *,name, char *,key)
+{
+	int i;
+	for (i = 0; name[i] != '\0'; i++) {
+		if (i >= DNS_MAXNAME - 1)
+			return 0;
+		key[i] = isupper(Py_CHARMASK(name[i])) ?
+			tolower(Py_CHARMASK(name[i])) : name[i];
+	}
+	key[i] = '\0';
+	return 1;
+}
+
+static int
+BUILD_FUNC_DEF_1(dns_hash, char *,key)
+{
+	unsigned int h = 0;
+	while (*key != '\0')
+		h = h*31 + Py_CHARMASK(*key++);
+	return h % DNS_BUCKETS;
+}
+
+
+/* Look key up in the cache.  Return 1 and the address or error
+   message if it's there and hasn't expired, else 0. */
+
+static int
+BUILD_FUNC_DEF_3(dns_get, char *,key, struct in_addr *,addr, char **,p_error)
+{
+	struct dnsentry *e;
+	time_t now = time((time_t *)NULL);
+	int found = 0;
+	DNS_LOCK(dns_lock);
+	for (e = dns_cache[dns_hash(key)]; e != NULL; e = e->next) {
+		if (strcmp(e->name, key) == 0) {
+			if (e->expires > now) {
+				*addr = e->addr;
+				*p_error = e->error;
+				found = 1;
+			}
+			break;
+		}
+	}
+	DNS_UNLOCK(dns_lock);
+	return found;
+}
+
+/* Remove all entries; call with dns_lock held */
+
+static void
+dns_clear()
+{
+	struct dnsentry *e, *next;
+	int i;
+	for (i = 0; i < DNS_BUCKETS; i++) {
+		for (e = dns_cache[i]; e != NULL; e = next) {
+			next = e->next;
+			free(e->name);
+			free((char *)e);
+		}
+		dns_cache[i] = NULL;
+	}
+	dns_entries = 0;
+}
+
+/* Enter an answer in the cache.  Failing to allocate memory just means
+   it isn't cached. */
+
+static void
+BUILD_FUNC_DEF_3(dns_put, char *,key, struct in_addr *,addr, char *,error)
+{
+	struct dnsentry *e;
+	int h = dns_hash(key);
+	int ttl = error == NULL ? dns_ttl : dns_negttl;
+	if (ttl <= 0)
+		return;
+	DNS_LOCK(dns_lock);
+	for (e = dns_cache[h]; e != NULL; e = e->next) {
+		if (strcmp(e->name, key) == 0)
+			break;
+	}
+	if (e == NULL) {
+		if (dns_entries >= DNS_MAXENTRIES)
+			dns_clear();
+		e = (struct dnsentry *) malloc(sizeof(struct dnsentry));
+		if (e != NULL && (e->name = strdup(key)) == NULL) {
+			free((char *)e);
+			e = NULL;
+		}
+		if (e != NULL) {
+			e->next = dns_cache[h];
+			dns_cache[h] = e;
+			dns_entries++;
+		}
+	}
+	if (e != NULL) {
+		if (error == NULL)
+			e->addr = *addr;
+		e->error = error;
+		e->expires = time((time_t *)NULL) + ttl;
+	}
+	DNS_UNLOCK(dns_lock);
+}
+
+
+/* Look key up in a file in the format of /etc/hosts: an address
+   followed by names on each line, and comments starting with '#'.
+   Return NULL and the address, or an error message. */
+
+static char *
+BUILD_FUNC_DEF_3(hostsfile_lookup, char *,file, char *,key, struct in_addr *,addr)
+{
+	FILE *fp;
+	char line[1024], *p, *word;
+	struct in_addr a;
+	int first;
+	if ((fp = fopen(file, "r")) == NULL)
+		return "can't open hosts file";
+	while (fgets(line, sizeof line, fp) != NULL) {
+		p = line;
+		first = 1;
+		for (;;) {
+			while (*p != '\0' && isspace(Py_CHARMASK(*p)))
+				p++;
+			if (*p == '\0' || *p == '#')
+				break;
+			word = p;
+			for (; *p != '\0' && !isspace(Py_CHARMASK(*p)); p++) {
+				if (isupper(Py_CHARMASK(*p)))
+					*p = tolower(Py_CHARMASK(*p));
+			}
+			if (*p != '\0')
+				*p++ = '\0';
+			if (first) {
+				if (!dotted_addr(word, &a))
+					break;
+				first = 0;
+			}
+			else if (strcmp(word, key) == 0) {
+				fclose(fp);
+				*addr = a;
+				return NULL;
+			}
+		}
+	}
+	fclose(fp);
+	return "host not found";
+}
+
+
+/* Resolve a host name that isn't in the cache, and cache the answer.
+   Return NULL and the address, or an error message.  This is called
+   without the interpreter lock.  resolver_lock is held while the cache
+   is checked again and updated, and while a hosts file is read, which
+   sethostsfile() may replace.  gethostbyname() returns static data, so
+   it is called with the lock held too; gethostbyname_r() is not, so
+   that other threads can resolve other names meanwhile. */
+
+static char *
+BUILD_FUNC_DEF_2(resolve, char *,key, struct in_addr *,addr)
+{
+	struct hostent *hp;
+	char *error;
 #ifdef HAVE_GETHOSTBYNAME_R
 	struct hostent hp_allocated;
 	char buf[1001];
@@ -259,6 +516,64 @@ BUILD_FUNC_DEF_2(setipaddr, char*,name, struct sockaddr_in *,addr_ret)
 	int errnop;
 #endif /* HAVE_GETHOSTBYNAME_R */
 
+	DNS_LOCK(resolver_lock);
+	/* Another thread may have looked it up meanwhile */
+	if (dns_get(key, addr, &error)) {
+		DNS_UNLOCK(resolver_lock);
+		return error;
+	}
+	if (dns_hostsfile != NULL) {
+		error = hostsfile_lookup(dns_hostsfile, key, addr);
+		dns_put(key, addr, error);
+		DNS_UNLOCK(resolver_lock);
+		return error;
+	}
+#ifdef HAVE_GETHOSTBYNAME_R
+	DNS_UNLOCK(resolver_lock);
+	hp = gethostbyname_r(key, &hp_allocated, buf, buf_len, &errnop);
+#else /* not HAVE_GETHOSTBYNAME_R */
+	hp = gethostbyname(key);
+#endif /* HAVE_GETHOSTBYNAME_R */
+	if (hp == NULL) {
+#ifdef HAVE_HSTRERROR
+		/* Let's get real error message to return */
+#ifdef HAVE_GETHOSTBYNAME_R
+		error = (char *)hstrerror(errnop);
+#else
+		extern int h_errno;
+		error = (char *)hstrerror(h_errno);
+#endif
+#else
+		error = "host not found";
+#endif
+	}
+	else {
+		memcpy((char *) addr, hp->h_addr, sizeof *addr);
+		error = NULL;
+	}
+#ifdef HAVE_GETHOSTBYNAME_R
+	DNS_LOCK(resolver_lock);
+#endif
+	/* sethostsfile() may have replaced the resolver meanwhile */
+	if (dns_hostsfile == NULL)
+		dns_put(key, addr, error);
+	DNS_UNLOCK(resolver_lock);
+	return error;
+}
+
+
+/* Convert a string specifying a host name or one of a few symbolic
+   names to a numeric IP address.  This usually calls gethostbyname()
+   to do the work, through the cache above; the names "" and
+   "<broadcast>" are special.  Return the length (always 4 bytes), or
+   negative if an error occurred; then an exception is raised. */
+
+static int
+BUILD_FUNC_DEF_2(setipaddr, char*,name, struct sockaddr_in *,addr_ret)
+{
+	char key[DNS_MAXNAME];
+	char *error;
+
 	if (name[0] == '\0') {
 		addr_ret->sin_addr.s_addr = INADDR_ANY;
 		return 4;
@@ -267,34 +582,20 @@ BUILD_FUNC_DEF_2(setipaddr, char*,name, struct sockaddr_in *,addr_ret)
 		addr_ret->sin_addr.s_addr = INADDR_BROADCAST;
 		return 4;
 	}
-	if (sscanf(name, "%d.%d.%d.%d%c", &d1, &d2, &d3, &d4, &ch) == 4 &&
-	    0 <= d1 && d1 <= 255 && 0 <= d2 && d2 <= 255 &&
-	    0 <= d3 && d3 <= 255 && 0 <= d4 && d4 <= 255) {
-		addr_ret->sin_addr.s_addr = htonl(
-			((long) d1 << 24) | ((long) d2 << 16) |
-			((long) d3 << 8) | ((long) d4 << 0));
+	if (dotted_addr(name, &addr_ret->sin_addr))
 		return 4;
+	if (!dns_key(name, key))
+		error = "host not found";
+	else if (!dns_get(key, &addr_ret->sin_addr, &error)) {
+		Py_BEGIN_ALLOW_THREADS
+		error = resolve(key, &addr_ret->sin_addr);
+		Py_END_ALLOW_THREADS
 	}
-#ifdef HAVE_GETHOSTBYNAME_R
-	Py_BEGIN_ALLOW_THREADS
-	hp = gethostbyname_r(name, &hp_allocated, buf, buf_len, &errnop);
-	Py_END_ALLOW_THREADS
-#else /* not HAVE_GETHOSTBYNAME_R */
-	hp = gethostbyname(name);
-#endif /* HAVE_GETHOSTBYNAME_R */
-
-	if (hp == NULL) {
-#ifdef HAVE_HSTRERROR
-	        /* Let's get real error message to return */
-	        extern int h_errno;
-		PyErr_SetString(PySocket_Error, (char *)hstrerror(h_errno));
-#else
-		PyErr_SetString(PySocket_Error, "host not found");
-#endif
+	if (error != NULL) {
+		PyErr_SetString(PySocket_Error, error);
 		return -1;
 	}
-	memcpy((char *) &addr_ret->sin_addr, hp->h_addr, hp->h_length);
-	return hp->h_length;
+	return 4;
 }
 
 
@@ -784,64 +1085,219 @@ BUILD_FUNC_DEF_2(PySocketSock_makefile,PySocketSockObject *,s, PyObject *,args)
 }
 #endif /* NO_DUP */
 
-/* s.recv(nbytes [,flags]) method */
+/* recv() and recvfrom() allocate a string of the requested size and
+   shrink it to the size of the message received.  Programs often ask
+   for much more than they get, e.g. 64K for a datagram of a few
+   hundred bytes, which makes this a large allocation and a resize for
+   every message.  So the socket keeps a running average of the sizes
+   received, and when that is much smaller than what is asked for, the
+   message is received into a buffer kept with the socket and copied
+   into a string of the right size instead. */
 
-static PyObject *
-BUILD_FUNC_DEF_2(PySocketSock_recv,PySocketSockObject *,s, PyObject *,args)
+#define RECV_SMALL 1024		/* No point in copying below this */
+#define RECV_BUFMAX 262144	/* Largest buffer kept with a socket */
+
+/* Return the socket's buffer to receive len bytes into, or NULL to
+   receive into a new string.  The buffer must be given back by clearing
+   sock_rbufbusy once nothing more is read from it. */
+
+static char *
+BUILD_FUNC_DEF_2(recv_buffer, PySocketSockObject *,s, int,len)
 {
-	int len, n, flags = 0;
-	PyObject *buf;
-	if (!PyArg_ParseTuple(args, "i|i", &len, &flags))
+	if (len <= RECV_SMALL || len > RECV_BUFMAX ||
+	    s->sock_recvavg < 0 || s->sock_recvavg > len/4)
 		return NULL;
-	buf = PyString_FromStringAndSize((char *) 0, len);
-	if (buf == NULL)
+	/* Another thread may be receiving on the same socket */
+	if (!Py_AtomicCAS(&s->sock_rbufbusy, 0L, 1L))
 		return NULL;
+	if (s->sock_rbufsize < len) {
+		char *p = s->sock_rbuf;
+		PyMem_RESIZE(p, char, len);
+		if (p == NULL) {
+			s->sock_rbufbusy = 0;
+			return NULL;
+		}
+		s->sock_rbuf = p;
+		s->sock_rbufsize = len;
+	}
+	return s->sock_rbuf;
+}
+
+/* Note the size of a message received */
+
+static void
+BUILD_FUNC_DEF_2(recv_done, PySocketSockObject *,s, int,n)
+{
+	if (s->sock_recvavg < 0)
+		s->sock_recvavg = n;
+	else
+		s->sock_recvavg += (n - s->sock_recvavg) / 4;
+}
+
+/* The sender's address, as stored by recvfrom() */
+
+struct recvaddr {
+	char buf[256];
+	int len;
+};
+
+/* Receive at most len bytes into a new string.  If from is not NULL,
+   recvfrom() is used, which stores the sender's address there. */
+
+static PyObject *
+BUILD_FUNC_DEF_4(recv_string, PySocketSockObject *,s, int,len, int,flags, struct recvaddr *,from)
+{
+	PyObject *buf = NULL;
+	char *p, *rbuf;
+	int n;
+	if (from != NULL && !getsockaddrlen(s, &from->len))
+		return NULL;
+	if ((rbuf = recv_buffer(s, len)) != NULL)
+		p = rbuf;
+	else {
+		buf = PyString_FromStringAndSize((char *) 0, len);
+		if (buf == NULL)
+			return NULL;
+		p = PyString_AsString(buf);
+	}
 	Py_BEGIN_ALLOW_THREADS
-	n = recv(s->sock_fd, PyString_AsString(buf), len, flags);
+	if (from == NULL)
+		n = recv(s->sock_fd, p, len, flags);
+	else
+		n = recvfrom(s->sock_fd, p, len, flags,
+#ifndef MS_WINDOWS
+			     (ANY *)from->buf, &from->len);
+#else
+			     (struct sockaddr *)from->buf, &from->len);
+#endif
 	Py_END_ALLOW_THREADS
 	if (n < 0) {
-		Py_DECREF(buf);
+		if (rbuf != NULL)
+			s->sock_rbufbusy = 0;
+		Py_XDECREF(buf);
 		return PySocket_Err();
 	}
-	if (n != len && _PyString_Resize(&buf, n) < 0)
+	recv_done(s, n);
+	if (rbuf != NULL) {
+		buf = PyString_FromStringAndSize(rbuf, n);
+		/* Only now may another thread claim the buffer */
+		Py_MemoryBarrier();
+		s->sock_rbufbusy = 0;
+	}
+	else if (n != len && _PyString_Resize(&buf, n) < 0)
 		return NULL;
 	return buf;
 }
 
 
+/* s.recv(nbytes [,flags]) method */
+
+static PyObject *
+BUILD_FUNC_DEF_2(PySocketSock_recv,PySocketSockObject *,s, PyObject *,args)
+{
+	int len, flags = 0;
+	if (!PyArg_ParseTuple(args, "i|i", &len, &flags))
+		return NULL;
+	return recv_string(s, len, flags, (struct recvaddr *)NULL);
+}
+
+
 /* s.recvfrom(nbytes [,flags]) method */
 
 static PyObject *
 BUILD_FUNC_DEF_2(PySocketSock_recvfrom,PySocketSockObject *,s, PyObject *,args)
 {
-	char addrbuf[256];
+	struct recvaddr from;
 	PyObject *buf, *addr, *ret;
-	int addrlen, len, n, flags = 0;
+	int len, flags = 0;
 	if (!PyArg_ParseTuple(args, "i|i", &len, &flags))
 		return NULL;
-	if (!getsockaddrlen(s, &addrlen))
-		return NULL;
-	buf = PyString_FromStringAndSize((char *) 0, len);
+	buf = recv_string(s, len, flags, &from);
 	if (buf == NULL)
 		return NULL;
+	addr = makesockaddr((struct sockaddr *)from.buf, from.len);
+	ret = Py_BuildValue("OO", buf, addr);
+	Py_XDECREF(addr);
+	Py_XDECREF(buf);
+	return ret;
+}
+
+
+/* Get the memory to receive into for recv_into() and recvfrom_into().
+   The buffer object is stored in *p_obj, and must be given back with
+   PyObject_ReleaseBuffer() after the receive; until then, it can't be
+   resized or closed. */
+
+static int
+BUILD_FUNC_DEF_4(into_buffer, PyObject *,args, PyObject **,p_obj, char **,p_buf, int *,p_flags)
+{
+	void *buf;
+	int size, len = 0;
+	*p_flags = 0;
+	if (!PyArg_ParseTuple(args, "O|ii", p_obj, &len, p_flags))
+		return -1;
+	if ((size = PyObject_AsWriteBuffer(*p_obj, &buf)) < 0)
+		return -1;
+	if (len < 0 || len > size) {
+		PyObject_ReleaseBuffer(*p_obj);
+		PyErr_SetString(PyExc_ValueError,
+				"nbytes is greater than the buffer size");
+		return -1;
+	}
+	*p_buf = (char *)buf;
+	return len == 0 ? size : len;
+}
+
+
+/* s.recv_into(buffer [,nbytes [,flags]]) method */
+
+static PyObject *
+BUILD_FUNC_DEF_2(PySocketSock_recv_into,PySocketSockObject *,s, PyObject *,args)
+{
+	PyObject *bufobj;
+	char *buf;
+	int len, n, flags;
+	if ((len = into_buffer(args, &bufobj, &buf, &flags)) < 0)
+		return NULL;
 	Py_BEGIN_ALLOW_THREADS
-	n = recvfrom(s->sock_fd, PyString_AsString(buf), len, flags,
+	n = recv(s->sock_fd, buf, len, flags);
+	Py_END_ALLOW_THREADS
+	PyObject_ReleaseBuffer(bufobj);
+	if (n < 0)
+		return PySocket_Err();
+	return PyInt_FromLong((long)n);
+}
+
+
+/* s.recvfrom_into(buffer [,nbytes [,flags]]) method */
+
+static PyObject *
+BUILD_FUNC_DEF_2(PySocketSock_recvfrom_into,PySocketSockObject *,s, PyObject *,args)
+{
+	char addrbuf[256];
+	PyObject *bufobj, *addr, *ret;
+	char *buf;
+	int addrlen, len, n, flags;
+	if ((len = into_buffer(args, &bufobj, &buf, &flags)) < 0)
+		return NULL;
+	if (!getsockaddrlen(s, &addrlen)) {
+		PyObject_ReleaseBuffer(bufobj);
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	n = recvfrom(s->sock_fd, buf, len, flags,
 #ifndef MS_WINDOWS
 		     (ANY *)addrbuf, &addrlen);
 #else
 		     (struct sockaddr *)addrbuf, &addrlen);
 #endif
 	Py_END_ALLOW_THREADS
-	if (n < 0) {
-		Py_DECREF(buf);
+	PyObject_ReleaseBuffer(bufobj);
+	if (n < 0)
 		return PySocket_Err();
-	}
-	if (n != len && _PyString_Resize(&buf, n) < 0)
-		return NULL;
 	addr = makesockaddr((struct sockaddr *)addrbuf, addrlen);
-	ret = Py_BuildValue("OO", buf, addr);
+	ret = Py_BuildValue("iO", n, addr);
 	Py_XDECREF(addr);
-	Py_XDECREF(buf);
 	return ret;
 }
 
@@ -890,6 +1346,171 @@ BUILD_FUNC_DEF_2(PySocketSock_sendto,PySocketSockObject *,s, PyObject *,args)
 }
 
 
+#ifdef HAVE_SENDMSG
+
+/* s.sendv(list of strings [,flags]) method */
+
+/* The strings are gathered into sendmsg() calls of at most IOV_MAX
+   buffers, and sent until all are sent, resuming after partial sends.
+   If an error occurs after some data was sent (e.g. a non-blocking
+   socket would block), the count sent so far is returned; the error
+   is reported by the next call. */
+
+static PyObject *
+BUILD_FUNC_DEF_2(PySocketSock_sendv,PySocketSockObject *,s, PyObject *,args)
+{
+	PyObject *seq, *data;
+	struct msghdr msg;
+	struct iovec *iov, *p;
+	int i, n, k, left, total, flags = 0;
+	if (!PyArg_ParseTuple(args, "O|i", &seq, &flags))
+		return NULL;
+	if (!PySequence_Check(seq)) {
+		PyErr_SetString(PyExc_TypeError,
+				"sendv() requires a sequence of strings");
+		return NULL;
+	}
+	/* A tuple keeps the strings alive while other threads run */
+	data = PySequence_Tuple(seq);
+	if (data == NULL)
+		return NULL;
+	n = PyTuple_Size(data);
+	iov = PyMem_NEW(struct iovec, n);
+	if (iov == NULL) {
+		Py_DECREF(data);
+		return PyErr_NoMemory();
+	}
+	for (i = 0; i < n; i++) {
+		PyObject *item = PyTuple_GET_ITEM(data, i);
+		if (!PyString_Check(item)) {
+			PyMem_DEL(iov);
+			Py_DECREF(data);
+			PyErr_SetString(PyExc_TypeError,
+				"sendv() requires a sequence of strings");
+			return NULL;
+		}
+		iov[i].iov_base = PyString_AsString(item);
+		iov[i].iov_len = PyString_Size(item);
+	}
+	p = iov;
+	left = n;
+	total = k = 0;
+	Py_BEGIN_ALLOW_THREADS
+	while (left > 0) {
+		memset((char *)&msg, '\0', sizeof msg);
+		msg.msg_iov = p;
+		msg.msg_iovlen = left < IOV_MAX ? left : IOV_MAX;
+		k = sendmsg(s->sock_fd, &msg, flags);
+		if (k < 0)
+			break;
+		total += k;
+		while (left > 0 && k >= (int)p->iov_len) {
+			k -= p->iov_len;
+			p++;
+			left--;
+		}
+		if (k > 0) {
+			p->iov_base = (char *)p->iov_base + k;
+			p->iov_len -= k;
+		}
+	}
+	Py_END_ALLOW_THREADS
+	PyMem_DEL(iov);
+	Py_DECREF(data);
+	if (k < 0 && total == 0)
+		return PySocket_Err();
+	return PyInt_FromLong((long)total);
+}
+
+#endif /* HAVE_SENDMSG */
+
+
+#ifdef USE_SENDFILE
+
+/* s.sendfile(file [,offset [,count]]) method */
+
+/* The kernel copies from the file to the socket; the data is never
+   seen by the process.  Without an offset, sending starts at the
+   file's current position, which is then moved past the data sent;
+   with an offset, the file's position is left alone.  A count of
+   zero sends up to the end of the file.  Partial sends are resumed;
+   as with sendv(), an error after some data was sent (e.g. on a
+   non-blocking socket) returns the count sent so far. */
+
+#define SENDFILE_CHUNK 0x40000000
+
+static PyObject *
+BUILD_FUNC_DEF_2(PySocketSock_sendfile,PySocketSockObject *,s, PyObject *,args)
+{
+	PyObject *file;
+	FILE *fp = NULL;
+	long offset = -1, count = 0, total;
+	off_t off;
+	int fd, n = 0;
+	if (!PyArg_ParseTuple(args, "O|ll", &file, &offset, &count))
+		return NULL;
+	if (PyFile_Check(file)) {
+		if ((fp = PyFile_AsFile(file)) == NULL) {
+			PyErr_SetString(PyExc_ValueError,
+					"I/O operation on closed file");
+			return NULL;
+		}
+		fd = fileno(fp);
+	}
+	else if (PyInt_Check(file))
+		fd = (int)PyInt_AsLong(file);
+	else {
+		PyErr_SetString(PyExc_TypeError,
+			"sendfile() requires a file object or descriptor");
+		return NULL;
+	}
+	if (count < 0) {
+		PyErr_SetString(PyExc_ValueError, "negative count");
+		return NULL;
+	}
+	if (fp != NULL)
+		fflush(fp);
+	if (offset >= 0)
+		off = offset;
+	else if (fp != NULL)
+		/* stdio may have read ahead of the descriptor */
+		off = ftell(fp);
+	else
+		off = lseek(fd, (off_t)0, SEEK_CUR);
+	if (off < 0)
+		return PySocket_Err();
+	total = 0;
+	Py_BEGIN_ALLOW_THREADS
+	for (;;) {
+		size_t chunk = SENDFILE_CHUNK;
+		if (count > 0) {
+			if (total >= count)
+				break;
+			if (count - total < chunk)
+				chunk = count - total;
+		}
+		n = sendfile(s->sock_fd, fd, &off, chunk);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		total += n;
+	}
+	Py_END_ALLOW_THREADS
+	if (n < 0 && total == 0)
+		return PySocket_Err();
+	if (offset < 0) {
+		if (fp != NULL)
+			fseek(fp, (long)off, SEEK_SET);
+		else
+			lseek(fd, off, SEEK_SET);
+	}
+	return PyInt_FromLong(total);
+}
+
+#endif /* USE_SENDFILE */
+
+
 /* s.shutdown(how) method */
 
 static PyObject *
@@ -933,8 +1554,16 @@ static PyMethodDef PySocketSock_methods[] = {
 #endif
 	{"recv",		(PyCFunction)PySocketSock_recv, 1},
 	{"recvfrom",		(PyCFunction)PySocketSock_recvfrom, 1},
+	{"recv_into",		(PyCFunction)PySocketSock_recv_into, 1},
+	{"recvfrom_into",	(PyCFunction)PySocketSock_recvfrom_into, 1},
 	{"send",		(PyCFunction)PySocketSock_send, 1},
 	{"sendto",		(PyCFunction)PySocketSock_sendto},
+#ifdef HAVE_SENDMSG
+	{"sendv",		(PyCFunction)PySocketSock_sendv, 1},
+#endif
+#ifdef USE_SENDFILE
+	{"sendfile",		(PyCFunction)PySocketSock_sendfile, 1},
+#endif
 	{"shutdown",		(PyCFunction)PySocketSock_shutdown},
 	{NULL,			NULL}		/* sentinel */
 };
@@ -947,6 +1576,8 @@ static void
 BUILD_FUNC_DEF_1(PySocketSock_dealloc,PySocketSockObject *,s)
 {
 	(void) close(s->sock_fd);
+	if (s->sock_rbuf != NULL)
+		PyMem_DEL(s->sock_rbuf);
 	PyMem_DEL(s);
 }
 
@@ -1045,10 +1676,15 @@ BUILD_FUNC_DEF_2(PySocket_gethostbyaddr,PyObject *,self, PyObject *, args)
 		return NULL;
 	if (setipaddr(ip_num, &addr) < 0)
 		return NULL;
+	/* The hostent is static; resolver_lock is held until it's copied */
+	Py_BEGIN_ALLOW_THREADS
+	DNS_LOCK(resolver_lock);
 	h = gethostbyaddr((char *)&addr.sin_addr,
 			  sizeof(addr.sin_addr),
 			  AF_INET);
+	Py_END_ALLOW_THREADS
 	if (h == NULL) {
+		DNS_UNLOCK(resolver_lock);
 #ifdef HAVE_HSTRERROR
 	        /* Let's get real error message to return */
 	        extern int h_errno;
@@ -1079,12 +1715,133 @@ BUILD_FUNC_DEF_2(PySocket_gethostbyaddr,PyObject *,self, PyObject *, args)
 	}
 	rtn_tuple = Py_BuildValue("sOO", h->h_name, name_list, addr_list);
  err:
+	DNS_UNLOCK(resolver_lock);
 	Py_XDECREF(name_list);
 	Py_XDECREF(addr_list);
 	return rtn_tuple;
 }
 
 
+/* Python interface to the host name cache */
+
+#ifdef WITH_THREAD
+
+/* The prefetch thread: resolve the queued names until there are none */
+
+static void
+BUILD_FUNC_DEF_1(dns_prefetcher, void *,arg)
+{
+	struct dnsrequest *r;
+	struct in_addr addr;
+	for (;;) {
+		DNS_LOCK(dns_lock);
+		if ((r = dns_queue) == NULL) {
+			dns_prefetching = 0;
+			DNS_UNLOCK(dns_lock);
+			break;
+		}
+		dns_queue = r->next;
+		DNS_UNLOCK(dns_lock);
+		(void) resolve(r->name, &addr);
+		free((char *)r);
+	}
+}
+
+#endif /* WITH_THREAD */
+
+/*ARGSUSED*/
+static PyObject *
+BUILD_FUNC_DEF_2(PySocket_prefetch,PyObject *,self, PyObject *,args)
+{
+	char *name, key[DNS_MAXNAME], *error;
+	struct in_addr addr;
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+	if (name[0] != '\0' && name[0] != '<' && !dotted_addr(name, &addr) &&
+	    dns_key(name, key) && !dns_get(key, &addr, &error)) {
+#ifdef WITH_THREAD
+		struct dnsrequest *r;
+		int start;
+		r = (struct dnsrequest *) malloc(sizeof(struct dnsrequest));
+		if (r == NULL)
+			return PyErr_NoMemory();
+		strcpy(r->name, key);
+		DNS_LOCK(dns_lock);
+		r->next = dns_queue;
+		dns_queue = r;
+		start = !dns_prefetching;
+		dns_prefetching = 1;
+		DNS_UNLOCK(dns_lock);
+		if (start && !start_new_thread(dns_prefetcher, (void *)NULL)) {
+			dns_prefetching = 0;
+			PyErr_SetString(PySocket_Error,
+					"can't start prefetch thread");
+			return NULL;
+		}
+#else
+		Py_BEGIN_ALLOW_THREADS
+		(void) resolve(key, &addr);
+		Py_END_ALLOW_THREADS
+#endif
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/*ARGSUSED*/
+static PyObject *
+BUILD_FUNC_DEF_2(PySocket_setdnscache,PyObject *,self, PyObject *,args)
+{
+	int ttl, negttl = dns_negttl;
+	if (!PyArg_ParseTuple(args, "i|i", &ttl, &negttl))
+		return NULL;
+	DNS_LOCK(dns_lock);
+	dns_ttl = ttl;
+	dns_negttl = negttl;
+	dns_clear();
+	DNS_UNLOCK(dns_lock);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/*ARGSUSED*/
+static PyObject *
+BUILD_FUNC_DEF_2(PySocket_flushdnscache,PyObject *,self, PyObject *,args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+	DNS_LOCK(dns_lock);
+	dns_clear();
+	DNS_UNLOCK(dns_lock);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/*ARGSUSED*/
+static PyObject *
+BUILD_FUNC_DEF_2(PySocket_sethostsfile,PyObject *,self, PyObject *,args)
+{
+	char *file = NULL, *copy = NULL;
+	if (!PyArg_ParseTuple(args, "|z", &file))
+		return NULL;
+	if (file != NULL && (copy = strdup(file)) == NULL)
+		return PyErr_NoMemory();
+	/* Wait for lookups using the old file to finish */
+	Py_BEGIN_ALLOW_THREADS
+	DNS_LOCK(resolver_lock);
+	Py_END_ALLOW_THREADS
+	if (dns_hostsfile != NULL)
+		free(dns_hostsfile);
+	dns_hostsfile = copy;
+	DNS_LOCK(dns_lock);
+	dns_clear();
+	DNS_UNLOCK(dns_lock);
+	DNS_UNLOCK(resolver_lock);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
 /* Python interface to getservbyname(name).
    This only returns the port number, since the other info is already
    known or not useful (like the list of aliases). */
@@ -1229,6 +1986,10 @@ static PyMethodDef PySocket_methods[] = {
 	{"gethostbyaddr",	PySocket_gethostbyaddr},
 	{"gethostname",		PySocket_gethostname},
 	{"getservbyname",	PySocket_getservbyname},
+	{"prefetch",		PySocket_prefetch, 1},
+	{"setdnscache",		PySocket_setdnscache, 1},
+	{"flushdnscache",	PySocket_flushdnscache, 1},
+	{"sethostsfile",	PySocket_sethostsfile, 1},
 	{"socket",		PySocket_socket, 1},
 #ifndef NO_DUP
 	{"fromfd",		PySocket_fromfd, 1},
@@ -1333,6 +2094,12 @@ initsocket()
 	if (PySocket_Error == NULL || 
 	    PyDict_SetItemString(d, "error", PySocket_Error) != 0)
 		Py_FatalError("can't define socket.error");
+#ifdef WITH_THREAD
+	dns_lock = allocate_lock();
+	resolver_lock = allocate_lock();
+	if (dns_lock == NULL || resolver_lock == NULL)
+		Py_FatalError("can't allocate socket resolver locks");
+#endif
 	insint(d, "AF_INET", AF_INET);
 #ifdef AF_UNIX
 	insint(d, "AF_UNIX", AF_UNIX);
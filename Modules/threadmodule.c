@@ -41,12 +41,59 @@ Rerun configure, adding a --with-thread option.
 
 #include "thread.h"
 #include "threadstate.h"
+#include "pymutex.h"
+#include "mytime.h"
 
 extern volatile int threads_started;
 
 static object *ThreadError;
 
 
+/* Convert a timeout in seconds to microseconds; negative (or too long
+   for a long) means forever. */
+
+static long
+timeout_usec(timeout)
+	double timeout;
+{
+	if (timeout < 0 || timeout * 1e6 > 0x7fffffffL)
+		return -1;
+	return (long)(timeout * 1e6);
+}
+
+/* Parse the arguments of the acquire methods: an optional waitflag
+   and, if it's nonzero, an optional timeout.  Return the number of
+   microseconds to wait (negative for forever), or -2 for an error. */
+
+static long
+acquire_args(args)
+	object *args;
+{
+	int waitflag = 1;
+	double timeout = -1.0;
+	if (!newgetargs(args, "|id", &waitflag, &timeout))
+		return -2;
+	if (!waitflag)
+		return 0;
+	return timeout_usec(timeout);
+}
+
+/* The value acquire methods return: None without arguments, else
+   whether the lock was acquired */
+
+static object *
+acquire_result(args, success)
+	object *args;
+	int success;
+{
+	if (gettuplesize(args) == 0) {
+		INCREF(None);
+		return None;
+	}
+	return newintobject((long)success);
+}
+
+
 /* Lock objects */
 
 typedef struct {
@@ -101,25 +148,17 @@ lock_acquire_lock(self, args)
 	lockobject *self;
 	object *args;
 {
+	long usec;
 	int i;
 
-	if (args != NULL) {
-		if (!getargs(args, "i", &i))
-			return NULL;
-	}
-	else
-		i = 1;
+	if ((usec = acquire_args(args)) == -2)
+		return NULL;
 
 	BGN_SAVE
-	i = acquire_lock(self->lock_lock, i);
+	i = acquire_lock_timed(self->lock_lock, usec);
 	END_SAVE
 
-	if (args == NULL) {
-		INCREF(None);
-		return None;
-	}
-	else
-		return newintobject((long)i);
+	return acquire_result(args, i);
 }
 
 static object *
@@ -158,8 +197,8 @@ lock_locked_lock(self, args)
 }
 
 static struct methodlist lock_methods[] = {
-	{"acquire_lock",	(method)lock_acquire_lock},
-	{"acquire",		(method)lock_acquire_lock},
+	{"acquire_lock",	(method)lock_acquire_lock, 1},
+	{"acquire",		(method)lock_acquire_lock, 1},
 	{"release_lock",	(method)lock_release_lock},
 	{"release",		(method)lock_release_lock},
 	{"locked_lock",		(method)lock_locked_lock},
@@ -191,110 +230,1565 @@ static typeobject Locktype = {
 };
 
 
-/* Module functions */
+/* Semaphore objects */
+
+typedef struct {
+	OB_HEAD
+	type_sema sema_sema;
+} semaobject;
+
+staticforward typeobject Sematype;
+
+static object *
+sema_acquire(self, args)
+	semaobject *self;
+	object *args;
+{
+	long usec;
+	int i;
+
+	if ((usec = acquire_args(args)) == -2)
+		return NULL;
+
+	BGN_SAVE
+	i = down_sema_timed(self->sema_sema, usec);
+	END_SAVE
+
+	return acquire_result(args, i);
+}
+
+static object *
+sema_release(self, args)
+	semaobject *self;
+	object *args;
+{
+	if (!getnoarg(args))
+		return NULL;
+	up_sema(self->sema_sema);
+	INCREF(None);
+	return None;
+}
 
 static void
-t_bootstrap(args_raw)
-	void *args_raw;
+sema_dealloc(self)
+	semaobject *self;
 {
-	object *args = (object *) args_raw;
-	object *func, *arg, *res;
+	free_sema(self->sema_sema);
+	DEL(self);
+}
 
-	/* this doesn't need a CRIT section; we just want non-zero */
-	threads_started = 1;
-	PyThreadState_New();
+static struct methodlist sema_methods[] = {
+	{"acquire",		(method)sema_acquire, 1},
+	{"release",		(method)sema_release},
+	{NULL,			NULL}		/* sentinel */
+};
 
-	restore_thread((void *)NULL);
-	func = gettupleitem(args, 0);
-	arg = gettupleitem(args, 1);
-	res = call_object(func, arg);
-	DECREF(args); /* Matches the INCREF(args) in thread_start_new_thread */
-	if (res == NULL) {
-		if (err_occurred() == SystemExit)
-			err_clear();
+static object *
+sema_getattr(self, name)
+	semaobject *self;
+	char *name;
+{
+	return findmethod(sema_methods, (object *)self, name);
+}
+
+static typeobject Sematype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"semaphore",			/*tp_name*/
+	sizeof(semaobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)sema_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)sema_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+
+/* Condition variable objects.
+
+   A condition is used together with a lock object, which must be held
+   to wait on it or notify it.  Each waiting thread blocks on a lock of
+   its own, which notify() releases; the waiters are kept in a list in
+   the order they started waiting.  The list and the spare waiter locks
+   are protected by the condition's lock. */
+
+struct waiter {
+	struct waiter *w_next;
+	type_lock w_lock;		/* Locked until notified */
+	int w_notified;
+};
+
+#define MAXSPARE 8
+
+typedef struct {
+	OB_HEAD
+	lockobject *cond_lock;
+	struct waiter *cond_head;
+	struct waiter *cond_tail;
+	type_lock cond_spare[MAXSPARE];	/* Locked waiter locks for reuse */
+	int cond_nspare;
+} condobject;
+
+staticforward typeobject Condtype;
+
+/* Check that the condition's lock is held */
+
+static int
+cond_locked(self)
+	condobject *self;
+{
+	if (acquire_lock(self->cond_lock->lock_lock, 0)) {
+		release_lock(self->cond_lock->lock_lock);
+		err_setstr(ThreadError, "condition's lock is not acquired");
+		return 0;
+	}
+	return 1;
+}
+
+static object *
+cond_acquire(self, args)
+	condobject *self;
+	object *args;
+{
+	return lock_acquire_lock(self->cond_lock, args);
+}
+
+static object *
+cond_release(self, args)
+	condobject *self;
+	object *args;
+{
+	return lock_release_lock(self->cond_lock, args);
+}
+
+static object *
+cond_wait(self, args)
+	condobject *self;
+	object *args;
+{
+	type_lock lock = self->cond_lock->lock_lock;
+	struct waiter w, **pw;
+	double timeout = -1.0;
+	long usec;
+	int notified;
+
+	if (!newgetargs(args, "|d", &timeout))
+		return NULL;
+	if (!cond_locked(self))
+		return NULL;
+	usec = timeout_usec(timeout);
+	if (self->cond_nspare > 0)
+		w.w_lock = self->cond_spare[--self->cond_nspare];
+	else {
+		w.w_lock = allocate_lock();
+		if (w.w_lock == NULL) {
+			err_setstr(ThreadError, "can't allocate lock");
+			return NULL;
+		}
+		acquire_lock(w.w_lock, WAIT_LOCK);
+	}
+	w.w_next = NULL;
+	w.w_notified = 0;
+	if (self->cond_tail == NULL)
+		self->cond_head = &w;
+	else
+		self->cond_tail->w_next = &w;
+	self->cond_tail = &w;
+	release_lock(lock);
+
+	BGN_SAVE
+	notified = acquire_lock_timed(w.w_lock, usec);
+	acquire_lock(lock, WAIT_LOCK);
+	END_SAVE
+
+	if (!notified) {
+		if (w.w_notified) {
+			/* Notified after the timeout: lock it for reuse */
+			acquire_lock(w.w_lock, WAIT_LOCK);
+			notified = 1;
+		}
 		else {
-			fprintf(stderr, "Unhandled exception in thread:\n");
-			print_error(); /* From pythonmain.c */
+			/* Still in the list; take it out */
+			struct waiter *prev = NULL;
+			for (pw = &self->cond_head; *pw != &w;
+			     pw = &(*pw)->w_next)
+				prev = *pw;
+			*pw = w.w_next;
+			if (self->cond_tail == &w)
+				self->cond_tail = prev;
 		}
 	}
+	if (self->cond_nspare < MAXSPARE)
+		self->cond_spare[self->cond_nspare++] = w.w_lock;
 	else
-		DECREF(res);
-	(void) save_thread(); /* Should always be NULL */
-	PyThreadState_Free();
-	exit_thread();
+		free_lock(w.w_lock);
+	return newintobject((long)notified);
+}
+
+/* Wake up at most n waiters */
+
+static void
+cond_wake(self, n)
+	condobject *self;
+	int n;
+{
+	struct waiter *w;
+	while (n-- > 0 && (w = self->cond_head) != NULL) {
+		self->cond_head = w->w_next;
+		if (self->cond_head == NULL)
+			self->cond_tail = NULL;
+		w->w_notified = 1;
+		release_lock(w->w_lock);
+	}
 }
 
 static object *
-thread_start_new_thread(self, args)
-	object *self; /* Not used */
+cond_notify(self, args)
+	condobject *self;
 	object *args;
 {
-	object *func, *arg;
-
-	if (!getargs(args, "(OO)", &func, &arg))
+	int n = 1;
+	if (!newgetargs(args, "|i", &n))
 		return NULL;
-	INCREF(args);
-	/* Initialize the interpreter's stack save/restore mechanism */
-	init_save_thread();
-	if (!start_new_thread(t_bootstrap, (void*) args)) {
-		DECREF(args);
-		err_setstr(ThreadError, "can't start new thread\n");
+	if (!cond_locked(self))
 		return NULL;
-	}
-	/* Otherwise the DECREF(args) is done by t_bootstrap */
+	cond_wake(self, n);
 	INCREF(None);
 	return None;
 }
 
 static object *
-thread_exit_thread(self, args)
-	object *self; /* Not used */
+cond_notify_all(self, args)
+	condobject *self;
 	object *args;
 {
 	if (!getnoarg(args))
 		return NULL;
-	err_set(SystemExit);
-	return NULL;
+	if (!cond_locked(self))
+		return NULL;
+	cond_wake(self, 0x7fffffff);
+	INCREF(None);
+	return None;
 }
 
-#ifndef NO_EXIT_PROG
+static void
+cond_dealloc(self)
+	condobject *self;
+{
+	/* Waiters hold a reference, so there are none */
+	while (self->cond_nspare > 0) {
+		type_lock l = self->cond_spare[--self->cond_nspare];
+		release_lock(l);
+		free_lock(l);
+	}
+	DECREF(self->cond_lock);
+	DEL(self);
+}
+
+static struct methodlist cond_methods[] = {
+	{"acquire",		(method)cond_acquire, 1},
+	{"release",		(method)cond_release},
+	{"wait",		(method)cond_wait, 1},
+	{"notify",		(method)cond_notify, 1},
+	{"notify_all",		(method)cond_notify_all},
+	{NULL,			NULL}		/* sentinel */
+};
+
 static object *
-thread_exit_prog(self, args)
-	object *self; /* Not used */
+cond_getattr(self, name)
+	condobject *self;
+	char *name;
+{
+	return findmethod(cond_methods, (object *)self, name);
+}
+
+static typeobject Condtype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"condition",			/*tp_name*/
+	sizeof(condobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)cond_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)cond_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+
+/* Reader-writer lock objects */
+
+typedef struct {
+	OB_HEAD
+	type_rwlock rw_lock;
+} rwlockobject;
+
+staticforward typeobject RWLocktype;
+
+static object *
+rwlock_acquire(self, args, writer)
+	rwlockobject *self;
 	object *args;
+	int writer;
 {
-	int sts;
-	if (!getargs(args, "i", &sts))
+	long usec;
+	int i;
+
+	if ((usec = acquire_args(args)) == -2)
 		return NULL;
-	goaway(sts); /* Calls exit_prog(sts) or _exit_prog(sts) */
-	for (;;) { } /* Should not be reached */
+
+	BGN_SAVE
+	i = acquire_rwlock(self->rw_lock, writer, usec);
+	END_SAVE
+
+	return acquire_result(args, i);
 }
-#endif
 
 static object *
-thread_allocate_lock(self, args)
-	object *self; /* Not used */
+rwlock_acquire_read(self, args)
+	rwlockobject *self;
 	object *args;
 {
-	if (!getnoarg(args))
-		return NULL;
-	return (object *) newlockobject();
+	return rwlock_acquire(self, args, 0);
 }
 
 static object *
-thread_get_ident(self, args)
-	object *self; /* Not used */
+rwlock_acquire_write(self, args)
+	rwlockobject *self;
+	object *args;
+{
+	return rwlock_acquire(self, args, 1);
+}
+
+static object *
+rwlock_release(self, args)
+	rwlockobject *self;
 	object *args;
 {
-	long ident;
 	if (!getnoarg(args))
 		return NULL;
-	ident = get_thread_ident();
-	if (ident == -1) {
-		err_setstr(ThreadError, "no current thread ident");
+	if (!release_rwlock(self->rw_lock)) {
+		err_setstr(ThreadError, "release unlocked lock");
 		return NULL;
 	}
-	return newintobject(ident);
+	INCREF(None);
+	return None;
+}
+
+static void
+rwlock_dealloc(self)
+	rwlockobject *self;
+{
+	free_rwlock(self->rw_lock);
+	DEL(self);
+}
+
+static struct methodlist rwlock_methods[] = {
+	{"acquire_read",	(method)rwlock_acquire_read, 1},
+	{"acquire_write",	(method)rwlock_acquire_write, 1},
+	{"release",		(method)rwlock_release},
+	{NULL,			NULL}		/* sentinel */
+};
+
+static object *
+rwlock_getattr(self, name)
+	rwlockobject *self;
+	char *name;
+{
+	return findmethod(rwlock_methods, (object *)self, name);
+}
+
+static typeobject RWLocktype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"rwlock",			/*tp_name*/
+	sizeof(rwlockobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)rwlock_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)rwlock_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+
+/* Queue objects.
+
+   A bounded queue for passing objects between threads.  The items are
+   kept in a ring of cells, each with a sequence number that says
+   whether it is ready to be filled or emptied for a given position; a
+   thread claims a position by advancing the put or get counter with a
+   compare-and-swap, and needs no lock (this is Dmitry Vyukov's bounded
+   MPMC queue).  Only threads that have to wait for an item or for room
+   use a semaphore: they count themselves in q_getters or q_putters,
+   and whoever makes progress for them claims one of them and raises
+   the semaphore. */
+
+typedef struct {
+	volatile long c_seq;
+	object *c_item;
+} qcell;
+
+typedef struct {
+	OB_HEAD
+	qcell *q_cells;
+	long q_mask;			/* Number of cells - 1 */
+	volatile long q_putpos;		/* Next position to fill */
+	volatile long q_getpos;		/* Next position to empty */
+	volatile long q_getters;	/* Threads waiting for an item */
+	volatile long q_putters;	/* Threads waiting for room */
+	type_sema q_getsema;
+	type_sema q_putsema;
+#ifdef Py_ATOMIC_PLAIN
+	type_lock q_lock;
+#endif
+} queueobject;
+
+staticforward typeobject Queuetype;
+
+/* Without atomic operations, a lock has to stand in for them, since
+   waiting threads use the queue without the interpreter lock */
+#ifdef Py_ATOMIC_PLAIN
+#define QUEUE_LOCK(q)	acquire_lock((q)->q_lock, 1)
+#define QUEUE_UNLOCK(q)	release_lock((q)->q_lock)
+#else
+#define QUEUE_LOCK(q)
+#define QUEUE_UNLOCK(q)
+#endif
+
+/* Put an item in a free cell; return 0 if the queue is full.  The
+   queue takes over the reference. */
+
+static int
+queue_tryput(q, item)
+	queueobject *q;
+	object *item;
+{
+	qcell *c;
+	long pos, dif;
+	QUEUE_LOCK(q);
+	pos = q->q_putpos;
+	for (;;) {
+		c = &q->q_cells[pos & q->q_mask];
+		dif = c->c_seq - pos;
+		Py_MemoryBarrier();
+		if (dif == 0) {
+			if (Py_AtomicCAS(&q->q_putpos, pos, pos + 1))
+				break;
+		}
+		else if (dif < 0) {
+			QUEUE_UNLOCK(q);
+			return 0;
+		}
+		pos = q->q_putpos;
+	}
+	c->c_item = item;
+	Py_MemoryBarrier();
+	c->c_seq = pos + 1;
+	QUEUE_UNLOCK(q);
+	return 1;
+}
+
+/* Take an item out, or return NULL if the queue is empty */
+
+static object *
+queue_tryget(q)
+	queueobject *q;
+{
+	qcell *c;
+	object *item;
+	long pos, dif;
+	QUEUE_LOCK(q);
+	pos = q->q_getpos;
+	for (;;) {
+		c = &q->q_cells[pos & q->q_mask];
+		dif = c->c_seq - (pos + 1);
+		Py_MemoryBarrier();
+		if (dif == 0) {
+			if (Py_AtomicCAS(&q->q_getpos, pos, pos + 1))
+				break;
+		}
+		else if (dif < 0) {
+			QUEUE_UNLOCK(q);
+			return NULL;
+		}
+		pos = q->q_getpos;
+	}
+	item = c->c_item;
+	Py_MemoryBarrier();
+	c->c_seq = pos + q->q_mask + 1;
+	QUEUE_UNLOCK(q);
+	return item;
+}
+
+/* Decrement a waiter count if it's positive; return whether it was */
+
+static int
+claim_waiter(q, p)
+	queueobject *q;
+	volatile long *p;
+{
+	long n;
+	int claimed = 0;
+	QUEUE_LOCK(q);
+	while ((n = *p) > 0) {
+		if (Py_AtomicCAS(p, n, n - 1)) {
+			claimed = 1;
+			break;
+		}
+	}
+	QUEUE_UNLOCK(q);
+	return claimed;
+}
+
+/* Wake a thread waiting on the counter and semaphore, if any */
+
+static void
+wake_waiter(q, p, sema)
+	queueobject *q;
+	volatile long *p;
+	type_sema sema;
+{
+	Py_MemoryBarrier();
+	if (*p > 0 && claim_waiter(q, p))
+		up_sema(sema);
+}
+
+/* The time in microseconds, for waits that may be woken up early */
+
+static double
+now_usec()
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval t;
+#ifdef GETTIMEOFDAY_NO_TZ
+	if (gettimeofday(&t) == 0)
+#else
+	if (gettimeofday(&t, (struct timezone *)NULL) == 0)
+#endif
+		return t.tv_sec * 1e6 + t.tv_usec;
+#endif
+	return time((time_t *)NULL) * 1e6;
+}
+
+static void
+count_waiter(q, p)
+	queueobject *q;
+	volatile long *p;
+{
+	long n;
+	QUEUE_LOCK(q);
+	do {
+		n = *p;
+	} while (!Py_AtomicCAS(p, n, n + 1));
+	QUEUE_UNLOCK(q);
+}
+
+/* Wait until try() succeeds or usec microseconds have passed.  Called
+   without the interpreter lock.  The caller has counted itself as a
+   waiter; it isn't one on return.  Wakeups are anonymous: a thread
+   that finds its waiter count taken by a producer has a wakeup coming
+   and must take it off the semaphore before it leaves. */
+
+static int
+queue_wait(q, usec, p, sema, try, arg)
+	queueobject *q;
+	long usec;
+	volatile long *p;
+	type_sema sema;
+	int (*try) Py_PROTO((queueobject *, object **));
+	object **arg;
+{
+	double deadline = usec < 0 ? 0.0 : now_usec() + usec;
+	int ok;
+	for (;;) {
+		/* Look again now that we're counted, so that a wakeup
+		   can't be missed */
+		if ((ok = (*try)(q, arg)) != 0)
+			break;
+		if (down_sema_timed(sema, usec)) {
+			/* Woken up and no longer counted; somebody else
+			   may have been quicker */
+			if (usec >= 0) {
+				usec = (long)(deadline - now_usec());
+				if (usec <= 0)
+					return (*try)(q, arg);
+			}
+			count_waiter(q, p);
+			continue;
+		}
+		ok = (*try)(q, arg);
+		break;
+	}
+	if (!claim_waiter(q, p)) {
+		down_sema(sema, WAIT_SEMA);
+		if (!ok)
+			ok = (*try)(q, arg);
+	}
+	return ok;
+}
+
+static int
+try_get(q, p_item)
+	queueobject *q;
+	object **p_item;
+{
+	return (*p_item = queue_tryget(q)) != NULL;
+}
+
+static int
+try_put(q, p_item)
+	queueobject *q;
+	object **p_item;
+{
+	return queue_tryput(q, *p_item);
+}
+
+/* Get an item, waiting at most usec microseconds (forever if negative).
+   Return NULL if the timeout expired. */
+
+static object *
+queue_get_item(q, usec)
+	queueobject *q;
+	long usec;
+{
+	object *item;
+	int ok;
+	if ((item = queue_tryget(q)) != NULL) {
+		wake_waiter(q, &q->q_putters, q->q_putsema);
+		return item;
+	}
+	if (usec == 0)
+		return NULL;
+	count_waiter(q, &q->q_getters);
+	BGN_SAVE
+	ok = queue_wait(q, usec, &q->q_getters, q->q_getsema,
+			try_get, &item);
+	END_SAVE
+	if (!ok)
+		return NULL;
+	wake_waiter(q, &q->q_putters, q->q_putsema);
+	return item;
+}
+
+static object *
+queue_put(q, args)
+	queueobject *q;
+	object *args;
+{
+	object *item;
+	double timeout = -1.0;
+	long usec;
+	int ok;
+	if (!newgetargs(args, "O|d", &item, &timeout))
+		return NULL;
+	usec = timeout_usec(timeout);
+	INCREF(item);
+	ok = queue_tryput(q, item);
+	if (!ok && usec != 0) {
+		count_waiter(q, &q->q_putters);
+		BGN_SAVE
+		ok = queue_wait(q, usec, &q->q_putters, q->q_putsema,
+				try_put, &item);
+		END_SAVE
+	}
+	if (!ok) {
+		DECREF(item);
+		err_setstr(ThreadError, "queue is full");
+		return NULL;
+	}
+	wake_waiter(q, &q->q_getters, q->q_getsema);
+	INCREF(None);
+	return None;
+}
+
+static object *
+queue_get(q, args)
+	queueobject *q;
+	object *args;
+{
+	object *item;
+	double timeout = -1.0;
+	if (!newgetargs(args, "|d", &timeout))
+		return NULL;
+	item = queue_get_item(q, timeout_usec(timeout));
+	if (item == NULL)
+		err_setstr(ThreadError, "queue is empty");
+	return item;
+}
+
+static object *
+queue_get_many(q, args)
+	queueobject *q;
+	object *args;
+{
+	object *list, *item;
+	double timeout = -1.0;
+	int i, n;
+	if (!newgetargs(args, "i|d", &n, &timeout))
+		return NULL;
+	if ((list = newlistobject(0)) == NULL)
+		return NULL;
+	if (n <= 0)
+		return list;
+	/* Wait for the first item only */
+	item = queue_get_item(q, timeout_usec(timeout));
+	for (i = 0; item != NULL; ) {
+		if (addlistitem(list, item) < 0) {
+			DECREF(item);
+			DECREF(list);
+			return NULL;
+		}
+		DECREF(item);
+		if (++i >= n)
+			break;
+		if ((item = queue_tryget(q)) != NULL)
+			wake_waiter(q, &q->q_putters, q->q_putsema);
+	}
+	return list;
+}
+
+static object *
+queue_qsize(q, args)
+	queueobject *q;
+	object *args;
+{
+	long n;
+	if (!getnoarg(args))
+		return NULL;
+	n = q->q_putpos - q->q_getpos;
+	return newintobject(n < 0 ? 0 : n);
+}
+
+static void
+queue_dealloc(q)
+	queueobject *q;
+{
+	object *item;
+	if (q->q_cells != NULL) {
+		while ((item = queue_tryget(q)) != NULL)
+			DECREF(item);
+		free((char *)q->q_cells);
+	}
+	if (q->q_getsema != NULL)
+		free_sema(q->q_getsema);
+	if (q->q_putsema != NULL)
+		free_sema(q->q_putsema);
+#ifdef Py_ATOMIC_PLAIN
+	if (q->q_lock != NULL)
+		free_lock(q->q_lock);
+#endif
+	DEL(q);
+}
+
+static struct methodlist queue_methods[] = {
+	{"put",			(method)queue_put, 1},
+	{"get",			(method)queue_get, 1},
+	{"get_many",		(method)queue_get_many, 1},
+	{"qsize",		(method)queue_qsize},
+	{NULL,			NULL}		/* sentinel */
+};
+
+static object *
+queue_getattr(q, name)
+	queueobject *q;
+	char *name;
+{
+	return findmethod(queue_methods, (object *)q, name);
+}
+
+static typeobject Queuetype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"queue",			/*tp_name*/
+	sizeof(queueobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)queue_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)queue_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+
+/* Thread pools.
+
+   A pool has a fixed number of worker threads that take tasks from a
+   queue, so a task doesn't pay for creating a thread and its thread
+   state.  Submitting a task returns a future object, which is itself
+   the queue entry; the worker stores the function's result or
+   exception in it and releases its lock, which callers of result()
+   wait for.
+
+   The queue and the workers belong to a pool state object, which each
+   worker holds a reference to until it exits.  The pool object that
+   is returned to the program only refers to the state, so it can go
+   away while the workers run; that shuts the pool down without
+   waiting, and the last worker to exit frees the state. */
+
+typedef struct futureobject {
+	OB_HEAD
+	struct futureobject *fut_next;	/* Next in the pool's queue */
+	object *fut_func;		/* Cleared when called */
+	object *fut_args;
+	type_lock fut_lock;		/* Locked until done */
+	int fut_done;
+	object *fut_result;		/* If the function returned */
+	object *fut_exc;		/* If it raised an exception */
+	object *fut_val;
+	object *fut_tb;
+} futureobject;
+
+staticforward typeobject Futuretype;
+
+typedef struct {
+	OB_HEAD
+	type_lock pool_mutex;		/* Protects the queue and idents */
+	type_sema pool_work;		/* Tasks queued, and exit requests */
+	type_sema pool_space;		/* Free places; NULL if unbounded */
+	type_sema pool_exited;		/* Workers that have exited */
+	futureobject *pool_head;
+	futureobject *pool_tail;
+	int pool_nthreads;
+	int pool_closed;		/* No more tasks are accepted */
+	int pool_joined;		/* shutdown() has waited */
+	long *pool_idents;		/* Thread idents of the workers */
+	int pool_nidents;		/* Workers that have started */
+} poolstateobject;
+
+staticforward typeobject Poolstatetype;
+
+typedef struct {
+	OB_HEAD
+	poolstateobject *pool_state;
+} poolobject;
+
+staticforward typeobject Pooltype;
+
+static futureobject *
+newfutureobject(func, args)
+	object *func;
+	object *args;
+{
+	futureobject *f;
+	f = NEWOBJ(futureobject, &Futuretype);
+	if (f == NULL)
+		return NULL;
+	f->fut_lock = allocate_lock();
+	if (f->fut_lock == NULL) {
+		DEL(f);
+		err_setstr(ThreadError, "can't allocate lock");
+		return NULL;
+	}
+	acquire_lock(f->fut_lock, WAIT_LOCK);
+	f->fut_next = NULL;
+	INCREF(func);
+	f->fut_func = func;
+	INCREF(args);
+	f->fut_args = args;
+	f->fut_done = 0;
+	f->fut_result = f->fut_exc = f->fut_val = f->fut_tb = NULL;
+	return f;
+}
+
+static void
+future_dealloc(f)
+	futureobject *f;
+{
+	if (!f->fut_done)
+		release_lock(f->fut_lock);
+	free_lock(f->fut_lock);
+	XDECREF(f->fut_func);
+	XDECREF(f->fut_args);
+	XDECREF(f->fut_result);
+	XDECREF(f->fut_exc);
+	XDECREF(f->fut_val);
+	XDECREF(f->fut_tb);
+	DEL(f);
+}
+
+/* Wait until the future is done or the timeout (in seconds, negative
+   for none) has expired.  Return whether it is done. */
+
+static int
+future_wait(f, timeout)
+	futureobject *f;
+	double timeout;
+{
+	int done;
+	if (f->fut_done)
+		return 1;
+	BGN_SAVE
+	done = acquire_lock_timed(f->fut_lock, timeout_usec(timeout));
+	/* Leave it unlocked for other waiters */
+	if (done)
+		release_lock(f->fut_lock);
+	END_SAVE
+	return done;
+}
+
+static object *
+future_done(f, args)
+	futureobject *f;
+	object *args;
+{
+	if (!getnoarg(args))
+		return NULL;
+	return newintobject((long)f->fut_done);
+}
+
+static object *
+future_wait_method(f, args)
+	futureobject *f;
+	object *args;
+{
+	double timeout = -1.0;
+	if (!newgetargs(args, "|d", &timeout))
+		return NULL;
+	return newintobject((long)future_wait(f, timeout));
+}
+
+static object *
+future_result(f, args)
+	futureobject *f;
+	object *args;
+{
+	double timeout = -1.0;
+	if (!newgetargs(args, "|d", &timeout))
+		return NULL;
+	if (!future_wait(f, timeout)) {
+		err_setstr(ThreadError, "timed out");
+		return NULL;
+	}
+	if (f->fut_exc != NULL) {
+		XINCREF(f->fut_exc);
+		XINCREF(f->fut_val);
+		XINCREF(f->fut_tb);
+		err_restore(f->fut_exc, f->fut_val, f->fut_tb);
+		return NULL;
+	}
+	INCREF(f->fut_result);
+	return f->fut_result;
+}
+
+static struct methodlist future_methods[] = {
+	{"done",		(method)future_done},
+	{"wait",		(method)future_wait_method, 1},
+	{"result",		(method)future_result, 1},
+	{NULL,			NULL}		/* sentinel */
+};
+
+static object *
+future_getattr(f, name)
+	futureobject *f;
+	char *name;
+{
+	return findmethod(future_methods, (object *)f, name);
+}
+
+static typeobject Futuretype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"future",			/*tp_name*/
+	sizeof(futureobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)future_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)future_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+/* The worker threads.  Each holds a reference to its pool's state,
+   and keeps its thread state until the pool is shut down. */
+
+static void
+pool_worker(arg)
+	void *arg;
+{
+	poolstateobject *pool = (poolstateobject *) arg;
+	futureobject *f;
+	object *res;
+
+	/* this doesn't need a CRIT section; we just want non-zero */
+	threads_started = 1;
+	PyThreadState_New();
+
+	acquire_lock(pool->pool_mutex, WAIT_LOCK);
+	pool->pool_idents[pool->pool_nidents++] = get_thread_ident();
+	release_lock(pool->pool_mutex);
+
+	for (;;) {
+		down_sema(pool->pool_work, WAIT_SEMA);
+		acquire_lock(pool->pool_mutex, WAIT_LOCK);
+		f = pool->pool_head;
+		if (f != NULL) {
+			pool->pool_head = f->fut_next;
+			if (pool->pool_head == NULL)
+				pool->pool_tail = NULL;
+		}
+		release_lock(pool->pool_mutex);
+		if (f == NULL)
+			break;		/* An exit request */
+		if (pool->pool_space != NULL)
+			up_sema(pool->pool_space);
+
+		restore_thread((void *)NULL);
+		res = call_object(f->fut_func, f->fut_args);
+		if (res == NULL)
+			err_fetch(&f->fut_exc, &f->fut_val, &f->fut_tb);
+		else
+			f->fut_result = res;
+		DECREF(f->fut_func);
+		f->fut_func = NULL;
+		DECREF(f->fut_args);
+		f->fut_args = NULL;
+		f->fut_done = 1;
+		release_lock(f->fut_lock);
+		DECREF(f); /* Matches the INCREF in pool_submit */
+		(void) save_thread();
+	}
+
+	up_sema(pool->pool_exited);
+	restore_thread((void *)NULL);
+	DECREF(pool);
+	(void) save_thread();
+	PyThreadState_Free();
+	exit_thread();
+}
+
+/* Stop accepting tasks, and ask the workers to exit once the queue is
+   empty.  The exit requests are queued behind the tasks, since the
+   workers take them in order. */
+
+static void
+pool_close(pool)
+	poolstateobject *pool;
+{
+	int i;
+	acquire_lock(pool->pool_mutex, WAIT_LOCK);
+	if (pool->pool_closed) {
+		release_lock(pool->pool_mutex);
+		return;
+	}
+	pool->pool_closed = 1;
+	release_lock(pool->pool_mutex);
+	for (i = 0; i < pool->pool_nthreads; i++)
+		up_sema(pool->pool_work);
+}
+
+static object *
+pool_submit(self, args)
+	poolobject *self;
+	object *args;
+{
+	poolstateobject *pool = self->pool_state;
+	object *func, *fargs = NULL;
+	futureobject *f;
+
+	if (!newgetargs(args, "O|O", &func, &fargs))
+		return NULL;
+	if (fargs == NULL)
+		fargs = newtupleobject(0);
+	else if (!is_tupleobject(fargs)) {
+		err_setstr(TypeError, "task arguments must be a tuple");
+		return NULL;
+	}
+	else
+		INCREF(fargs);
+	if (fargs == NULL)
+		return NULL;
+	f = newfutureobject(func, fargs);
+	DECREF(fargs);
+	if (f == NULL)
+		return NULL;
+
+	/* Wait for a free place in a bounded queue */
+	if (pool->pool_space != NULL &&
+	    !down_sema(pool->pool_space, NOWAIT_SEMA)) {
+		BGN_SAVE
+		down_sema(pool->pool_space, WAIT_SEMA);
+		END_SAVE
+	}
+	acquire_lock(pool->pool_mutex, WAIT_LOCK);
+	if (pool->pool_closed) {
+		release_lock(pool->pool_mutex);
+		if (pool->pool_space != NULL)
+			up_sema(pool->pool_space);
+		DECREF(f);
+		err_setstr(ThreadError, "pool has been shut down");
+		return NULL;
+	}
+	INCREF(f); /* The queue's reference, given up by the worker */
+	if (pool->pool_tail == NULL)
+		pool->pool_head = f;
+	else
+		pool->pool_tail->fut_next = f;
+	pool->pool_tail = f;
+	release_lock(pool->pool_mutex);
+	up_sema(pool->pool_work);
+	return (object *)f;
+}
+
+/* Return whether the current thread is one of the pool's workers */
+
+static int
+pool_is_worker(pool)
+	poolstateobject *pool;
+{
+	long ident = get_thread_ident();
+	int i, found = 0;
+	acquire_lock(pool->pool_mutex, WAIT_LOCK);
+	for (i = 0; i < pool->pool_nidents; i++) {
+		if (pool->pool_idents[i] == ident) {
+			found = 1;
+			break;
+		}
+	}
+	release_lock(pool->pool_mutex);
+	return found;
+}
+
+static object *
+pool_shutdown(self, args)
+	poolobject *self;
+	object *args;
+{
+	poolstateobject *pool = self->pool_state;
+	int i, wait = 1;
+	if (!newgetargs(args, "|i", &wait))
+		return NULL;
+	/* The worker would wait for itself to exit */
+	if (wait && !pool->pool_joined && pool_is_worker(pool)) {
+		err_setstr(ThreadError,
+			   "can't wait for a pool from one of its tasks");
+		return NULL;
+	}
+	pool_close(pool);
+	if (wait && !pool->pool_joined) {
+		pool->pool_joined = 1;
+		BGN_SAVE
+		for (i = 0; i < pool->pool_nthreads; i++)
+			down_sema(pool->pool_exited, WAIT_SEMA);
+		END_SAVE
+	}
+	INCREF(None);
+	return None;
+}
+
+static void
+poolstate_dealloc(pool)
+	poolstateobject *pool;
+{
+	/* The workers have exited, or they would hold references */
+	if (pool->pool_mutex != NULL)
+		free_lock(pool->pool_mutex);
+	if (pool->pool_work != NULL)
+		free_sema(pool->pool_work);
+	if (pool->pool_space != NULL)
+		free_sema(pool->pool_space);
+	if (pool->pool_exited != NULL)
+		free_sema(pool->pool_exited);
+	if (pool->pool_idents != NULL)
+		free((char *)pool->pool_idents);
+	DEL(pool);
+}
+
+static typeobject Poolstatetype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"pool state",			/*tp_name*/
+	sizeof(poolstateobject),	/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)poolstate_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	0,				/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+/* A pool that is no longer used is shut down without waiting; the
+   queued tasks are still run */
+
+static void
+pool_dealloc(pool)
+	poolobject *pool;
+{
+	pool_close(pool->pool_state);
+	DECREF(pool->pool_state);
+	DEL(pool);
+}
+
+static struct methodlist pool_methods[] = {
+	{"submit",		(method)pool_submit, 1},
+	{"shutdown",		(method)pool_shutdown, 1},
+	{NULL,			NULL}		/* sentinel */
+};
+
+static object *
+pool_getattr(pool, name)
+	poolobject *pool;
+	char *name;
+{
+	return findmethod(pool_methods, (object *)pool, name);
+}
+
+static typeobject Pooltype = {
+	OB_HEAD_INIT(&Typetype)
+	0,				/*ob_size*/
+	"pool",				/*tp_name*/
+	sizeof(poolobject),		/*tp_size*/
+	0,				/*tp_itemsize*/
+	/* methods */
+	(destructor)pool_dealloc,	/*tp_dealloc*/
+	0,				/*tp_print*/
+	(getattrfunc)pool_getattr,	/*tp_getattr*/
+	0,				/*tp_setattr*/
+	0,				/*tp_compare*/
+	0,				/*tp_repr*/
+};
+
+
+/* Module functions */
+
+static void
+t_bootstrap(args_raw)
+	void *args_raw;
+{
+	object *args = (object *) args_raw;
+	object *func, *arg, *res;
+
+	/* this doesn't need a CRIT section; we just want non-zero */
+	threads_started = 1;
+	PyThreadState_New();
+
+	restore_thread((void *)NULL);
+	func = gettupleitem(args, 0);
+	arg = gettupleitem(args, 1);
+	res = call_object(func, arg);
+	DECREF(args); /* Matches the INCREF(args) in thread_start_new_thread */
+	if (res == NULL) {
+		if (err_occurred() == SystemExit)
+			err_clear();
+		else {
+			fprintf(stderr, "Unhandled exception in thread:\n");
+			print_error(); /* From pythonmain.c */
+		}
+	}
+	else
+		DECREF(res);
+	(void) save_thread(); /* Should always be NULL */
+	PyThreadState_Free();
+	exit_thread();
+}
+
+static object *
+thread_start_new_thread(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	object *func, *arg;
+
+	if (!getargs(args, "(OO)", &func, &arg))
+		return NULL;
+	INCREF(args);
+	/* Initialize the interpreter's stack save/restore mechanism */
+	init_save_thread();
+	if (!start_new_thread(t_bootstrap, (void*) args)) {
+		DECREF(args);
+		err_setstr(ThreadError, "can't start new thread\n");
+		return NULL;
+	}
+	/* Otherwise the DECREF(args) is done by t_bootstrap */
+	INCREF(None);
+	return None;
+}
+
+static object *
+thread_exit_thread(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	if (!getnoarg(args))
+		return NULL;
+	err_set(SystemExit);
+	return NULL;
+}
+
+#ifndef NO_EXIT_PROG
+static object *
+thread_exit_prog(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	int sts;
+	if (!getargs(args, "i", &sts))
+		return NULL;
+	goaway(sts); /* Calls exit_prog(sts) or _exit_prog(sts) */
+	for (;;) { } /* Should not be reached */
+}
+#endif
+
+static object *
+thread_allocate_lock(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	if (!getnoarg(args))
+		return NULL;
+	return (object *) newlockobject();
+}
+
+static object *
+thread_allocate_semaphore(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	semaobject *sema;
+	int value = 1;
+	if (!newgetargs(args, "|i", &value))
+		return NULL;
+	if (value < 0) {
+		err_setstr(ValueError, "semaphore value must be >= 0");
+		return NULL;
+	}
+	sema = NEWOBJ(semaobject, &Sematype);
+	if (sema == NULL)
+		return NULL;
+	sema->sema_sema = allocate_sema(value);
+	if (sema->sema_sema == NULL) {
+		DEL(sema);
+		err_setstr(ThreadError, "can't allocate semaphore");
+		return NULL;
+	}
+	return (object *)sema;
+}
+
+static object *
+thread_allocate_condition(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	condobject *cond;
+	object *lock = NULL;
+	if (!newgetargs(args, "|O", &lock))
+		return NULL;
+	if (lock == NULL) {
+		lock = (object *) newlockobject();
+		if (lock == NULL)
+			return NULL;
+	}
+	else if (!is_lockobject(lock)) {
+		err_setstr(TypeError, "condition requires a lock object");
+		return NULL;
+	}
+	else
+		INCREF(lock);
+	cond = NEWOBJ(condobject, &Condtype);
+	if (cond == NULL) {
+		DECREF(lock);
+		return NULL;
+	}
+	cond->cond_lock = (lockobject *) lock;
+	cond->cond_head = cond->cond_tail = NULL;
+	cond->cond_nspare = 0;
+	return (object *)cond;
+}
+
+static object *
+thread_allocate_rwlock(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	rwlockobject *rw;
+	if (!getnoarg(args))
+		return NULL;
+	rw = NEWOBJ(rwlockobject, &RWLocktype);
+	if (rw == NULL)
+		return NULL;
+	rw->rw_lock = allocate_rwlock();
+	if (rw->rw_lock == NULL) {
+		DEL(rw);
+		err_setstr(ThreadError, "can't allocate lock");
+		return NULL;
+	}
+	return (object *)rw;
+}
+
+static object *
+thread_allocate_queue(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	queueobject *q;
+	long i, size;
+	int maxsize;
+	if (!newgetargs(args, "i", &maxsize))
+		return NULL;
+	if (maxsize < 1 || maxsize > 0x10000000) {
+		err_setstr(ValueError, "queue size out of range");
+		return NULL;
+	}
+	/* The ring is a power of 2 cells, at least maxsize */
+	for (size = 2; size < maxsize; size <<= 1)
+		;
+	q = NEWOBJ(queueobject, &Queuetype);
+	if (q == NULL)
+		return NULL;
+	q->q_cells = NULL;
+	q->q_getsema = allocate_sema(0);
+	q->q_putsema = allocate_sema(0);
+#ifdef Py_ATOMIC_PLAIN
+	q->q_lock = allocate_lock();
+	if (q->q_lock == NULL) {
+		DECREF(q);
+		return err_nomem();
+	}
+#endif
+	if (q->q_getsema == NULL || q->q_putsema == NULL ||
+	    (q->q_cells = (qcell *) malloc(size * sizeof(qcell))) == NULL) {
+		DECREF(q);
+		return err_nomem();
+	}
+	for (i = 0; i < size; i++) {
+		q->q_cells[i].c_seq = i;
+		q->q_cells[i].c_item = NULL;
+	}
+	q->q_mask = size - 1;
+	q->q_putpos = q->q_getpos = 0;
+	q->q_getters = q->q_putters = 0;
+	return (object *)q;
+}
+
+static int
+add_stats(d, name, stats)
+	object *d;
+	char *name;
+	long *stats;
+{
+	object *v;
+	int err;
+	v = mkvalue("(lll)", stats[0], stats[1], stats[2]);
+	if (v == NULL)
+		return -1;
+	err = dictinsert(d, name, v);
+	DECREF(v);
+	return err;
+}
+
+static object *
+thread_lock_stats(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	object *d;
+	long stats[3];
+#ifdef WITH_FREE_THREAD
+	struct _Py_NamedMutex *nm;
+#endif
+	if (!getnoarg(args))
+		return NULL;
+	if ((d = newdictobject()) == NULL)
+		return NULL;
+	if (interpreter_lock_stats(stats) &&
+	    add_stats(d, "interpreter", stats) < 0) {
+		DECREF(d);
+		return NULL;
+	}
+#ifdef WITH_FREE_THREAD
+	for (nm = _Py_NamedMutexes; nm->name != NULL; nm++) {
+		if (PyMutex_Stats(*nm->mutex, stats) &&
+		    add_stats(d, nm->name, stats) < 0) {
+			DECREF(d);
+			return NULL;
+		}
+	}
+#endif
+	return d;
+}
+
+static object *
+thread_get_ident(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	long ident;
+	if (!getnoarg(args))
+		return NULL;
+	ident = get_thread_ident();
+	if (ident == -1) {
+		err_setstr(ThreadError, "no current thread ident");
+		return NULL;
+	}
+	return newintobject(ident);
+}
+
+static object *
+thread_pool(self, args)
+	object *self; /* Not used */
+	object *args;
+{
+	poolobject *p;
+	poolstateobject *pool;
+	int i, nthreads, maxqueue = 0;
+
+	if (!newgetargs(args, "i|i", &nthreads, &maxqueue))
+		return NULL;
+	if (nthreads < 1 || maxqueue < 0) {
+		err_setstr(ValueError, "pool needs at least one thread");
+		return NULL;
+	}
+	pool = NEWOBJ(poolstateobject, &Poolstatetype);
+	if (pool == NULL)
+		return NULL;
+	pool->pool_mutex = allocate_lock();
+	pool->pool_work = allocate_sema(0);
+	pool->pool_space = maxqueue > 0 ? allocate_sema(maxqueue) : NULL;
+	pool->pool_exited = allocate_sema(0);
+	pool->pool_head = pool->pool_tail = NULL;
+	pool->pool_nthreads = 0;
+	pool->pool_closed = pool->pool_joined = 0;
+	pool->pool_idents = (long *) malloc(nthreads * sizeof(long));
+	pool->pool_nidents = 0;
+	if (pool->pool_mutex == NULL || pool->pool_work == NULL ||
+	    (maxqueue > 0 && pool->pool_space == NULL) ||
+	    pool->pool_exited == NULL || pool->pool_idents == NULL) {
+		DECREF(pool);
+		err_setstr(ThreadError, "can't allocate pool");
+		return NULL;
+	}
+	p = NEWOBJ(poolobject, &Pooltype);
+	if (p == NULL) {
+		DECREF(pool);
+		return NULL;
+	}
+	p->pool_state = pool; /* Gives up the reference */
+	/* Initialize the interpreter's stack save/restore mechanism */
+	init_save_thread();
+	for (i = 0; i < nthreads; i++) {
+		INCREF(pool); /* Given up by the worker when it exits */
+		if (!start_new_thread(pool_worker, (void *) pool)) {
+			DECREF(pool);
+			DECREF(p); /* Closes the pool */
+			err_setstr(ThreadError, "can't start new thread\n");
+			return NULL;
+		}
+		pool->pool_nthreads++;
+	}
+	return (object *)p;
 }
 
 static struct methodlist thread_methods[] = {
@@ -302,9 +1796,15 @@ static struct methodlist thread_methods[] = {
 	{"start_new",		(method)thread_start_new_thread},
 	{"allocate_lock",	(method)thread_allocate_lock},
 	{"allocate",		(method)thread_allocate_lock},
+	{"allocate_semaphore",	(method)thread_allocate_semaphore, 1},
+	{"allocate_condition",	(method)thread_allocate_condition, 1},
+	{"allocate_rwlock",	(method)thread_allocate_rwlock},
+	{"allocate_queue",	(method)thread_allocate_queue, 1},
+	{"lock_stats",		(method)thread_lock_stats},
 	{"exit_thread",		(method)thread_exit_thread},
 	{"exit",		(method)thread_exit_thread},
 	{"get_ident",		(method)thread_get_ident},
+	{"pool",		(method)thread_pool, 1},
 #ifndef NO_EXIT_PROG
 	{"exit_prog",		(method)thread_exit_prog},
 #endif
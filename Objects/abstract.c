@@ -180,6 +180,46 @@ PyObject_DelItem(o, key)
   return -1;
 }
 
+int
+PyObject_AsReadBuffer(o, buffer)
+  PyObject *o;
+  void **buffer;
+{
+  PyBufferProcs *pb;
+
+  if(! o || ! buffer) return Py_ReturnNullError(),-1;
+  if((pb=o->ob_type->tp_as_buffer) && pb->bf_getreadbuffer)
+    return pb->bf_getreadbuffer(o,buffer);
+
+  PyErr_SetString(PyExc_TypeError,"expected a buffer object");
+  return -1;
+}
+
+int
+PyObject_AsWriteBuffer(o, buffer)
+  PyObject *o;
+  void **buffer;
+{
+  PyBufferProcs *pb;
+
+  if(! o || ! buffer) return Py_ReturnNullError(),-1;
+  if((pb=o->ob_type->tp_as_buffer) && pb->bf_getwritebuffer)
+    return pb->bf_getwritebuffer(o,buffer);
+
+  PyErr_SetString(PyExc_TypeError,"expected a writable buffer object");
+  return -1;
+}
+
+void
+PyObject_ReleaseBuffer(o)
+  PyObject *o;
+{
+  PyBufferProcs *pb = o->ob_type->tp_as_buffer;
+
+  if(pb->bf_releasebuffer)
+    pb->bf_releasebuffer(o);
+}
+
 int 
 PyNumber_Check(o)
   PyObject *o;
@@ -47,6 +47,24 @@ PERFORMANCE OF THIS SOFTWARE.
 #define BUF(v) GETSTRINGVALUE((stringobject *)v)
 
 #include <errno.h>
+#include <limits.h>
+
+#ifndef macintosh
+#include <sys/types.h>
+#include <sys/stat.h>
+#define USE_FSTAT
+#endif
+
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#ifndef IOV_MAX
+#ifdef UIO_MAXIOV
+#define IOV_MAX UIO_MAXIOV
+#else
+#define IOV_MAX 16
+#endif
+#endif
+#endif
 
 typedef struct {
 	OB_HEAD
@@ -55,6 +73,7 @@ typedef struct {
 	object *f_mode;
 	int (*f_close) PROTO((FILE *));
 	int f_softspace; /* Flag used by 'print' command */
+	int f_bufsize; /* As given to setfilebufsize(), -1 if not called */
 } fileobject;
 
 FILE *
@@ -92,6 +111,7 @@ newopenfileobject(fp, name, mode, close)
 	f->f_mode = newstringobject(mode);
 	f->f_close = close;
 	f->f_softspace = 0;
+	f->f_bufsize = -1;
 	if (f->f_name == NULL || f->f_mode == NULL) {
 		DECREF(f);
 		return NULL;
@@ -144,6 +164,7 @@ setfilebufsize(f, bufsize)
 	if (bufsize >= 0) {
 #ifdef HAVE_SETVBUF
 		int type;
+		((fileobject *)f)->f_bufsize = bufsize;
 		switch (bufsize) {
 		case 0:
 			type = _IONBF;
@@ -372,6 +393,34 @@ file_isatty(f, args)
 	return newintobject(res);
 }
 
+/* Return the buffer size to use for reading the rest of a file when
+   currentsize bytes didn't suffice.  For a regular file this is what
+   is left of it according to fstat(), plus one byte so that reaching
+   EOF doesn't require another resize; so the whole file is normally
+   read into a single allocation.  Otherwise the buffer is doubled. */
+
+static int
+new_buffersize(f, currentsize)
+	fileobject *f;
+	int currentsize;
+{
+#ifdef USE_FSTAT
+	struct stat st;
+	long pos;
+
+	if (fstat(fileno(f->f_fp), &st) == 0 &&
+	    (st.st_mode & S_IFMT) == S_IFREG &&
+	    (pos = ftell(f->f_fp)) >= 0 && st.st_size > pos &&
+	    st.st_size - pos < INT_MAX - currentsize)
+		return currentsize + (int)(st.st_size - pos) + 1;
+#endif
+	if (currentsize < BUFSIZ)
+		return currentsize + BUFSIZ;
+	if (currentsize > INT_MAX/2)
+		return INT_MAX;
+	return currentsize + currentsize;
+}
+
 static object *
 file_read(f, args)
 	fileobject *f;
@@ -388,7 +437,7 @@ file_read(f, args)
 		if (!getargs(args, "i", &n))
 			return NULL;
 	}
-	n2 = n >= 0 ? n : BUFSIZ;
+	n2 = n >= 0 ? n : new_buffersize(f, 0);
 	v = newsizedstringobject((char *)NULL, n2);
 	if (v == NULL)
 		return NULL;
@@ -400,15 +449,15 @@ file_read(f, args)
 		if (n3 == 0)
 			break;
 		n1 += n3;
-		if (n1 == n)
+		if (n1 < n2)
+			continue;
+		if (n >= 0 || n2 == INT_MAX)
 			break;
-		if (n < 0) {
-			n2 = n1 + BUFSIZ;
-			RET_SAVE
-			if (resizestring(&v, n2) < 0)
-				return NULL;
-			RES_SAVE
-		}
+		n2 = new_buffersize(f, n2);
+		RET_SAVE
+		if (resizestring(&v, n2) < 0)
+			return NULL;
+		RES_SAVE
 	}
 	END_SAVE
 	if (n1 != n2)
@@ -421,6 +470,16 @@ file_read(f, args)
    > 0: max length;
    = 0: read arbitrary line;
    < 0: strip trailing '\n', raise EOFError if EOF reached immediately
+
+   The line is read with fgets(), straight into the string object, so
+   stdio can scan its buffer for the newline instead of this looping
+   over getc().  fgets() doesn't say how much it read, which matters
+   if the line contains null bytes; so the free part of the buffer is
+   first filled with newlines.  The first newline in the buffer is
+   then either the end of the line, if fgets() put a null byte after
+   it, or one of ours, in which case the line ended at EOF just before
+   it (the null byte fgets() wrote is in front of it).  If there is no
+   newline at all, fgets() filled the buffer and the line goes on.
 */
 
 static object *
@@ -428,9 +487,8 @@ getline(f, n)
 	fileobject *f;
 	int n;
 {
-	register FILE *fp;
-	register int c;
-	register char *buf, *end;
+	FILE *fp;
+	char *buf, *end, *p;
 	int n1, n2;
 	object *v;
 
@@ -439,19 +497,22 @@ getline(f, n)
 	v = newsizedstringobject((char *)NULL, n2);
 	if (v == NULL)
 		return NULL;
-	buf = BUF(v);
-	end = buf + n2;
+	n1 = 0; /* Number of bytes read so far */
 
 	BGN_SAVE
 	for (;;) {
-		if ((c = getc(fp)) == EOF) {
+		/* A string object has room for n2 bytes and a null byte */
+		buf = BUF(v) + n1;
+		end = BUF(v) + n2 + 1;
+		memset(buf, '\n', end - buf);
+		if (fgets(buf, end - buf, fp) == NULL) {
 			clearerr(fp);
 			if (sigcheck()) {
 				RET_SAVE
 				DECREF(v);
 				return NULL;
 			}
-			if (n < 0 && buf == BUF(v)) {
+			if (n < 0 && n1 == 0) {
 				RET_SAVE
 				DECREF(v);
 				err_setstr(EOFError,
@@ -460,27 +521,33 @@ getline(f, n)
 			}
 			break;
 		}
-		if ((*buf++ = c) == '\n') {
-			if (n < 0)
-				buf--;
+		p = memchr(buf, '\n', end - buf);
+		if (p != NULL) {
+			if (p+1 < end && p[1] == '\0')
+				n1 = p+1 - BUF(v);
+			else
+				n1 = p-1 - BUF(v);
 			break;
 		}
-		if (buf == end) {
-			if (n > 0)
-				break;
-			n1 = n2;
-			n2 += 1000;
+		n1 = n2;
+		if (n > 0)
+			break;
+		if (n2 > INT_MAX/2) {
 			RET_SAVE
-			if (resizestring(&v, n2) < 0)
-				return NULL;
-			RES_SAVE
-			buf = BUF(v) + n1;
-			end = BUF(v) + n2;
+			DECREF(v);
+			err_setstr(OverflowError, "line too long");
+			return NULL;
 		}
+		n2 += n2;
+		RET_SAVE
+		if (resizestring(&v, n2) < 0)
+			return NULL;
+		RES_SAVE
 	}
 	END_SAVE
 
-	n1 = buf - BUF(v);
+	if (n < 0 && n1 > 0 && BUF(v)[n1-1] == '\n')
+		n1--;
 	if (n1 != n2)
 		resizestring(&v, n1);
 	return v;
@@ -573,36 +640,263 @@ file_readline(f, args)
 	return getline(f, n);
 }
 
+/* Read lines in blocks of READLINES_CHUNK bytes (or more, for very long
+   lines) with fread(), split them with memchr() and append them to a
+   list, until EOF or until at least sizehint bytes have been read
+   (if sizehint > 0).  The block buffer is passed in so that it can be
+   kept between calls; it is allocated or grown as needed.  Return the
+   number of bytes read, or -1 with an exception set. */
+
+#define READLINES_CHUNK 8192
+
+static long
+getlines(f, list, sizehint, p_buf, p_bufsize)
+	fileobject *f;
+	object *list;
+	long sizehint;
+	char **p_buf;
+	int *p_bufsize;
+{
+	char *buf = *p_buf;
+	int bufsize = *p_bufsize;
+	char *p, *q, *end;
+	int nkept = 0; /* Bytes of an incomplete line at the start of buf */
+	int nread;
+	long total = 0;
+	object *line, *rest;
+
+	for (;;) {
+		if (buf == NULL || nkept == bufsize) {
+			/* No buffer yet, or a line that doesn't fit */
+			if (bufsize > INT_MAX/2) {
+				err_setstr(OverflowError, "line too long");
+				goto error;
+			}
+			bufsize = bufsize == 0 ? READLINES_CHUNK : 2*bufsize;
+			p = buf == NULL ? malloc(bufsize) : realloc(buf, bufsize);
+			if (p == NULL) {
+				err_nomem();
+				goto error;
+			}
+			buf = p;
+		}
+		BGN_SAVE
+		errno = 0;
+		nread = fread(buf + nkept, 1, bufsize - nkept, f->f_fp);
+		END_SAVE
+		if (nread == 0) {
+			if (ferror(f->f_fp)) {
+				err_errno(IOError);
+				clearerr(f->f_fp);
+				goto error;
+			}
+			clearerr(f->f_fp);
+			break;
+		}
+		total += nread;
+		q = buf;
+		end = buf + nkept + nread;
+		while ((p = memchr(q, '\n', end - q)) != NULL) {
+			p++;
+			line = newsizedstringobject(q, (int)(p - q));
+			if (line == NULL || addlistitem(list, line) != 0) {
+				XDECREF(line);
+				goto error;
+			}
+			DECREF(line);
+			q = p;
+		}
+		nkept = end - q;
+		if (nkept > 0 && q != buf)
+			memmove(buf, q, nkept);
+		if (sizehint > 0 && total >= sizehint)
+			break;
+	}
+	if (nkept > 0) {
+		/* The last line ends at EOF, or past sizehint: read the
+		   rest of it (if any) the normal way */
+		line = newsizedstringobject(buf, nkept);
+		if (line == NULL)
+			goto error;
+		if (sizehint > 0 && total >= sizehint) {
+			rest = getline(f, 0);
+			if (rest == NULL) {
+				DECREF(line);
+				goto error;
+			}
+			total += getstringsize(rest);
+			joinstring_decref(&line, rest);
+			if (line == NULL)
+				goto error;
+		}
+		if (addlistitem(list, line) != 0) {
+			DECREF(line);
+			goto error;
+		}
+		DECREF(line);
+	}
+	*p_buf = buf;
+	*p_bufsize = bufsize;
+	return total;
+
+  error:
+	*p_buf = buf;
+	*p_bufsize = bufsize;
+	return -1;
+}
+
 static object *
 file_readlines(f, args)
 	fileobject *f;
 	object *args;
 {
+	long sizehint = 0;
 	object *list;
-	object *line;
+	char *buf = NULL;
+	int bufsize = 0;
+	long n;
 
 	if (f->f_fp == NULL)
 		return err_closed();
-	if (!getnoarg(args))
+	if (args != NULL && !getargs(args, "l", &sizehint))
 		return NULL;
 	if ((list = newlistobject(0)) == NULL)
 		return NULL;
-	for (;;) {
-		line = getline(f, 0);
-		if (line != NULL && getstringsize(line) == 0) {
-			DECREF(line);
-			break;
+	n = getlines(f, list, sizehint, &buf, &bufsize);
+	if (buf != NULL)
+		free(buf);
+	if (n < 0) {
+		DECREF(list);
+		return NULL;
+	}
+	return list;
+}
+
+/* Line iterator, returned by f.xreadlines(): a sequence that can only
+   be indexed in order, as by a for loop, and that reads the file a
+   block at a time into the same buffer:
+
+	for line in f.xreadlines(): ...
+
+   does what "for line in f.readlines()" does without holding all of
+   the file's lines in memory. */
+
+typedef struct {
+	OB_HEAD
+	fileobject *x_file;
+	object *x_lines;	/* Lines of the current block */
+	int x_next;		/* Index of the next line in x_lines */
+	int x_index;		/* Sequence index of the next line */
+	char *x_buf;		/* Block buffer, kept between blocks */
+	int x_bufsize;
+} xreadlinesobject;
+
+staticforward typeobject XReadlinestype;
+
+static object *
+file_xreadlines(f, args)
+	fileobject *f;
+	object *args;
+{
+	xreadlinesobject *x;
+
+	if (f->f_fp == NULL)
+		return err_closed();
+	if (!getnoarg(args))
+		return NULL;
+	x = NEWOBJ(xreadlinesobject, &XReadlinestype);
+	if (x == NULL)
+		return NULL;
+	INCREF(f);
+	x->x_file = f;
+	x->x_lines = NULL;
+	x->x_next = 0;
+	x->x_index = 0;
+	x->x_buf = NULL;
+	x->x_bufsize = 0;
+	return (object *)x;
+}
+
+static void
+xreadlines_dealloc(x)
+	xreadlinesobject *x;
+{
+	DECREF(x->x_file);
+	XDECREF(x->x_lines);
+	if (x->x_buf != NULL)
+		free(x->x_buf);
+	DEL(x);
+}
+
+static int
+xreadlines_length(x)
+	xreadlinesobject *x;
+{
+	err_setstr(TypeError, "len() of xreadlines object");
+	return -1;
+}
+
+static object *
+xreadlines_item(x, i)
+	xreadlinesobject *x;
+	int i;
+{
+	object *line;
+
+	if (i != x->x_index) {
+		err_setstr(RuntimeError,
+			   "xreadlines object accessed out of order");
+		return NULL;
+	}
+	if (x->x_lines == NULL || x->x_next >= getlistsize(x->x_lines)) {
+		XDECREF(x->x_lines);
+		x->x_next = 0;
+		if (x->x_file->f_fp == NULL) {
+			x->x_lines = NULL;
+			return err_closed();
 		}
-		if (line == NULL || addlistitem(list, line) != 0) {
-			DECREF(list);
-			XDECREF(line);
+		if ((x->x_lines = newlistobject(0)) == NULL)
+			return NULL;
+		if (getlines(x->x_file, x->x_lines, (long)READLINES_CHUNK,
+			     &x->x_buf, &x->x_bufsize) < 0)
+			return NULL;
+		if (getlistsize(x->x_lines) == 0) {
+			err_setstr(IndexError, "end of file");
 			return NULL;
 		}
-		DECREF(line);
 	}
-	return list;
+	line = getlistitem(x->x_lines, x->x_next++);
+	x->x_index++;
+	INCREF(line);
+	return line;
 }
 
+static sequence_methods xreadlines_as_sequence = {
+	(inquiry)xreadlines_length, /*sq_length*/
+	0,		/*sq_concat*/
+	0,		/*sq_repeat*/
+	(intargfunc)xreadlines_item, /*sq_item*/
+	0,		/*sq_slice*/
+	0,		/*sq_ass_item*/
+	0,		/*sq_ass_slice*/
+};
+
+statichere typeobject XReadlinestype = {
+	OB_HEAD_INIT(&Typetype)
+	0,
+	"xreadlines",
+	sizeof(xreadlinesobject),
+	0,
+	(destructor)xreadlines_dealloc, /*tp_dealloc*/
+	0,		/*tp_print*/
+	0,		/*tp_getattr*/
+	0,		/*tp_setattr*/
+	0,		/*tp_compare*/
+	0,		/*tp_repr*/
+	0,		/*tp_as_number*/
+	&xreadlines_as_sequence, /*tp_as_sequence*/
+};
+
 static object *
 file_write(f, args)
 	fileobject *f;
@@ -628,6 +922,84 @@ file_write(f, args)
 	return None;
 }
 
+#ifdef HAVE_WRITEV
+
+/* Write all of n buffers to fd, in calls of at most IOV_MAX buffers.
+   After a partial write the buffers are advanced past what was written
+   and the rest is written by the next call.  The iovec array is
+   changed.  Return 0, or -1 with errno set. */
+
+static int
+writev_all(fd, iov, n)
+	int fd;
+	struct iovec *iov;
+	int n;
+{
+	int k;
+
+	while (n > 0) {
+		k = writev(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+		if (k < 0)
+			return -1;
+		while (n > 0 && k >= (int)iov->iov_len) {
+			k -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (k > 0) {
+			iov->iov_base = (char *)iov->iov_base + k;
+			iov->iov_len -= k;
+		}
+	}
+	return 0;
+}
+
+/* Write a list of strings with writev(), bypassing the stdio buffer
+   after flushing what it holds, so the output stays in order. */
+
+static object *
+file_writev(f, args)
+	fileobject *f;
+	object *args;
+{
+	object *lines;
+	struct iovec *iov;
+	int i, n, res;
+
+	/* Keep the strings alive while other threads run */
+	lines = getlistslice(args, 0, getlistsize(args));
+	if (lines == NULL)
+		return NULL;
+	n = getlistsize(lines);
+	iov = NEW(struct iovec, n);
+	if (iov == NULL) {
+		DECREF(lines);
+		return err_nomem();
+	}
+	for (i = 0; i < n; i++) {
+		object *line = getlistitem(lines, i);
+		iov[i].iov_base = getstringvalue(line);
+		iov[i].iov_len = getstringsize(line);
+	}
+	BGN_SAVE
+	errno = 0;
+	res = fflush(f->f_fp);
+	if (res == 0)
+		res = writev_all(fileno(f->f_fp), iov, n);
+	END_SAVE
+	DEL(iov);
+	DECREF(lines);
+	if (res != 0) {
+		err_errno(IOError);
+		clearerr(f->f_fp);
+		return NULL;
+	}
+	INCREF(None);
+	return None;
+}
+
+#endif /* HAVE_WRITEV */
+
 static object *
 file_writelines(f, args)
 	fileobject *f;
@@ -643,6 +1015,23 @@ file_writelines(f, args)
 	}
 	n = getlistsize(args);
 	f->f_softspace = 0;
+#ifdef HAVE_WRITEV
+	/* Gather the strings into one system call when stdio would
+	   make several: the file is unbuffered or line buffered, or
+	   there is more data than fits in a default buffer. */
+	if (n > 1) {
+		long total = 0;
+		for (i = 0; i < n; i++) {
+			object *line = getlistitem(args, i);
+			if (!is_stringobject(line))
+				break;
+			total += getstringsize(line);
+		}
+		if (i == n && (f->f_bufsize == 0 || f->f_bufsize == 1 ||
+			       total >= BUFSIZ))
+			return file_writev(f, args);
+	}
+#endif
 	BGN_SAVE
 	errno = 0;
 	for (i = 0; i < n; i++) {
@@ -684,6 +1073,7 @@ static struct methodlist file_methods[] = {
 	{"tell",	(method)file_tell, 0},
 	{"write",	(method)file_write, 0},
 	{"writelines",	(method)file_writelines, 0},
+	{"xreadlines",	(method)file_xreadlines, 0},
 	{NULL,		NULL}		/* sentinel */
 };
 
@@ -36,6 +36,7 @@ PERFORMANCE OF THIS SOFTWARE.
 
 #include "allobjects.h"
 #include "modsupport.h"
+#include "threadstate.h"
 
 #include <errno.h>
 #include <ctype.h>
@@ -85,6 +86,65 @@ extern double fmod PROTO((double, double));
 extern double pow PROTO((double, double));
 #endif
 
+/* Floats get the same treatment as integers (see intobject.c): they
+   are allocated from blocks of BLOCK_SIZE bytes and deallocated onto a
+   free list instead of going through malloc() and free() each time.
+   When free threading, each thread has its own free list in its
+   thread state, so no lock is needed on the fast path; the lists of
+   threads that go away are kept in orphan_list for others to reuse. */
+
+#define BLOCK_SIZE	1000	/* 1K less typical malloc overhead */
+#define N_FLOATOBJECTS	(BLOCK_SIZE / sizeof(floatobject))
+
+#ifdef WITH_FREE_THREAD
+static floatobject *orphan_list = NULL;
+#else
+static floatobject *free_list = NULL;
+#endif
+
+static floatobject *
+fill_free_list()
+{
+	floatobject *p, *q;
+#ifdef WITH_FREE_THREAD
+	Py_SUBSYS_LOCK(_Py_FloatMutex);
+	p = orphan_list;
+	orphan_list = NULL;
+	Py_SUBSYS_UNLOCK(_Py_FloatMutex);
+	if (p != NULL)
+		return p;
+#endif
+	p = NEW(floatobject, N_FLOATOBJECTS);
+	if (p == NULL)
+		return NULL;	/* NOTE: LET CALLER RAISE ERROR */
+	q = p + N_FLOATOBJECTS;
+	while (--q > p)
+		*(floatobject **)q = q-1;
+	*(floatobject **)q = NULL;
+	return p + N_FLOATOBJECTS - 1;
+}
+
+#ifdef WITH_FREE_THREAD
+/* Called when a thread state is freed: hand its free list over to
+   orphan_list */
+void
+_PyFloat_ReleaseFreeList(plist)
+	object **plist;
+{
+	floatobject *p = (floatobject *) *plist;
+	floatobject *q;
+	*plist = NULL;
+	if (p == NULL)
+		return;
+	for (q = p; *(floatobject **)q != NULL; q = *(floatobject **)q)
+		;
+	Py_SUBSYS_LOCK(_Py_FloatMutex);
+	*(floatobject **)q = orphan_list;
+	orphan_list = p;
+	Py_SUBSYS_UNLOCK(_Py_FloatMutex);
+}
+#endif
+
 object *
 #ifdef __SC__
 newfloatobject(double fval)
@@ -93,10 +153,21 @@ newfloatobject(fval)
 	double fval;
 #endif
 {
-	/* For efficiency, this code is copied from newobject() */
-	register floatobject *op = (floatobject *) malloc(sizeof(floatobject));
-	if (op == NULL)
+	register floatobject *op;
+#ifdef WITH_FREE_THREAD
+	PyThreadState *pts = PyThreadState_Get();
+	op = (floatobject *) pts->float_free_list;
+	if (op == NULL && (op = fill_free_list()) == NULL)
 		return err_nomem();
+	pts->float_free_list = (object *) *(floatobject **)op;
+#else
+	if (free_list == NULL) {
+		if ((free_list = fill_free_list()) == NULL)
+			return err_nomem();
+	}
+	op = free_list;
+	free_list = *(floatobject **)op;
+#endif
 	op->ob_type = &Floattype;
 	op->ob_fval = fval;
 	NEWREF(op);
@@ -107,7 +178,14 @@ static void
 float_dealloc(op)
 	object *op;
 {
-	DEL(op);
+#ifdef WITH_FREE_THREAD
+	PyThreadState *pts = PyThreadState_Get();
+	*(object **)op = pts->float_free_list;
+	pts->float_free_list = op;
+#else
+	*(floatobject **)op = free_list;
+	free_list = (floatobject *) op;
+#endif
 }
 
 double
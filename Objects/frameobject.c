@@ -113,10 +113,10 @@ frame_dealloc(f)
 	XDECREF(f->f_owner);
 	XDECREF(f->f_fastlocals);
 	XDECREF(f->f_trace);
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_FrameMutex);
 	f->f_back = free_list;
 	free_list = f;
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_FrameMutex);
 }
 
 typeobject Frametype = {
@@ -169,9 +169,9 @@ newframeobject(back, code, globals, locals, owner, nvalues, nblocks)
 		err_setstr(TypeError, "bad __builtins__ dictionary");
 		return NULL;
 	}
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_FrameMutex);
 	if (free_list == NULL) {
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_FrameMutex);
 		f = NEWOBJ(frameobject, &Frametype);
 		if (f == NULL)
 			return NULL;
@@ -182,7 +182,7 @@ newframeobject(back, code, globals, locals, owner, nvalues, nblocks)
 	else {
 		f = free_list;
 		free_list = free_list->f_back;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_FrameMutex);
 		f->ob_type = &Frametype;
 		NEWREF(f);
 	}
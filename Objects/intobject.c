@@ -110,6 +110,8 @@ fill_free_list()
 }
 
 static intobject *volatile free_list = NULL;
+/* NSMALLPOSINTS can be set with configure --with-small-ints=N; making
+   it larger lets loop counters and indices share objects too */
 #ifndef NSMALLPOSINTS
 #define NSMALLPOSINTS		100
 #endif
@@ -146,16 +148,16 @@ newintobject(ival)
 		return (object *) v;
 	}
 #endif
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_IntMutex);
 	if (free_list == NULL) {
 		if ((free_list = fill_free_list()) == NULL) {
-			Py_CRIT_UNLOCK();
+			Py_SUBSYS_UNLOCK(_Py_IntMutex);
 			return err_nomem();
 		}
 	}
 	v = free_list;
 	free_list = *(intobject **)free_list;
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_IntMutex);
 	v->ob_type = &Inttype;
 	v->ob_ival = ival;
 	NEWREF(v);
@@ -173,10 +175,10 @@ static void
 int_dealloc(v)
 	intobject *v;
 {
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_IntMutex);
 	*(intobject **)v = free_list;
 	free_list = v;
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_IntMutex);
 }
 
 long
@@ -40,7 +40,21 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <assert.h>
 #include <ctype.h>
 
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifndef CHAR_BIT
+#define CHAR_BIT 8
+#endif
+
+#ifndef LONG_BIT
+#define LONG_BIT (CHAR_BIT * sizeof(long))
+#endif
+
 #define ABS(x) ((x) < 0 ? -(x) : (x))
+#define MAX(x, y) ((x) < (y) ? (y) : (x))
+#define MIN(x, y) ((x) > (y) ? (y) : (x))
 
 /* Forward */
 static longobject *long_normalize PROTO((longobject *));
@@ -48,6 +62,28 @@ static longobject *mul1 PROTO((longobject *, wdigit));
 static longobject *muladd1 PROTO((longobject *, wdigit, wdigit));
 static longobject *divrem1 PROTO((longobject *, wdigit, digit *));
 static object *long_format PROTO((object *aa, int base));
+static longobject *k_mul PROTO((longobject *, longobject *));
+static object *long_add PROTO((longobject *, longobject *));
+static int long_divrem PROTO((longobject *, longobject *,
+	longobject **, longobject **));
+
+/* For operands with at least this many digits, multiplication uses
+   Karatsuba's algorithm instead of the grade school method.  x_mul()
+   squares a number with about half the multiplies of a general
+   product, so for squares Karatsuba pays off later. */
+#define KARATSUBA_CUTOFF	70
+#define KARATSUBA_SQUARE_CUTOFF	(2 * KARATSUBA_CUTOFF)
+
+/* Conversions between long ints and strings in bases that aren't powers
+   of two split the problem in half with a power of the base once the
+   number has more than this many digits (or the string more than this
+   many characters); below it they fall back to the linear loops. */
+#define CONVERT_DC_CUTOFF	40
+#define SCAN_DC_CUTOFF		(CONVERT_DC_CUTOFF * 4)
+
+/* Enough room for the powers base**(2**i) of any long int we can
+   allocate. */
+#define MAXPOWERS	32
 
 #define SIGCHECK(block) \
 	if (--pts->interp_ticker < 0) { \
@@ -89,18 +125,27 @@ object *
 newlongobject(ival)
 	long ival;
 {
-	/* Assume a C long fits in at most 3 'digits' */
-	/* XXX On 64 bit machines this isn't true!!! */
-	longobject *v = alloclongobject(3);
+	longobject *v;
+	unsigned long t;
+	int i, ndigits = 0;
+
+	/* Count the digits, so this works whatever the size of a C long
+	   and of a digit.  Negating in unsigned arithmetic keeps the most
+	   negative long right. */
+	t = ival < 0 ? -(unsigned long)ival : (unsigned long)ival;
+	while (t != 0) {
+		++ndigits;
+		t >>= SHIFT;
+	}
+	v = alloclongobject(ndigits);
 	if (v != NULL) {
-		if (ival < 0) {
-			ival = -ival;
-			v->ob_size = -(v->ob_size);
+		t = ival < 0 ? -(unsigned long)ival : (unsigned long)ival;
+		for (i = 0; i < ndigits; i++) {
+			v->ob_digit[i] = t & MASK;
+			t >>= SHIFT;
 		}
-		v->ob_digit[0] = ival & MASK;
-		v->ob_digit[1] = (ival >> SHIFT) & MASK;
-		v->ob_digit[2] = ((unsigned long)ival >> (2*SHIFT)) & MASK;
-		v = long_normalize(v);
+		if (ival < 0)
+			v->ob_size = -(v->ob_size);
 	}
 	return (object *)v;
 }
@@ -268,6 +313,130 @@ divrem1(a, n, prem)
 	return long_normalize(z);
 }
 
+/* Compute the largest power of base that still fits in a digit, and the
+   number of base-digits it stands for.  The conversion loops peel off
+   (or add in) that many characters per pass over the long int. */
+
+static wdigit
+long_chunkbase(base, pndig)
+	int base;
+	int *pndig;
+{
+	wdigit pbase = base;
+	int ndig = 1;
+
+	while ((twodigits)pbase * base <= MASK) {
+		pbase *= base;
+		++ndig;
+	}
+	*pndig = ndig;
+	return pbase;
+}
+
+/* Fill powers[0..nlevels-1] with pbase**(2**i), squaring as we go.
+   Returns -1 (with everything released) if we run out of memory. */
+
+static int
+long_powers(pbase, nlevels, powers)
+	wdigit pbase;
+	int nlevels;
+	longobject **powers;
+{
+	int i;
+
+	powers[0] = (longobject *) newlongobject((long)pbase);
+	if (powers[0] == NULL)
+		return -1;
+	for (i = 1; i < nlevels; i++) {
+		powers[i] = k_mul(powers[i-1], powers[i-1]);
+		if (powers[i] == NULL) {
+			while (--i >= 0)
+				DECREF(powers[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Write the digits of |a| backwards from *pp, in a base that is not a
+   power of two.  powers[lev] is pbase**(2**lev) and accounts for
+   ndig<<lev characters.  Large numbers are split with a single division
+   by the biggest such power and both halves done recursively, which
+   keeps the divisions balanced instead of peeling one chunk at a time
+   off the full-length number.  If width is nonzero, the output is
+   padded with zeros to exactly width characters (the low half of a
+   split needs its leading zeros).  Returns -1 on error. */
+
+static int
+long_format_dc(a, base, pbase, ndig, powers, lev, pp, width)
+	longobject *a;
+	int base;
+	wdigit pbase;
+	int ndig;
+	longobject **powers;
+	int lev;
+	char **pp;
+	int width;
+{
+	char *start = *pp;
+
+	if (lev < 0 || ABS(a->ob_size) <= CONVERT_DC_CUTOFF) {
+		PyThreadState *pts = PyThreadState_Get();
+		INCREF(a);
+		while (ABS(a->ob_size) != 0) {
+			digit rem;
+			int i;
+			longobject *temp = divrem1(a, pbase, &rem);
+			DECREF(a);
+			if (temp == NULL)
+				return -1;
+			a = temp;
+			for (i = 0; i < ndig; i++) {
+				int d = rem % base;
+				rem /= base;
+				*--*pp = d < 10 ? '0' + d : 'A' - 10 + d;
+				if (rem == 0 && a->ob_size == 0)
+					break;
+			}
+			SIGCHECK({
+				DECREF(a);
+				return -1;
+			})
+		}
+		DECREF(a);
+	}
+	else {
+		longobject *div, *mod;
+		int lowwidth = ndig << lev;
+		int err;
+
+		if (long_divrem(a, powers[lev], &div, &mod) < 0)
+			return -1;
+		if (div == NULL) {
+			DECREF(mod);
+			return -1;
+		}
+		if (div->ob_size == 0)
+			err = long_format_dc(mod, base, pbase, ndig, powers,
+					     lev-1, pp, width);
+		else {
+			err = long_format_dc(mod, base, pbase, ndig, powers,
+					     lev-1, pp, lowwidth);
+			if (err == 0)
+				err = long_format_dc(div, base, pbase, ndig,
+					powers, lev-1, pp,
+					width > lowwidth ? width - lowwidth : 0);
+		}
+		DECREF(div);
+		DECREF(mod);
+		if (err < 0)
+			return -1;
+	}
+	while (start - *pp < width)
+		*--*pp = '0';
+	return 0;
+}
+
 /* Convert a long int object to a string, using a given conversion base.
    Return a string object.
    If base is 8 or 16, add the proper prefix '0' or '0x'.
@@ -279,7 +448,6 @@ long_format(aa, base)
 	int base;
 {
 	register longobject *a = (longobject *)aa;
-	PyThreadState *pts = PyThreadState_Get();
 	stringobject *str;
 	int i;
 	int size_a = ABS(a->ob_size);
@@ -310,30 +478,58 @@ long_format(aa, base)
 	if (a->ob_size < 0)
 		sign = '-';
 	
-	INCREF(a);
-	do {
-		digit rem;
-		longobject *temp = divrem1(a, (digit)base, &rem);
-		if (temp == NULL) {
-			DECREF(a);
-			DECREF(str);
-			return NULL;
+	if (size_a == 0)
+		*--p = '0';
+	else if ((base & (base - 1)) == 0) {
+		/* Power-of-two bases don't need any division: just pull
+		   bits groups off the digits, low end first.  Here bits
+		   is exactly log2(base), which is never more than SHIFT. */
+		twodigits accum = 0;
+		int accumbits = 0;
+
+		for (i = 0; i < size_a; ++i) {
+			accum |= (twodigits)a->ob_digit[i] << accumbits;
+			accumbits += SHIFT;
+			do {
+				int d = accum & (base - 1);
+				*--p = d < 10 ? '0' + d : 'A' - 10 + d;
+				accumbits -= bits;
+				accum >>= bits;
+			} while (i < size_a-1 ? accumbits >= bits : accum != 0);
 		}
-		if (rem < 10)
-			rem += '0';
-		else
-			rem += 'A'-10;
-		assert(p > GETSTRINGVALUE(str));
-		*--p = rem;
-		DECREF(a);
-		a = temp;
-		SIGCHECK({
-			DECREF(a);
+	}
+	else {
+		longobject *powers[MAXPOWERS];
+		int ndig, nlevels = 0;
+		wdigit pbase = long_chunkbase(base, &ndig);
+		int err;
+
+		/* Use powers up to about half the size of a */
+		if (size_a > CONVERT_DC_CUTOFF) {
+			int n = 1;
+			while (nlevels < MAXPOWERS && n <= size_a) {
+				n <<= 1;
+				nlevels++;
+			}
+			if (long_powers(pbase, nlevels, powers) < 0) {
+				DECREF(str);
+				return NULL;
+			}
+			while (nlevels > 1 &&
+			       2*ABS(powers[nlevels-1]->ob_size) > size_a+1) {
+				nlevels--;
+				DECREF(powers[nlevels]);
+			}
+		}
+		err = long_format_dc(a, base, pbase, ndig, powers,
+				     nlevels-1, &p, 0);
+		for (i = 0; i < nlevels; i++)
+			DECREF(powers[i]);
+		if (err < 0) {
 			DECREF(str);
 			return NULL;
-		})
-	} while (ABS(a->ob_size) != 0);
-	DECREF(a);
+		}
+	}
 	if (base == 8) {
 		if (size_a != 0)
 			*--p = '0';
@@ -375,6 +571,83 @@ long_scan(str, base)
 }
 #endif
 
+/* Value of the character c as a digit, or -1 if it isn't one;
+   the caller still has to check the result against the base. */
+
+static int
+long_digitvalue(c)
+	int c;
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Convert n (already validated) characters at str to a long int, in a
+   base that is not a power of two.  Short strings are consumed ndig
+   characters per multiply-add pass; longer ones are split so that
+   high * base**m + low can use the fast multiplication, with m taken
+   from powers[lev] (which stands for ndig<<lev characters). */
+
+static longobject *
+long_scan_dc(str, n, base, pbase, ndig, powers, lev)
+	char *str;
+	int n;
+	int base;
+	wdigit pbase;
+	int ndig;
+	longobject **powers;
+	int lev;
+{
+	longobject *z, *hi, *lo, *temp;
+	int m;
+
+	while (lev >= 0 && (ndig << lev) >= n)
+		lev--;
+	if (lev < 0 || n <= SCAN_DC_CUTOFF) {
+		z = alloclongobject(0);
+		while (z != NULL && n > 0) {
+			wdigit chunk = 0, mult = 1;
+			int i;
+			/* Take a short first chunk so the rest are full */
+			int len = n % ndig ? n % ndig : ndig;
+			for (i = 0; i < len; i++) {
+				chunk = chunk * base +
+					long_digitvalue(Py_CHARMASK(*str++));
+				mult *= base;
+			}
+			n -= len;
+			temp = muladd1(z, mult, chunk);
+			DECREF(z);
+			z = temp;
+		}
+		return z;
+	}
+	m = ndig << lev;
+	hi = long_scan_dc(str, n - m, base, pbase, ndig, powers, lev);
+	if (hi == NULL)
+		return NULL;
+	lo = long_scan_dc(str + n - m, m, base, pbase, ndig, powers, lev-1);
+	if (lo == NULL) {
+		DECREF(hi);
+		return NULL;
+	}
+	temp = k_mul(hi, powers[lev]);
+	DECREF(hi);
+	if (temp == NULL) {
+		DECREF(lo);
+		return NULL;
+	}
+	z = (longobject *) long_add(temp, lo);
+	DECREF(temp);
+	DECREF(lo);
+	return z;
+}
+
 object *
 long_escan(str, pend, base)
 	char *str;
@@ -382,6 +655,8 @@ long_escan(str, pend, base)
 	int base;
 {
 	int sign = 1;
+	char *start;
+	int n;
 	longobject *z;
 	
 	if (base != 0 && base < 2 || base > 36) {
@@ -408,22 +683,62 @@ long_escan(str, pend, base)
 	}
 	if (base == 16 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
 		str += 2;
-	z = alloclongobject(0);
-	for ( ; z != NULL; ++str) {
-		int k = -1;
-		longobject *temp;
-		
-		if (*str <= '9')
-			k = *str - '0';
-		else if (*str >= 'a')
-			k = *str - 'a' + 10;
-		else if (*str >= 'A')
-			k = *str - 'A' + 10;
+	start = str;
+	for (;;) {
+		int k = long_digitvalue(Py_CHARMASK(*str));
 		if (k < 0 || k >= base)
 			break;
-		temp = muladd1(z, (digit)base, (digit)k);
-		DECREF(z);
-		z = temp;
+		++str;
+	}
+	n = str - start;
+	if ((base & (base - 1)) == 0) {
+		/* Power-of-two base: pack the bits in directly, starting
+		   from the least significant character */
+		int bits = 0, i = base;
+		twodigits accum = 0;
+		int accumbits = 0;
+		char *p = str;
+		digit *pdigit;
+
+		while (i > 1) {
+			++bits;
+			i >>= 1;
+		}
+		z = alloclongobject((n * bits + SHIFT - 1) / SHIFT);
+		if (z != NULL) {
+			pdigit = z->ob_digit;
+			while (--p >= start) {
+				accum |= (twodigits)long_digitvalue(
+					Py_CHARMASK(*p)) << accumbits;
+				accumbits += bits;
+				if (accumbits >= SHIFT) {
+					*pdigit++ = accum & MASK;
+					accum >>= SHIFT;
+					accumbits -= SHIFT;
+				}
+			}
+			if (accumbits)
+				*pdigit++ = accum;
+			while (pdigit < z->ob_digit + z->ob_size)
+				*pdigit++ = 0;
+			z = long_normalize(z);
+		}
+	}
+	else {
+		longobject *powers[MAXPOWERS];
+		int ndig, nlevels = 0, i;
+		wdigit pbase = long_chunkbase(base, &ndig);
+
+		if (n > SCAN_DC_CUTOFF) {
+			while (nlevels < MAXPOWERS && (ndig << nlevels) < n)
+				nlevels++;
+			if (long_powers(pbase, nlevels, powers) < 0)
+				return NULL;
+		}
+		z = long_scan_dc(start, n, base, pbase, ndig, powers,
+				 nlevels-1);
+		for (i = 0; i < nlevels; i++)
+			DECREF(powers[i]);
 	}
 	if (sign < 0 && z != NULL && z->ob_size != 0)
 		z->ob_size = -(z->ob_size);
@@ -667,8 +982,9 @@ long_hash(v)
 		i = -(i);
 	}
 	while (--i >= 0) {
-		/* Force a 32-bit circular shift */
-		x = ((x << SHIFT) & ~MASK) | ((x >> (32-SHIFT)) & MASK);
+		/* Force a circular shift over the width of a long, so that
+		   any value that fits in a long hashes to itself */
+		x = ((x << SHIFT) & ~MASK) | ((x >> (LONG_BIT-SHIFT)) & MASK);
 		x += v->ob_digit[i];
 	}
 	x = x * sign;
@@ -761,6 +1077,7 @@ x_sub(a, b)
 		borrow = a->ob_digit[i] - borrow;
 		z->ob_digit[i] = borrow & MASK;
 		borrow >>= SHIFT;
+		borrow &= 1; /* Keep only one sign bit */
 	}
 	assert(borrow == 0);
 	if (sign < 0)
@@ -817,8 +1134,11 @@ long_sub(a, b)
 	return (object *)z;
 }
 
-static object *
-long_mul(a, b)
+/* Grade school multiplication, ignoring the signs.
+   Returns the absolute value of the product, or NULL if error. */
+
+static longobject *
+x_mul(a, b)
 	longobject *a;
 	longobject *b;
 {
@@ -835,6 +1155,39 @@ long_mul(a, b)
 		return NULL;
 	for (i = 0; i < z->ob_size; ++i)
 		z->ob_digit[i] = 0;
+	if (a == b) {
+		/* Squaring: each cross product a[i]*a[j], i < j, appears
+		   twice in the result, so it is computed once and added
+		   in doubled, along with the square a[i]*a[i].  This is
+		   about half the multiplies of the general loop. */
+		for (i = 0; i < size_a; ++i) {
+			twodigits carry;
+			twodigits f = a->ob_digit[i];
+			int j = 2*i;
+			int k;
+
+			SIGCHECK({
+				DECREF(z);
+				return NULL;
+			})
+			carry = z->ob_digit[j] + f * f;
+			z->ob_digit[j++] = carry & MASK;
+			carry >>= SHIFT;
+			f <<= 1;
+			for (k = i+1; k < size_a; ++k, ++j) {
+				carry += z->ob_digit[j] + a->ob_digit[k] * f;
+				z->ob_digit[j] = carry & MASK;
+				carry >>= SHIFT;
+			}
+			for (; carry != 0; ++j) {
+				assert(j < z->ob_size);
+				carry += z->ob_digit[j];
+				z->ob_digit[j] = carry & MASK;
+				carry >>= SHIFT;
+			}
+		}
+		return long_normalize(z);
+	}
 	for (i = 0; i < size_a; ++i) {
 		twodigits carry = 0;
 		twodigits f = a->ob_digit[i];
@@ -856,11 +1209,293 @@ long_mul(a, b)
 			carry >>= SHIFT;
 		}
 	}
-	if (a->ob_size < 0)
-		z->ob_size = -(z->ob_size);
-	if (b->ob_size < 0)
+	return long_normalize(z);
+}
+
+/* Add the digit vector y[0:n] into x[0:m] in place, m >= n, and return
+   the carry out of x (0 or 1).  Used by the Karatsuba code to combine
+   partial products at an offset. */
+
+static digit
+v_iadd(x, m, y, n)
+	digit *x;
+	int m;
+	digit *y;
+	int n;
+{
+	int i;
+	digit carry = 0;
+
+	assert(m >= n);
+	for (i = 0; i < n; ++i) {
+		carry += x[i] + y[i];
+		x[i] = carry & MASK;
+		carry >>= SHIFT;
+	}
+	for (; carry && i < m; ++i) {
+		carry += x[i];
+		x[i] = carry & MASK;
+		carry >>= SHIFT;
+	}
+	return carry;
+}
+
+/* Subtract the digit vector y[0:n] from x[0:m] in place, m >= n, and
+   return the borrow out of x (0 or 1). */
+
+static digit
+v_isub(x, m, y, n)
+	digit *x;
+	int m;
+	digit *y;
+	int n;
+{
+	int i;
+	digit borrow = 0;
+
+	assert(m >= n);
+	for (i = 0; i < n; ++i) {
+		/* The following assumes unsigned arithmetic
+		   works modulo 2**N for some N>SHIFT. */
+		borrow = x[i] - y[i] - borrow;
+		x[i] = borrow & MASK;
+		borrow >>= SHIFT;
+		borrow &= 1; /* Keep only one sign bit */
+	}
+	for (; borrow && i < m; ++i) {
+		borrow = x[i] - borrow;
+		x[i] = borrow & MASK;
+		borrow >>= SHIFT;
+		borrow &= 1;
+	}
+	return borrow;
+}
+
+/* Split the absolute value of n into high and low parts, where low
+   holds the size least significant digits.  Both are normalized.
+   Returns -1 on error. */
+
+static int
+kmul_split(n, size, phigh, plow)
+	longobject *n;
+	int size;
+	longobject **phigh;
+	longobject **plow;
+{
+	longobject *hi, *lo;
+	int size_n = ABS(n->ob_size);
+	int size_lo = MIN(size_n, size);
+	int size_hi = size_n - size_lo;
+
+	if ((hi = alloclongobject(size_hi)) == NULL)
+		return -1;
+	if ((lo = alloclongobject(size_lo)) == NULL) {
+		DECREF(hi);
+		return -1;
+	}
+	memcpy(lo->ob_digit, n->ob_digit, size_lo * sizeof(digit));
+	memcpy(hi->ob_digit, n->ob_digit + size_lo, size_hi * sizeof(digit));
+	*phigh = long_normalize(hi);
+	*plow = long_normalize(lo);
+	return 0;
+}
+
+static longobject *k_lopsided_mul PROTO((longobject *, longobject *));
+
+/* Karatsuba multiplication, ignoring the signs.  With a = ah*B + al and
+   b = bh*B + bl, where B is BASE**shift,
+	a*b = ah*bh*B*B + ((ah+al)*(bh+bl) - ah*bh - al*bl)*B + al*bl
+   which takes three half-size multiplications instead of four.
+   Returns the absolute value of the product, or NULL if error. */
+
+static longobject *
+k_mul(a, b)
+	longobject *a;
+	longobject *b;
+{
+	int asize = ABS(a->ob_size);
+	int bsize = ABS(b->ob_size);
+	longobject *ah = NULL, *al = NULL, *bh = NULL, *bl = NULL;
+	longobject *ret = NULL;
+	longobject *t1, *t2, *t3;
+	int shift, i;
+
+	/* Ensure a is the smaller of the two */
+	if (asize > bsize) {
+		{ longobject *temp = a; a = b; b = temp; }
+		{ int size_temp = asize; asize = bsize; bsize = size_temp; }
+	}
+
+	/* Use grade school below the cutoff */
+	i = a == b ? KARATSUBA_SQUARE_CUTOFF : KARATSUBA_CUTOFF;
+	if (asize <= i) {
+		if (asize == 0)
+			return alloclongobject(0);
+		else
+			return x_mul(a, b);
+	}
+
+	/* If a is small compared to b, splitting on b gives a degenerate
+	   case with ah == 0; slice b into pieces the size of a instead */
+	if (2 * asize <= bsize)
+		return k_lopsided_mul(a, b);
+
+	shift = bsize >> 1;
+	if (kmul_split(a, shift, &ah, &al) < 0)
+		goto fail;
+	if (a == b) {
+		bh = ah;
+		bl = al;
+		INCREF(bh);
+		INCREF(bl);
+	}
+	else if (kmul_split(b, shift, &bh, &bl) < 0)
+		goto fail;
+
+	ret = alloclongobject(asize + bsize);
+	if (ret == NULL)
+		goto fail;
+
+	/* t1 = ah*bh goes into the high digits of the result */
+	if ((t1 = k_mul(ah, bh)) == NULL)
+		goto fail;
+	assert(2*shift + t1->ob_size <= ret->ob_size);
+	memcpy(ret->ob_digit + 2*shift, t1->ob_digit,
+	       t1->ob_size * sizeof(digit));
+	i = ret->ob_size - 2*shift - t1->ob_size;
+	if (i)
+		memset(ret->ob_digit + 2*shift + t1->ob_size, 0,
+		       i * sizeof(digit));
+
+	/* t2 = al*bl goes into the low digits */
+	if ((t2 = k_mul(al, bl)) == NULL) {
+		DECREF(t1);
+		goto fail;
+	}
+	assert(t2->ob_size <= 2*shift);
+	memcpy(ret->ob_digit, t2->ob_digit, t2->ob_size * sizeof(digit));
+	i = 2*shift - t2->ob_size;
+	if (i)
+		memset(ret->ob_digit + t2->ob_size, 0, i * sizeof(digit));
+
+	/* Subtract both from the middle.  This may go negative for a
+	   moment; the borrow is lost, and the carry out of adding t3 below
+	   restores it, since the final result fits. */
+	i = ret->ob_size - shift;
+	(void)v_isub(ret->ob_digit + shift, i, t2->ob_digit, t2->ob_size);
+	DECREF(t2);
+	(void)v_isub(ret->ob_digit + shift, i, t1->ob_digit, t1->ob_size);
+	DECREF(t1);
+
+	/* t3 = (ah+al)*(bh+bl) */
+	if ((t1 = x_add(ah, al)) == NULL)
+		goto fail;
+	DECREF(ah);
+	DECREF(al);
+	ah = al = NULL;
+	if (a == b) {
+		t2 = t1;
+		INCREF(t2);
+	}
+	else if ((t2 = x_add(bh, bl)) == NULL) {
+		DECREF(t1);
+		goto fail;
+	}
+	DECREF(bh);
+	DECREF(bl);
+	bh = bl = NULL;
+	t3 = k_mul(t1, t2);
+	DECREF(t1);
+	DECREF(t2);
+	if (t3 == NULL)
+		goto fail;
+
+	/* Add it into the middle */
+	(void)v_iadd(ret->ob_digit + shift, i, t3->ob_digit, t3->ob_size);
+	DECREF(t3);
+
+	return long_normalize(ret);
+
+ fail:
+	XDECREF(ret);
+	XDECREF(ah);
+	XDECREF(al);
+	XDECREF(bh);
+	XDECREF(bl);
+	return NULL;
+}
+
+/* Multiply a by a much larger b, by cutting b into slices of a's size
+   and multiplying those with k_mul, so every multiply stays balanced.
+   Both signs are ignored. */
+
+static longobject *
+k_lopsided_mul(a, b)
+	longobject *a;
+	longobject *b;
+{
+	int asize = ABS(a->ob_size);
+	int bsize = ABS(b->ob_size);
+	int nbdone; /* # of b digits already multiplied */
+	longobject *ret;
+	longobject *bslice = NULL;
+
+	assert(asize > KARATSUBA_CUTOFF);
+	assert(2 * asize <= bsize);
+
+	ret = alloclongobject(asize + bsize);
+	if (ret == NULL)
+		return NULL;
+	memset(ret->ob_digit, 0, ret->ob_size * sizeof(digit));
+
+	bslice = alloclongobject(asize);
+	if (bslice == NULL)
+		goto fail;
+
+	nbdone = 0;
+	while (bsize > 0) {
+		longobject *product;
+		int nbtouse = MIN(bsize, asize);
+
+		/* Multiply the next slice of b by a */
+		memcpy(bslice->ob_digit, b->ob_digit + nbdone,
+		       nbtouse * sizeof(digit));
+		bslice->ob_size = nbtouse;
+		product = k_mul(a, long_normalize(bslice));
+		if (product == NULL)
+			goto fail;
+
+		/* Add into the result */
+		(void)v_iadd(ret->ob_digit + nbdone, ret->ob_size - nbdone,
+			     product->ob_digit, product->ob_size);
+		DECREF(product);
+
+		bsize -= nbtouse;
+		nbdone += nbtouse;
+	}
+
+	DECREF(bslice);
+	return long_normalize(ret);
+
+ fail:
+	DECREF(ret);
+	XDECREF(bslice);
+	return NULL;
+}
+
+static object *
+long_mul(a, b)
+	longobject *a;
+	longobject *b;
+{
+	longobject *z;
+	
+	z = k_mul(a, b);
+	if (z == NULL)
+		return NULL;
+	if ((a->ob_size < 0) != (b->ob_size < 0))
 		z->ob_size = -(z->ob_size);
-	return (object *) long_normalize(z);
+	return (object *) z;
 }
 
 /* The / and % operators are now defined in terms of divmod().
@@ -964,69 +1599,158 @@ long_divmod(v, w)
 	return z;
 }
 
+/* Return a*b, reduced modulo c unless c is None.  Neither argument is
+   consumed.  Helper for long_pow. */
+
+static longobject *
+l_mulmod(a, b, c)
+	longobject *a;
+	longobject *b;
+	longobject *c;
+{
+	longobject *temp, *div, *mod;
+
+	temp = (longobject *)long_mul(a, b);
+	if (temp == NULL || (object *)c == None)
+		return temp;
+	if (l_divmod(temp, c, &div, &mod) < 0) {
+		DECREF(temp);
+		return NULL;
+	}
+	DECREF(temp);
+	DECREF(div);
+	return mod;
+}
+
+/* Bit i of the (nonnegative) exponent b */
+#define POW_BIT(b, i) (((b)->ob_digit[(i) / SHIFT] >> ((i) % SHIFT)) & 1)
+
+/* Largest window used by the sliding window exponentiation; the table
+   of odd powers has 1 << (POW_WINDOW_MAX-1) entries. */
+#define POW_WINDOW_MAX 5
+
 static object *
 long_pow(a, b, c)
 	longobject *a;
 	longobject *b;
 	longobject *c;
 {
-	longobject *z, *div, *mod;
-	int size_b, i;
+	longobject *table[1 << (POW_WINDOW_MAX-1)];
+	longobject *z, *temp, *div;
+	int size_b, nbits, window, ntable, i, j, k;
+	digit top;
 	
 	size_b = b->ob_size;
 	if (size_b < 0) {
 		err_setstr(ValueError, "long integer to the negative power");
 		return NULL;
 	}
-	z = (longobject *)newlongobject(1L);
-	INCREF(a);
-	for (i = 0; i < size_b; ++i) {
-		digit bi = b->ob_digit[i];
-		int j;
-	
-		for (j = 0; j < SHIFT; ++j) {
-			longobject *temp;
-		
-			if (bi & 1) {
-				temp = (longobject *)long_mul(z, a);
+
+	/* Number of significant bits in the exponent */
+	nbits = 0;
+	if (size_b > 0) {
+		nbits = (size_b-1) * SHIFT;
+		for (top = b->ob_digit[size_b-1]; top != 0; top >>= 1)
+			++nbits;
+	}
+
+	/* Left-to-right sliding window: scan the exponent from the top
+	   bit, squaring for every bit, and for each run of up to window
+	   bits that starts and ends with a one multiply once by the
+	   matching odd power of a from a precomputed table.  For big
+	   exponents this saves most of the multiplications the plain
+	   binary method does; for small ones the table isn't worth it. */
+	if (nbits <= 8)
+		window = 1;
+	else if (nbits <= 64)
+		window = 3;
+	else if (nbits <= 512)
+		window = 4;
+	else
+		window = POW_WINDOW_MAX;
+	ntable = 1 << (window-1);
+
+	/* table[k] = a ** (2*k+1) [mod c] */
+	if ((object *)c != None) {
+		if (l_divmod(a, c, &div, &table[0]) < 0)
+			return NULL;
+		DECREF(div);
+	}
+	else {
+		INCREF(a);
+		table[0] = a;
+	}
+	if (ntable > 1) {
+		longobject *a2 = l_mulmod(table[0], table[0], c);
+		for (k = 1; a2 != NULL && k < ntable; k++) {
+			table[k] = l_mulmod(table[k-1], a2, c);
+			if (table[k] == NULL)
+				break;
+		}
+		XDECREF(a2);
+		if (a2 == NULL || k < ntable) {
+			while (--k >= 0)
+				DECREF(table[k]);
+			return NULL;
+		}
+	}
+
+	z = NULL; /* Stands for 1 until the first window is seen */
+	for (i = nbits-1; i >= 0; i = j-1) {
+		int val;
+		if (!POW_BIT(b, i)) {
+			j = i;
+			if (z != NULL) {
+				temp = l_mulmod(z, z, c);
 				DECREF(z);
-			 	if ((object*)c!=None && temp!=NULL) {
-			 		l_divmod(temp, c, &div, &mod);
-				 	XDECREF(div);
-				 	DECREF(temp);
-				 	temp = mod;
-				}
-			 	z = temp;
-				if (z == NULL)
+				if ((z = temp) == NULL)
 					break;
 			}
-			bi >>= 1;
-			if (bi == 0 && i+1 == size_b)
-				break;
-			temp = (longobject *)long_mul(a, a);
-			DECREF(a);
-		 	if ((object*)c!=None && temp!=NULL) {
-			 	l_divmod(temp, c, &div, &mod);
-			 	XDECREF(div);
-			 	DECREF(temp);
-			 	temp = mod;
-			}
-			a = temp;
-			if (a == NULL) {
-				DECREF(z);
-				z = NULL;
+			continue;
+		}
+		/* The window is bits i down to j, with bit j set */
+		j = i - window + 1;
+		if (j < 0)
+			j = 0;
+		while (!POW_BIT(b, j))
+			++j;
+		val = 0;
+		for (k = i; k >= j; --k)
+			val = (val << 1) | POW_BIT(b, k);
+		if (z == NULL) {
+			z = table[val >> 1];
+			INCREF(z);
+			continue;
+		}
+		for (k = i; k >= j; --k) {
+			temp = l_mulmod(z, z, c);
+			DECREF(z);
+			if ((z = temp) == NULL)
 				break;
-			}
 		}
-		if (a == NULL || z == NULL)
+		if (z == NULL)
+			break;
+		temp = l_mulmod(z, table[val >> 1], c);
+		DECREF(z);
+		if ((z = temp) == NULL)
 			break;
 	}
-	XDECREF(a);
-	if ((object*)c!=None && z!=NULL) {
-			l_divmod(z, c, &div, &mod);
-			XDECREF(div);
-			DECREF(z);
-			z=mod;
+	for (k = 0; k < ntable; k++)
+		DECREF(table[k]);
+	if (i >= 0)
+		return NULL; /* Error in the loop */
+
+	if (z == NULL) {
+		/* Exponent zero */
+		z = (longobject *)newlongobject(1L);
+		if ((object *)c != None && z != NULL) {
+			temp = z;
+			if (l_divmod(temp, c, &div, &z) < 0)
+				z = NULL;
+			else
+				DECREF(div);
+			DECREF(temp);
+		}
 	}
 	return (object *)z;
 }
@@ -1209,9 +1933,6 @@ long_lshift(a, b)
 
 /* Bitwise and/xor/or operations */
 
-#define MAX(x, y) ((x) < (y) ? (y) : (x))
-#define MIN(x, y) ((x) > (y) ? (y) : (x))
-
 static object *long_bitwise PROTO((longobject *, int, longobject *));
 static object *
 long_bitwise(a, op, b)
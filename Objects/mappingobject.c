@@ -995,24 +995,24 @@ getattro(v, name)
 	   last_name_char, even if last_name_* subsequently change).
 	   This approach may also optimize future uses. */
 
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_AttrMutex);
 	if (name == last_name_object) {
 		attr = last_name_char;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 	}
 	else {
 		object *temp;
 
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 
 		INCREF(name);	/* for storing in last_name_object */
 		attr = getstringvalue(name);
 
-		Py_CRIT_LOCK();
+		Py_SUBSYS_LOCK(_Py_AttrMutex);
 		temp = last_name_object;
 		last_name_object = name;
 		last_name_char = attr;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 
 		XDECREF(temp);
 	}
@@ -1043,24 +1043,24 @@ setattro(v, name, value)
 	   last_name_char, even if last_name_* subsequently change).
 	   This approach may also optimize future uses. */
 
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_AttrMutex);
 	if (name == last_name_object) {
 		attr = last_name_char;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 	}
 	else {
 		object *temp;
 
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 
 		INCREF(name);	/* for storing in last_name_object */
 		attr = getstringvalue(name);
 
-		Py_CRIT_LOCK();
+		Py_SUBSYS_LOCK(_Py_AttrMutex);
 		temp = last_name_object;
 		last_name_object = name;
 		last_name_char = attr;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_AttrMutex);
 
 		XDECREF(temp);
 	}
@@ -71,14 +71,14 @@ newtupleobject(size)
 	op = NULL;
 	if (0 < size && size < MAXSAVESIZE )
 	{
-	    Py_CRIT_LOCK();
+	    Py_SUBSYS_LOCK(_Py_TupleMutex);
 	    if ((op = free_tuples[size]) != NULL) {
 		free_tuples[size] = (tupleobject *) op->ob_item[0];
 #ifdef COUNT_ALLOCS
 		fast_tuple_allocs++;
 #endif
 	    }
-	    Py_CRIT_UNLOCK();
+	    Py_SUBSYS_UNLOCK(_Py_TupleMutex);
 	}
 	if (op == NULL )
 #endif
@@ -166,10 +166,10 @@ tupledealloc(op)
 		XDECREF(op->ob_item[i]);
 #if MAXSAVESIZE > 0
 	if (0 < op->ob_size && op->ob_size < MAXSAVESIZE) {
-		Py_CRIT_LOCK();
+		Py_SUBSYS_LOCK(_Py_TupleMutex);
 		op->ob_item[0] = (object *) free_tuples[op->ob_size];
 		free_tuples[op->ob_size] = op;
-		Py_CRIT_UNLOCK();
+		Py_SUBSYS_UNLOCK(_Py_TupleMutex);
 	} else
 #endif
 		free((ANY *)op);
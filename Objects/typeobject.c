@@ -84,7 +84,7 @@ typeobject Typetype = {
 	0,			/*tp_str*/
 	0,			/*tp_xxx1*/
 	0,			/*tp_xxx2*/
-	0,			/*tp_xxx3*/
+	0,			/*tp_as_buffer*/
 	0,			/*tp_xxx4*/
 	"Define the behaviour of a particular type of object.",
 };
@@ -50,6 +50,22 @@ PERFORMANCE OF THIS SOFTWARE.
 
 #include <ctype.h>
 
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifndef CHAR_BIT
+#define CHAR_BIT 8
+#endif
+
+#ifndef LONG_BIT
+#define LONG_BIT (CHAR_BIT * sizeof(long))
+#endif
+
+/* Ints smaller than this in absolute value can be multiplied inline
+   without any risk of overflowing a long */
+#define INLINE_MUL_LIMIT ((long)1 << (LONG_BIT/2 - 1))
+
 /* Turn this on if your compiler chokes on the big switch: */
 /* #define CASE_TOO_BIG 1 */
 
@@ -101,6 +117,7 @@ static int assign_slice PROTO((object *, object *, object *, object *));
 static int cmp_exception PROTO((object *, object *));
 static int cmp_member PROTO((object *, object *));
 static object *cmp_outcome PROTO((int, object *, object *));
+static int float_operands PROTO((object *, object *, double *, double *));
 static int import_from PROTO((object *, object *, object *));
 static object *build_class PROTO((object *, object *, object *));
 #ifdef SUPPORT_OBSOLETE_ACCESS
@@ -165,6 +182,17 @@ restore_thread(x)
 #endif
 }
 
+int
+interpreter_lock_stats(stats)
+	long *stats;
+{
+#ifdef USE_INTERPRETER_LOCK
+	if (interpreter_lock)
+		return lock_stats(interpreter_lock, stats);
+#endif
+	return 0;
+}
+
 
 /* Mechanism whereby asynchronously executing callbacks (e.g. UNIX
    signal handlers or Mac I/O completion routines) can schedule calls
@@ -213,7 +241,7 @@ Py_AddPendingCall(func, arg)
 	PyThreadState *pts = PyThreadState_Get();
 
 #ifdef WITH_FREE_THREAD
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_PendingMutex);
 #else
 	static int busy = 0;
 	/* XXX Begin critical section */
@@ -236,7 +264,7 @@ Py_AddPendingCall(func, arg)
 	pts->interp_ticker = 0; /* Signal main loop */
 
 #ifdef WITH_FREE_THREAD
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_PendingMutex);
 #else
 	busy = 0;
 	/* XXX End critical section */
@@ -352,6 +380,7 @@ eval_code2(co, globals, locals,
 	register frameobject *f; /* Current frame */
 	register object **fastlocals;
 	object *retval;		/* Return value */
+	double fa, fb;		/* Operands of inline float arithmetic */
 	PyThreadState *pts;
 #ifdef SUPPORT_OBSOLETE_ACCESS
 	int defmode = 0;	/* Default access mode for new variables */
@@ -736,7 +765,21 @@ eval_code2(co, globals, locals,
 		case BINARY_MULTIPLY:
 			w = POP();
 			v = POP();
-			x = mul(v, w);
+			if (is_intobject(v) && is_intobject(w)) {
+				/* INLINE: int * int, if it can't overflow */
+				register long a, b;
+				a = GETINTVALUE((intobject *)v);
+				b = GETINTVALUE((intobject *)w);
+				if (a > -INLINE_MUL_LIMIT && a < INLINE_MUL_LIMIT &&
+				    b > -INLINE_MUL_LIMIT && b < INLINE_MUL_LIMIT)
+					x = newintobject(a * b);
+				else
+					x = mul(v, w);
+			}
+			else if (float_operands(v, w, &fa, &fb))
+				x = newfloatobject(fa * fb);
+			else
+				x = mul(v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -745,7 +788,12 @@ eval_code2(co, globals, locals,
 		case BINARY_DIVIDE:
 			w = POP();
 			v = POP();
-			x = divide(v, w);
+			if (float_operands(v, w, &fa, &fb) && fb != 0.0)
+				/* INLINE: float / float; division by zero
+				   takes the slow path, which raises */
+				x = newfloatobject(fa / fb);
+			else
+				x = divide(v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -763,7 +811,22 @@ eval_code2(co, globals, locals,
 		case BINARY_ADD:
 			w = POP();
 			v = POP();
-			x = add(v, w);
+			if (is_intobject(v) && is_intobject(w)) {
+				/* INLINE: int + int; overflow takes the long way
+				   round, which raises the error */
+				register long a, b, i;
+				a = GETINTVALUE((intobject *)v);
+				b = GETINTVALUE((intobject *)w);
+				i = a + b;
+				if ((i^a) < 0 && (i^b) < 0)
+					x = add(v, w);
+				else
+					x = newintobject(i);
+			}
+			else if (float_operands(v, w, &fa, &fb))
+				x = newfloatobject(fa + fb);
+			else
+				x = add(v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -772,7 +835,21 @@ eval_code2(co, globals, locals,
 		case BINARY_SUBTRACT:
 			w = POP();
 			v = POP();
-			x = sub(v, w);
+			if (is_intobject(v) && is_intobject(w)) {
+				/* INLINE: int - int */
+				register long a, b, i;
+				a = GETINTVALUE((intobject *)v);
+				b = GETINTVALUE((intobject *)w);
+				i = a - b;
+				if ((i^a) < 0 && (i^~b) < 0)
+					x = sub(v, w);
+				else
+					x = newintobject(i);
+			}
+			else if (float_operands(v, w, &fa, &fb))
+				x = newfloatobject(fa - fb);
+			else
+				x = sub(v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -781,7 +858,35 @@ eval_code2(co, globals, locals,
 		case BINARY_SUBSCR:
 			w = POP();
 			v = POP();
-			x = apply_subscript(v, w);
+			x = NULL;
+			if (is_intobject(w)) {
+				/* INLINE: tuple[int] and list[int].  Lists
+				   have to go through their lock when free
+				   threading.  Bad indices take the slow
+				   path, which raises the error. */
+				register long i = GETINTVALUE((intobject *)w);
+				if (is_tupleobject(v)) {
+					if (i < 0)
+						i += ((tupleobject *)v)->ob_size;
+					if (i >= 0 &&
+					    i < ((tupleobject *)v)->ob_size)
+						x = GETTUPLEITEM(v, i);
+				}
+#ifndef WITH_FREE_THREAD
+				else if (is_listobject(v)) {
+					if (i < 0)
+						i += ((listobject *)v)->ob_size;
+					if (i >= 0 &&
+					    i < ((listobject *)v)->ob_size)
+						x = GETLISTITEM((listobject *)v,
+								i);
+				}
+#endif
+			}
+			if (x != NULL)
+				INCREF(x);
+			else
+				x = apply_subscript(v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -1436,7 +1541,45 @@ eval_code2(co, globals, locals,
 		case COMPARE_OP:
 			w = POP();
 			v = POP();
-			x = cmp_outcome(oparg, v, w);
+			if (is_intobject(v) && is_intobject(w) &&
+			    oparg <= (int) GE) {
+				/* INLINE: cmp(int, int) */
+				register long a, b;
+				register int res;
+				a = GETINTVALUE((intobject *)v);
+				b = GETINTVALUE((intobject *)w);
+				switch (oparg) {
+				case LT: res = a <  b; break;
+				case LE: res = a <= b; break;
+				case EQ: res = a == b; break;
+				case NE: res = a != b; break;
+				case GT: res = a >  b; break;
+				case GE: res = a >= b; break;
+				default: res = 0; /* Can't happen */
+				}
+				x = res ? True : False;
+				INCREF(x);
+			}
+			else if (oparg <= (int) GE &&
+				 float_operands(v, w, &fa, &fb)) {
+				/* INLINE: cmp(float, float), ordering the
+				   values the same way float_compare does */
+				register int c, res;
+				c = fa < fb ? -1 : fa > fb ? 1 : 0;
+				switch (oparg) {
+				case LT: res = c <  0; break;
+				case LE: res = c <= 0; break;
+				case EQ: res = c == 0; break;
+				case NE: res = c != 0; break;
+				case GT: res = c >  0; break;
+				case GE: res = c >= 0; break;
+				default: res = 0; /* Can't happen */
+				}
+				x = res ? True : False;
+				INCREF(x);
+			}
+			else
+				x = cmp_outcome(oparg, v, w);
 			DECREF(v);
 			DECREF(w);
 			PUSH(x);
@@ -1532,10 +1675,31 @@ eval_code2(co, globals, locals,
 			   	s, i are popped, and we jump */
 			w = POP(); /* Loop index */
 			v = POP(); /* Sequence object */
-			u = loop_subscript(v, w);
+			/* INLINE: the index is always an int, and tuple
+			   and list items can be fetched directly */
+			if (is_tupleobject(v)) {
+				long i = GETINTVALUE((intobject *)w);
+				u = NULL;
+				if (i < ((tupleobject *)v)->ob_size) {
+					u = GETTUPLEITEM(v, i);
+					INCREF(u);
+				}
+			}
+#ifndef WITH_FREE_THREAD
+			else if (is_listobject(v)) {
+				long i = GETINTVALUE((intobject *)w);
+				u = NULL;
+				if (i < ((listobject *)v)->ob_size) {
+					u = GETLISTITEM((listobject *)v, i);
+					INCREF(u);
+				}
+			}
+#endif
+			else
+				u = loop_subscript(v, w);
 			if (u != NULL) {
 				PUSH(v);
-				x = newintobject(getintvalue(w)+1);
+				x = newintobject(GETINTVALUE((intobject *)w)+1);
 				PUSH(x);
 				DECREF(w);
 				PUSH(u);
@@ -2811,6 +2975,36 @@ cmp_member(v, w)
 	return 0;
 }
 
+/* If v and w are two floats, or a float and an int, store their values
+   in *pa and *pb and return 1, so the caller can do the arithmetic
+   inline; the int is converted the same way float_coerce does it.
+   Otherwise return 0. */
+
+static int
+float_operands(v, w, pa, pb)
+	object *v;
+	object *w;
+	double *pa;
+	double *pb;
+{
+	if (is_floatobject(v)) {
+		if (is_floatobject(w))
+			*pb = GETFLOATVALUE((floatobject *)w);
+		else if (is_intobject(w))
+			*pb = (double) GETINTVALUE((intobject *)w);
+		else
+			return 0;
+		*pa = GETFLOATVALUE((floatobject *)v);
+		return 1;
+	}
+	if (is_floatobject(w) && is_intobject(v)) {
+		*pa = (double) GETINTVALUE((intobject *)v);
+		*pb = GETFLOATVALUE((floatobject *)w);
+		return 1;
+	}
+	return 0;
+}
+
 static object *
 cmp_outcome(op, v, w)
 	int op;
@@ -520,12 +520,57 @@ com_add(c, list, v)
 	return n;
 }
 
+/* Constants are only shared if they are really the same value: the
+   same type, and for floats even the same sign of zero.  Tuples are
+   compared item by item the same way, so (1, 2) and (1.0, 2), which
+   compare equal, stay distinct constants. */
+
+static int
+com_sameconst(v, w)
+	object *v;
+	object *w;
+{
+	int i;
+	if (v->ob_type != w->ob_type)
+		return 0;
+	if (is_floatobject(v))
+		return memcmp((char *)&((floatobject *)v)->ob_fval,
+			      (char *)&((floatobject *)w)->ob_fval,
+			      sizeof(double)) == 0;
+#ifndef WITHOUT_COMPLEX
+	if (is_complexobject(v))
+		return memcmp((char *)&((complexobject *)v)->cval,
+			      (char *)&((complexobject *)w)->cval,
+			      sizeof(Py_complex)) == 0;
+#endif
+	if (is_tupleobject(v)) {
+		if (gettuplesize(v) != gettuplesize(w))
+			return 0;
+		for (i = gettuplesize(v); --i >= 0; ) {
+			if (!com_sameconst(gettupleitem(v, i),
+					   gettupleitem(w, i)))
+				return 0;
+		}
+		return 1;
+	}
+	return cmpobject(v, w) == 0;
+}
+
 static int
 com_addconst(c, v)
 	struct compiling *c;
 	object *v;
 {
-	return com_add(c, c->c_consts, v);
+	object *list = c->c_consts;
+	int n = getlistsize(list);
+	int i;
+	for (i = n; --i >= 0; ) {
+		if (com_sameconst(v, getlistitem(list, i)))
+			return i;
+	}
+	if (addlistitem(list, v) != 0)
+		c->c_errors++;
+	return n;
 }
 
 static int
@@ -790,6 +835,270 @@ parsestrplus(n)
 	return v;
 }
 
+/* Constant folding.
+
+   com_const() returns the value of an expression that consists only
+   of literals -- numbers, strings and tuples of those, combined with
+   the arithmetic, bitwise and unary operators -- or NULL (with no
+   error set) if the expression isn't constant or can't be folded.
+   The compile functions for those operators call com_fold() first,
+   which emits a single LOAD_CONST for such an expression.
+
+   Operations that fail (e.g. 1/0) are left for run time, so they
+   raise their exception where they always did.  To keep code objects
+   small, sequence results longer than MAX_FOLD_SIZE are only kept
+   when they come from '+', ** and << aren't folded when a long is
+   involved, and floats that aren't finite are left alone since not
+   every atof() can read them back from a .pyc file. */
+
+#define MAX_FOLD_SIZE 100
+
+static object *com_const PROTO((struct compiling *, node *));
+
+static int
+fold_seqsize(v)
+	object *v;
+{
+	if (is_stringobject(v))
+		return getstringsize(v);
+	if (is_tupleobject(v))
+		return gettuplesize(v);
+	return -1;
+}
+
+static int
+fold_finite(v)
+	object *v;
+{
+	double x, y;
+	if (is_floatobject(v)) {
+		x = getfloatvalue(v);
+		y = 0.0;
+	}
+#ifndef WITHOUT_COMPLEX
+	else if (is_complexobject(v)) {
+		x = ((complexobject *)v)->cval.real;
+		y = ((complexobject *)v)->cval.imag;
+	}
+#endif
+	else
+		return 1;
+	return x - x == 0.0 && y - y == 0.0;
+}
+
+static object *
+fold_binop(op, v, w)
+	int op;
+	object *v;
+	object *w;
+{
+	object *x;
+	long size, count;
+	switch (op) {
+	case STAR:
+		/* Check the size of a repeated sequence beforehand */
+		size = count = 0;
+		if (fold_seqsize(v) >= 0 && is_intobject(w)) {
+			size = fold_seqsize(v);
+			count = getintvalue(w);
+		}
+		else if (fold_seqsize(w) >= 0 && is_intobject(v)) {
+			size = fold_seqsize(w);
+			count = getintvalue(v);
+		}
+		if (size > 0 && count > MAX_FOLD_SIZE / size)
+			return NULL;
+		x = PyNumber_Multiply(v, w);
+		break;
+	case SLASH:	x = PyNumber_Divide(v, w); break;
+	case PERCENT:	x = PyNumber_Remainder(v, w); break;
+	case PLUS:	x = PyNumber_Add(v, w); break;
+	case MINUS:	x = PyNumber_Subtract(v, w); break;
+	case RIGHTSHIFT: x = PyNumber_Rshift(v, w); break;
+	case AMPER:	x = PyNumber_And(v, w); break;
+	case CIRCUMFLEX: x = PyNumber_Xor(v, w); break;
+	case VBAR:	x = PyNumber_Or(v, w); break;
+	case LEFTSHIFT:
+		if (is_longobject(v) || is_longobject(w))
+			return NULL;
+		x = PyNumber_Lshift(v, w);
+		break;
+	case DOUBLESTAR:
+		if (is_longobject(v) || is_longobject(w))
+			return NULL;
+		x = PyNumber_Power(v, w, None);
+		break;
+	default:
+		return NULL;
+	}
+	if (x == NULL) {
+		err_clear();
+		return NULL;
+	}
+	if ((op != PLUS && fold_seqsize(x) > MAX_FOLD_SIZE) || !fold_finite(x)) {
+		DECREF(x);
+		return NULL;
+	}
+	return x;
+}
+
+/* Fold a tuple display: every other child of an exprlist or testlist */
+
+static object *
+com_const_tuple(c, n)
+	struct compiling *c;
+	node *n;
+{
+	object *v, *x;
+	int i;
+	v = newtupleobject((NCH(n) + 1) / 2);
+	if (v == NULL) {
+		err_clear();
+		return NULL;
+	}
+	for (i = 0; i < NCH(n); i += 2) {
+		if ((x = com_const(c, CHILD(n, i))) == NULL) {
+			DECREF(v);
+			return NULL;
+		}
+		settupleitem(v, i/2, x);
+	}
+	return v;
+}
+
+static object *
+com_const(c, n)
+	struct compiling *c;
+	node *n;
+{
+	object *v, *w, *x;
+	int i;
+	if (c->c_errors)
+		return NULL;
+	switch (TYPE(n)) {
+
+	case test:
+	case and_test:
+	case comparison:
+		/* Only the plain case: no lambda, and, or or compare */
+		if (NCH(n) != 1 || TYPE(CHILD(n, 0)) == lambdef)
+			return NULL;
+		return com_const(c, CHILD(n, 0));
+
+	case not_test:
+		if (NCH(n) == 1)
+			return com_const(c, CHILD(n, 0));
+		if ((v = com_const(c, CHILD(n, 1))) == NULL)
+			return NULL;
+		i = testbool(v);
+		DECREF(v);
+		return newintobject((long) !i);
+
+	case testlist:
+	case exprlist:
+		if (NCH(n) == 1)
+			return com_const(c, CHILD(n, 0));
+		return com_const_tuple(c, n);
+
+	case expr:
+	case xor_expr:
+	case and_expr:
+	case shift_expr:
+	case arith_expr:
+	case term:
+		v = com_const(c, CHILD(n, 0));
+		for (i = 2; i < NCH(n) && v != NULL; i += 2) {
+			w = com_const(c, CHILD(n, i));
+			if (w == NULL) {
+				DECREF(v);
+				return NULL;
+			}
+			x = fold_binop(TYPE(CHILD(n, i-1)), v, w);
+			DECREF(v);
+			DECREF(w);
+			v = x;
+		}
+		return v;
+
+	case factor:
+		if (NCH(n) == 1)
+			return com_const(c, CHILD(n, 0));
+		if ((v = com_const(c, CHILD(n, 1))) == NULL)
+			return NULL;
+		switch (TYPE(CHILD(n, 0))) {
+		case PLUS:
+			w = PyNumber_Positive(v);
+			break;
+		case MINUS:
+			w = PyNumber_Negative(v);
+			break;
+		case TILDE:
+			w = PyNumber_Invert(v);
+			break;
+		default:
+			w = NULL;
+		}
+		DECREF(v);
+		if (w == NULL)
+			err_clear();
+		return w;
+
+	case power:
+		if (NCH(n) == 1)
+			return com_const(c, CHILD(n, 0));
+		if (NCH(n) != 3 || TYPE(CHILD(n, 1)) != DOUBLESTAR)
+			return NULL; /* Trailers are never constant */
+		if ((v = com_const(c, CHILD(n, 0))) == NULL)
+			return NULL;
+		if ((w = com_const(c, CHILD(n, 2))) == NULL) {
+			DECREF(v);
+			return NULL;
+		}
+		x = fold_binop(DOUBLESTAR, v, w);
+		DECREF(v);
+		DECREF(w);
+		return x;
+
+	case atom:
+		switch (TYPE(CHILD(n, 0))) {
+		case LPAR:
+			if (TYPE(CHILD(n, 1)) == RPAR)
+				v = newtupleobject(0);
+			else
+				return com_const(c, CHILD(n, 1));
+			break;
+		case NUMBER:
+			v = parsenumber(c, STR(CHILD(n, 0)));
+			break;
+		case STRING:
+			v = parsestrplus(n);
+			break;
+		default:
+			return NULL;
+		}
+		if (v == NULL)
+			err_clear();
+		return v;
+	}
+	return NULL;
+}
+
+/* Compile n as a LOAD_CONST if it is a constant expression; return
+   nonzero if it was */
+
+static int
+com_fold(c, n)
+	struct compiling *c;
+	node *n;
+{
+	object *v = com_const(c, n);
+	if (v == NULL)
+		return 0;
+	com_addoparg(c, LOAD_CONST, com_addconst(c, v));
+	DECREF(v);
+	return 1;
+}
+
 static void
 com_list_constructor(c, n)
 	struct compiling *c;
@@ -836,8 +1145,10 @@ com_atom(c, n)
 	ch = CHILD(n, 0);
 	switch (TYPE(ch)) {
 	case LPAR:
-		if (TYPE(CHILD(n, 1)) == RPAR)
-			com_addoparg(c, BUILD_TUPLE, 0);
+		if (TYPE(CHILD(n, 1)) == RPAR) {
+			if (!com_fold(c, n)) /* The empty tuple */
+				com_addoparg(c, BUILD_TUPLE, 0);
+		}
 		else
 			com_node(c, CHILD(n, 1));
 		break;
@@ -1117,6 +1428,8 @@ com_power(c, n)
 {
 	int i;
 	REQ(n, power);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_atom(c, CHILD(n, 0));
 	for (i = 1; i < NCH(n); i++) {
 		if (TYPE(CHILD(n, i)) == DOUBLESTAR) {
@@ -1135,6 +1448,8 @@ com_factor(c, n)
 	node *n;
 {
 	REQ(n, factor);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	if (TYPE(CHILD(n, 0)) == PLUS) {
 		com_factor(c, CHILD(n, 1));
 		com_addbyte(c, UNARY_POSITIVE);
@@ -1160,6 +1475,8 @@ com_term(c, n)
 	int i;
 	int op;
 	REQ(n, term);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_factor(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_factor(c, CHILD(n, i));
@@ -1190,6 +1507,8 @@ com_arith_expr(c, n)
 	int i;
 	int op;
 	REQ(n, arith_expr);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_term(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_term(c, CHILD(n, i));
@@ -1217,6 +1536,8 @@ com_shift_expr(c, n)
 	int i;
 	int op;
 	REQ(n, shift_expr);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_arith_expr(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_arith_expr(c, CHILD(n, i));
@@ -1244,6 +1565,8 @@ com_and_expr(c, n)
 	int i;
 	int op;
 	REQ(n, and_expr);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_shift_expr(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_shift_expr(c, CHILD(n, i));
@@ -1267,6 +1590,8 @@ com_xor_expr(c, n)
 	int i;
 	int op;
 	REQ(n, xor_expr);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_and_expr(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_and_expr(c, CHILD(n, i));
@@ -1290,6 +1615,8 @@ com_expr(c, n)
 	int i;
 	int op;
 	REQ(n, expr);
+	if (NCH(n) > 1 && com_fold(c, n))
+		return;
 	com_xor_expr(c, CHILD(n, 0));
 	for (i = 2; i < NCH(n); i += 2) {
 		com_xor_expr(c, CHILD(n, i));
@@ -1499,6 +1826,12 @@ com_list(c, n, toplevel)
 	else {
 		int i;
 		int len;
+		object *v = com_const_tuple(c, n);
+		if (v != NULL) {
+			com_addoparg(c, LOAD_CONST, com_addconst(c, v));
+			DECREF(v);
+			return;
+		}
 		len = (NCH(n) + 1) / 2;
 		for (i = 0; i < NCH(n); i += 2)
 			com_node(c, CHILD(n, i));
@@ -1941,6 +2274,70 @@ com_exec_stmt(c, n)
 	com_addbyte(c, EXEC_STMT);
 }
 
+/* Return 1 if test n is a constant that is true, 0 if it is a
+   constant that is false, and -1 if it isn't constant */
+
+static int
+com_const_test(c, n)
+	struct compiling *c;
+	node *n;
+{
+	object *v = com_const(c, n);
+	int i;
+	if (v == NULL)
+		return -1;
+	i = testbool(v);
+	DECREF(v);
+	return i;
+}
+
+/* Compile n, which can never be executed, and throw the code away.
+   It is still compiled so that errors in it are reported and its
+   global statements take effect; and since optimize() finds a
+   function's locals by scanning its code, names stored in the
+   dropped code are made locals here.  If the code contains an exec
+   statement, which turns that optimization off, it is kept instead,
+   with a jump around it. */
+
+static void
+com_skip_node(c, n)
+	struct compiling *c;
+	node *n;
+{
+	unsigned char *code, *p, *end;
+	int start = c->c_nexti;
+	int lineno = c->c_lineno;
+	int anchor = 0;
+	int op;
+	com_addfwref(c, JUMP_FORWARD, &anchor);
+	com_node(c, n);
+	if (c->c_errors)
+		return;
+	code = (unsigned char *) getstringvalue(c->c_code);
+	for (p = code + start + 3, end = code + c->c_nexti; p < end; ) {
+		op = *p++;
+		if (op == EXEC_STMT) {
+			com_backpatch(c, anchor);
+			return;
+		}
+		if (HAS_ARG(op))
+			p += 2;
+	}
+	for (p = code + start + 3; p < end; ) {
+		op = *p++;
+		if (!HAS_ARG(op))
+			continue;
+		p += 2;
+		if (c->c_infunction &&
+		    (op == STORE_NAME || op == DELETE_NAME ||
+		     op == IMPORT_FROM))
+			com_addlocal_o(c, getlistitem(c->c_names,
+						      (p[-1]<<8) + p[-2]));
+	}
+	c->c_nexti = start;
+	c->c_lineno = lineno;
+}
+
 static void
 com_if_stmt(c, n)
 	struct compiling *c;
@@ -1948,13 +2345,31 @@ com_if_stmt(c, n)
 {
 	int i;
 	int anchor = 0;
+	int done = 0;
 	REQ(n, if_stmt);
 	/*'if' test ':' suite ('elif' test ':' suite)* ['else' ':' suite] */
+	/* A branch whose test is a false constant is dropped, and so is
+	   everything after one whose test is a true constant */
 	for (i = 0; i+3 < NCH(n); i+=4) {
 		int a = 0;
+		int k;
 		node *ch = CHILD(n, i+1);
+		if (done) {
+			com_skip_node(c, CHILD(n, i+3));
+			continue;
+		}
+		k = com_const_test(c, ch);
+		if (k == 0) {
+			com_skip_node(c, CHILD(n, i+3));
+			continue;
+		}
 		if (i > 0)
 			com_addoparg(c, SET_LINENO, ch->n_lineno);
+		if (k > 0) {
+			com_node(c, CHILD(n, i+3));
+			done = 1;
+			continue;
+		}
 		com_node(c, CHILD(n, i+1));
 		com_addfwref(c, JUMP_IF_FALSE, &a);
 		com_addbyte(c, POP_TOP);
@@ -1963,9 +2378,14 @@ com_if_stmt(c, n)
 		com_backpatch(c, a);
 		com_addbyte(c, POP_TOP);
 	}
-	if (i+2 < NCH(n))
-		com_node(c, CHILD(n, i+2));
-	com_backpatch(c, anchor);
+	if (i+2 < NCH(n)) {
+		if (done)
+			com_skip_node(c, CHILD(n, i+2));
+		else
+			com_node(c, CHILD(n, i+2));
+	}
+	if (anchor)
+		com_backpatch(c, anchor);
 }
 
 static void
@@ -1976,21 +2396,28 @@ com_while_stmt(c, n)
 	int break_anchor = 0;
 	int anchor = 0;
 	int save_begin = c->c_begin;
+	int forever;
 	REQ(n, while_stmt); /* 'while' test ':' suite ['else' ':' suite] */
 	com_addfwref(c, SETUP_LOOP, &break_anchor);
 	block_push(c, SETUP_LOOP);
 	c->c_begin = c->c_nexti;
 	com_addoparg(c, SET_LINENO, n->n_lineno);
-	com_node(c, CHILD(n, 1));
-	com_addfwref(c, JUMP_IF_FALSE, &anchor);
-	com_addbyte(c, POP_TOP);
+	/* No need to test a true constant, as in "while 1:" */
+	forever = com_const_test(c, CHILD(n, 1)) > 0;
+	if (!forever) {
+		com_node(c, CHILD(n, 1));
+		com_addfwref(c, JUMP_IF_FALSE, &anchor);
+		com_addbyte(c, POP_TOP);
+	}
 	c->c_loops++;
 	com_node(c, CHILD(n, 3));
 	c->c_loops--;
 	com_addoparg(c, JUMP_ABSOLUTE, c->c_begin);
 	c->c_begin = save_begin;
-	com_backpatch(c, anchor);
-	com_addbyte(c, POP_TOP);
+	if (!forever) {
+		com_backpatch(c, anchor);
+		com_addbyte(c, POP_TOP);
+	}
 	com_addbyte(c, POP_BLOCK);
 	block_pop(c, SETUP_LOOP);
 	if (NCH(n) > 4)
@@ -43,6 +43,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "bltinmodule.h"
 #include "pythonrun.h"
 #include "marshal.h"
+#include "pymutex.h"
 #include "compile.h"
 #include "eval.h"
 #include "osdefs.h"
@@ -55,6 +56,27 @@ PERFORMANCE OF THIS SOFTWARE.
 
 extern long getmtime(); /* In getmtime.c */
 
+/* Only where file names are case sensitive and there is no 8.3 mangling
+   can a directory listing stand in for trying to open the file */
+#if defined(HAVE_DIRENT_H) && !defined(macintosh) && !defined(MS_WINDOWS) \
+	&& !defined(IMPORT_8x3_NAMES)
+#define USE_DIR_CACHE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <time.h>
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifndef MAP_FAILED
+#define MAP_FAILED ((char *)-1)
+#endif
+#define USE_MMAP
+#endif
+
 /* Magic word to reject .pyc files generated by other Python versions */
 /* Change for each incompatible change */
 /* The value of CR and LF is incorporated so if you ever read or write
@@ -62,7 +84,7 @@ extern long getmtime(); /* In getmtime.c */
    Apple MPW compiler swaps their values, botching string constants */
 /* XXX Perhaps the magic number should be frozen and a version field
    added to the .pyc file header? */
-#define MAGIC (5892 | ((long)'\r'<<16) | ((long)'\n'<<24))
+#define MAGIC (5895 | ((long)'\r'<<16) | ((long)'\n'<<24))
 
 object *import_modules; /* This becomes sys.modules */
 
@@ -251,7 +273,7 @@ read_compiled_module(fp)
 {
 	object *co;
 
-	co = rd_object(fp);
+	co = PyMarshal_ReadObjectFromMappedFile(fp);
 	/* Ugly: rd_object() may return NULL with or without error */
 	if (co == NULL || !is_codeobject(co)) {
 		if (!err_occurred())
@@ -328,6 +350,12 @@ write_compiled_module(co, cpathname, mtime)
 {
 	FILE *fp;
 
+#ifdef HAVE_MMAP
+	/* Another process may have the old file mapped (see
+	   read_compiled_module()); truncating it under their feet would
+	   crash them, so write a new file instead */
+	(void) unlink(cpathname);
+#endif
 	fp = fopen(cpathname, "wb");
 	if (fp == NULL) {
 		if (verbose)
@@ -405,6 +433,131 @@ load_source_module(name, pathname, fp)
 }
 
 
+#ifdef USE_DIR_CACHE
+
+/* Cache of directory listings, so that find_module() only tries to
+   open files that exist.  Without it, importing a module costs a
+   failed fopen() for every suffix in every directory on sys.path
+   before the right one, which is slow on network file systems.
+
+   dir_cache maps a directory's (st_dev, st_ino) pair to a tuple
+   (mtime, listed, names), where listed is the time the listing was
+   started and names is a dictionary with the directory's entries as
+   keys.  Keying on the inode rather than the name keeps a relative
+   entry such as '' from finding the listing of whatever directory was
+   current before an os.chdir().  The directory is stat()ed on every
+   lookup and listed again when its mtime has changed.  Since mtimes
+   only have a resolution of one second, a listing started no later
+   than the second the directory was last changed is stale: another
+   file could still have appeared without changing the mtime.  The
+   cache and its counters are shared by all threads and guarded by the
+   import mutex. */
+
+static object *dir_cache;
+static long dir_cache_avoided;	/* Number of fopen() calls avoided */
+static long dir_cache_listed;	/* Number of directories listed */
+
+/* Return the names in directory dir as a dictionary (a new
+   reference), or NULL, without an exception, if it can't be listed */
+
+static object *
+dir_listing(dir)
+	char *dir;
+{
+	object *key, *entry, *old, *names, *v;
+	DIR *dirp;
+	struct dirent *ep;
+	struct stat st, st2;
+	long listed;
+
+	if (*dir == '\0')
+		dir = ".";
+	if (stat(dir, &st) != 0)
+		return NULL;
+	if (dir_cache == NULL) {
+		if ((old = newdictobject()) == NULL) {
+			err_clear();
+			return NULL;
+		}
+		Py_SUBSYS_LOCK(_Py_ImportMutex);
+		if (dir_cache == NULL) {
+			dir_cache = old;
+			old = NULL;
+		}
+		Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+		XDECREF(old);
+	}
+
+	if ((key = mkvalue("(ll)", (long)st.st_dev, (long)st.st_ino)) == NULL) {
+		err_clear();
+		return NULL;
+	}
+
+	/* Another thread may replace the entry as soon as the mutex is
+	   released; hence the extra references */
+	Py_SUBSYS_LOCK(_Py_ImportMutex);
+	entry = dict2lookup(dir_cache, key);
+	XINCREF(entry);
+	Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+	err_clear();
+	if (entry != NULL) {
+		if (getintvalue(gettupleitem(entry, 0)) == (long)st.st_mtime &&
+		    getintvalue(gettupleitem(entry, 1)) > (long)st.st_mtime) {
+			names = gettupleitem(entry, 2);
+			INCREF(names);
+			DECREF(entry);
+			DECREF(key);
+			return names;
+		}
+		DECREF(entry);
+	}
+
+	listed = (long)time((time_t *)NULL);
+	if ((dirp = opendir(dir)) == NULL) {
+		DECREF(key);
+		return NULL;
+	}
+	names = newdictobject();
+	while (names != NULL && (ep = readdir(dirp)) != NULL) {
+		v = newstringobject(ep->d_name);
+		if (v == NULL || dict2insert(names, v, None) != 0) {
+			DECREF(names);
+			names = NULL;
+		}
+		XDECREF(v);
+	}
+	closedir(dirp);
+	if (names == NULL) {
+		DECREF(key);
+		err_clear();
+		return NULL;
+	}
+	/* Only keep the listing if dir still names the same, unchanged
+	   directory; a stale one would be relisted anyway */
+	entry = NULL;
+	if (stat(dir, &st2) == 0 && st2.st_dev == st.st_dev &&
+	    st2.st_ino == st.st_ino && st2.st_mtime == st.st_mtime &&
+	    listed > (long)st.st_mtime)
+		entry = mkvalue("(llO)", (long)st.st_mtime, listed, names);
+	Py_SUBSYS_LOCK(_Py_ImportMutex);
+	dir_cache_listed++;
+	old = dict2lookup(dir_cache, key);
+	XINCREF(old);
+	if (entry != NULL)
+		dict2insert(dir_cache, key, entry);
+	else if (old != NULL)
+		dict2remove(dir_cache, key);
+	Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+	err_clear();
+	XDECREF(old);
+	XDECREF(entry);
+	DECREF(key);
+	return names;
+}
+
+#endif /* USE_DIR_CACHE */
+
+
 /* Search the path (default sys.path) for a module.  Return the
    corresponding filedescr struct, and (via return arguments) the
    pathname and an open file.  Return NULL if the module is not found. */
@@ -421,6 +574,11 @@ find_module(name, path, buf, buflen, p_fp)
 	int i, npath, len, namelen;
 	struct filedescr *fdp;
 	FILE *fp = NULL;
+#ifdef USE_DIR_CACHE
+	object *names;
+	int dirlen;
+	long avoided = 0;
+#endif
 
 #ifdef MS_COREDLL
 	if ((fp=PyWin_FindRegisteredModule(name, &fdp, buf, buflen))!=NULL) {
@@ -455,9 +613,15 @@ find_module(name, path, buf, buflen, p_fp)
 			
 			return &resfiledescr;
 		}
+#endif
+#ifdef USE_DIR_CACHE
+		names = dir_listing(buf);
 #endif
 		if (len > 0 && buf[len-1] != SEP)
 			buf[len++] = SEP;
+#ifdef USE_DIR_CACHE
+		dirlen = len;
+#endif
 #ifdef IMPORT_8x3_NAMES
 		/* see if we are searching in directory dos_8x3 */
 		if (len > 7 && !strncmp(buf + len - 8, "dos_8x3", 7)){
@@ -477,15 +641,33 @@ find_module(name, path, buf, buflen, p_fp)
 		}
 		for (fdp = import_filetab; fdp->suffix != NULL; fdp++) {
 			strcpy(buf+len, fdp->suffix);
+#ifdef USE_DIR_CACHE
+			if (names != NULL &&
+			    dictlookup(names, buf+dirlen) == NULL) {
+				err_clear();
+				avoided++;
+				continue;
+			}
+#endif
 			if (verbose > 1)
 				fprintf(stderr, "# trying %s\n", buf);
 			fp = fopen(buf, fdp->mode);
 			if (fp != NULL)
 				break;
 		}
+#ifdef USE_DIR_CACHE
+		XDECREF(names);
+#endif
 		if (fp != NULL)
 			break;
 	}
+#ifdef USE_DIR_CACHE
+	if (avoided > 0) {
+		Py_SUBSYS_LOCK(_Py_ImportMutex);
+		dir_cache_avoided += avoided;
+		Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+	}
+#endif
 	if (fp == NULL) {
 		char buf[256];
 		sprintf(buf, "No module named %.200s", name);
@@ -640,6 +822,224 @@ init_frozen(name)
 }
 
 
+/* Module archive.
+
+   If $PYTHONARCHIVE names a module archive, as written by
+   Tools/scripts/pyarchive.py, modules found in it are imported from
+   there, after built-in and frozen modules but before sys.path is
+   searched.  Like frozen modules, archived modules are not checked
+   against their source files.  The archive is mapped into memory (or
+   read, if there is no mmap()) once; importing a module from it then
+   costs a binary search and unmarshalling the code, without any file
+   system access.
+
+   All numbers are 4-byte little-endian integers, as in marshal:
+
+	"PYAR"			archive magic
+	magic			as get_pyc_magic(); a mismatch ignores the archive
+	n			number of modules
+	n * (name, code, size)	offsets of the module name (a null-terminated
+				string) and of its marshalled code object,
+				and the code object's size, sorted by name
+
+   followed by the names and code objects themselves. */
+
+#define ARCHIVE_HEADER 12
+#define ARCHIVE_ENTRY 12
+
+static char *archive_data;	/* Contents of the archive, NULL if none */
+static long archive_size;
+static long archive_count;
+static char *archive_name;	/* Pathname, as given by $PYTHONARCHIVE */
+static int archive_opened;
+
+static long
+archive_long(p)
+	char *p;
+{
+	unsigned char *u = (unsigned char *)p;
+	long x = u[0] | ((long)u[1] << 8) | ((long)u[2] << 16) |
+		((long)u[3] << 24);
+	/* Sign-extend, in case a long is more than 32 bits */
+	x |= -(x & 0x80000000L);
+	return x;
+}
+
+/* Check that all names and code objects in the archive lie within it,
+   after the index, and that the names are sorted, as find_archived()
+   assumes */
+
+static int
+archive_valid(data, size)
+	char *data;
+	long size;
+{
+	long i, n, start, name, code, len;
+	char *p, *prev = NULL;
+
+	if (size < ARCHIVE_HEADER || memcmp(data, "PYAR", 4) != 0 ||
+	    archive_long(data+4) != get_pyc_magic())
+		return 0;
+	n = archive_long(data+8);
+	if (n < 0 || n > (size - ARCHIVE_HEADER) / ARCHIVE_ENTRY)
+		return 0;
+	start = ARCHIVE_HEADER + n*ARCHIVE_ENTRY;
+	for (i = 0; i < n; i++) {
+		p = data + ARCHIVE_HEADER + i*ARCHIVE_ENTRY;
+		name = archive_long(p);
+		code = archive_long(p+4);
+		len = archive_long(p+8);
+		if (name < start || name >= size ||
+		    memchr(data+name, '\0', size-name) == NULL ||
+		    code < start || len < 0 || code > size - len)
+			return 0;
+		if (prev != NULL && strcmp(prev, data+name) >= 0)
+			return 0;
+		prev = data+name;
+	}
+	return 1;
+}
+
+/* Open the archive, once.  A missing or bad archive is not an error:
+   modules are then simply found on sys.path. */
+
+static void
+open_archive()
+{
+	char *path;
+	FILE *fp;
+	char *data = NULL;
+	long size;
+	int mapped = 0;
+#ifdef USE_MMAP
+	struct stat st;
+#endif
+
+	Py_SUBSYS_LOCK(_Py_ImportMutex);
+	if (archive_opened) {
+		Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+		return;
+	}
+	path = getenv("PYTHONARCHIVE");
+	if (path == NULL || *path == '\0' ||
+	    (fp = fopen(path, "rb")) == NULL) {
+		archive_opened = 1;
+		Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+		return;
+	}
+#ifdef USE_MMAP
+	if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)) {
+		size = st.st_size;
+		data = (char *) mmap(0, (size_t)size, PROT_READ,
+				     MAP_PRIVATE, fileno(fp), (off_t)0);
+		if (data == (char *)MAP_FAILED)
+			data = NULL;
+		else
+			mapped = 1;
+	}
+#endif
+	if (data == NULL) {
+		fseek(fp, 0L, 2);
+		size = ftell(fp);
+		if (size > 0 && (data = malloc(size)) != NULL) {
+			fseek(fp, 0L, 0);
+			if (fread(data, 1, (int)size, fp) != size) {
+				free(data);
+				data = NULL;
+			}
+		}
+	}
+	fclose(fp);
+	if (data != NULL && archive_valid(data, size)) {
+		archive_data = data;
+		archive_size = size;
+		archive_count = archive_long(data+8);
+		archive_name = path;
+	}
+	else if (data != NULL) {
+		if (verbose)
+			fprintf(stderr, "# %s is not a valid module archive\n",
+				path);
+#ifdef USE_MMAP
+		if (mapped)
+			munmap(data, (size_t)size);
+		else
+#endif
+			free(data);
+	}
+	/* Set last, so other threads don't look before it's ready */
+	archive_opened = 1;
+	Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+}
+
+/* Find a module in the archive.  Return a pointer to its marshalled
+   code object and store the size in *p_size, or return NULL. */
+
+static char *
+find_archived(name, p_size)
+	char *name;
+	int *p_size;
+{
+	long lo, hi, mid;
+	char *p;
+	int cmp;
+
+	if (!archive_opened)
+		open_archive();
+	if (archive_data == NULL)
+		return NULL;
+	lo = 0;
+	hi = archive_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		p = archive_data + ARCHIVE_HEADER + mid*ARCHIVE_ENTRY;
+		cmp = strcmp(name, archive_data + archive_long(p));
+		if (cmp == 0) {
+			*p_size = (int)archive_long(p+8);
+			return archive_data + archive_long(p+4);
+		}
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid+1;
+	}
+	return NULL;
+}
+
+/* Initialize a module from the archive.
+   Return 1 for succes, 0 if the module is not found, and -1 with
+   an exception set if the initialization failed. */
+
+static int
+init_archived(name)
+	char *name;
+{
+	char *code;
+	int size;
+	object *co;
+	object *m;
+
+	if ((code = find_archived(name, &size)) == NULL)
+		return 0;
+	if (verbose)
+		fprintf(stderr, "import %s # from %s\n", name, archive_name);
+	co = rds_object(code, size);
+	if (co == NULL)
+		return -1;
+	if (!is_codeobject(co)) {
+		DECREF(co);
+		err_setstr(TypeError, "archived object is not a code object");
+		return -1;
+	}
+	m = exec_code_module(name, co);
+	DECREF(co);
+	if (m == NULL)
+		return -1;
+	DECREF(m);
+	return 1;
+}
+
+
 /* Import a module, either built-in, frozen, or external, and return
    its module object WITH INCREMENTED REFERENCE COUNT */
 
@@ -658,7 +1058,8 @@ import_module(name)
 	}
 	else {
 		int i;
-		if ((i = init_builtin(name)) || (i = init_frozen(name))) {
+		if ((i = init_builtin(name)) || (i = init_frozen(name)) ||
+		    (i = init_archived(name))) {
 			if (i < 0)
 				return NULL;
 			if ((m = dictlookup(import_modules, name)) == NULL) {
@@ -702,8 +1103,9 @@ reload_module(m)
 		err_setstr(ImportError, "reload() module not in sys.modules");
 		return NULL;
 	}
-	/* Check for built-in and frozen modules */
-	if ((i = init_builtin(name)) || (i = init_frozen(name))) {
+	/* Check for built-in, frozen and archived modules */
+	if ((i = init_builtin(name)) || (i = init_frozen(name)) ||
+	    (i = init_archived(name))) {
 		if (i < 0)
 			return NULL;
 		INCREF(m);
@@ -765,6 +1167,44 @@ imp_get_suffixes(self, args)
 	return list;
 }
 
+static object *
+imp_invalidate_caches(self, args)
+	object *self;
+	object *args;
+{
+#ifdef USE_DIR_CACHE
+	object *new, *old;
+#endif
+
+	if (!newgetargs(args, ""))
+		return NULL;
+#ifdef USE_DIR_CACHE
+	if ((new = newdictobject()) == NULL)
+		return NULL;
+	Py_SUBSYS_LOCK(_Py_ImportMutex);
+	old = dir_cache;
+	dir_cache = new;
+	Py_SUBSYS_UNLOCK(_Py_ImportMutex);
+	XDECREF(old);
+#endif
+	INCREF(None);
+	return None;
+}
+
+static object *
+imp_cache_stats(self, args)
+	object *self;
+	object *args;
+{
+	if (!newgetargs(args, ""))
+		return NULL;
+#ifdef USE_DIR_CACHE
+	return mkvalue("(ll)", dir_cache_avoided, dir_cache_listed);
+#else
+	return mkvalue("(ll)", 0L, 0L);
+#endif
+}
+
 static object *
 imp_find_module(self, args)
 	object *self;
@@ -887,6 +1327,40 @@ imp_is_frozen(self, args)
 	return newintobject(0);
 }
 
+static object *
+imp_init_archived(self, args)
+	object *self;
+	object *args;
+{
+	char *name;
+	int ret;
+	object *m;
+	if (!newgetargs(args, "s", &name))
+		return NULL;
+	ret = init_archived(name);
+	if (ret < 0)
+		return NULL;
+	if (ret == 0) {
+		INCREF(None);
+		return None;
+	}
+	m = add_module(name);
+	XINCREF(m);
+	return m;
+}
+
+static object *
+imp_is_archived(self, args)
+	object *self;
+	object *args;
+{
+	char *name;
+	int size;
+	if (!newgetargs(args, "s", &name))
+		return NULL;
+	return newintobject(find_archived(name, &size) != NULL);
+}
+
 static FILE *
 get_file(pathname, fob, mode)
 	char *pathname;
@@ -995,9 +1469,13 @@ static struct methodlist imp_methods[] = {
 	{"get_frozen_object",	imp_get_frozen_object,	1},
 	{"get_magic",		imp_get_magic,		1},
 	{"get_suffixes",	imp_get_suffixes,	1},
+	{"cache_stats",		imp_cache_stats,	1},
 	{"find_module",		imp_find_module,	1},
+	{"init_archived",	imp_init_archived,	1},
 	{"init_builtin",	imp_init_builtin,	1},
 	{"init_frozen",		imp_init_frozen,	1},
+	{"invalidate_caches",	imp_invalidate_caches,	1},
+	{"is_archived",		imp_is_archived,	1},
 	{"is_builtin",		imp_is_builtin,		1},
 	{"is_frozen",		imp_is_frozen,		1},
 	{"load_compiled",	imp_load_compiled,	1},
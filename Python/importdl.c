@@ -273,12 +273,12 @@ load_dynamic_module(name, pathname, fp)
 			fstat(fileno(fp), &statb);
 
 			/* make sure the same module won't occur twice */
-			Py_CRIT_LOCK();
+			Py_SUBSYS_LOCK(_Py_ImportMutex);
 
 			for (i = 0; i < nhandles; i++) {
 				if (statb.st_dev == handles[i].dev &&
 				    statb.st_ino == handles[i].ino) {
-					Py_CRIT_UNLOCK();
+					Py_SUBSYS_UNLOCK(_Py_ImportMutex);
 					p = (dl_funcptr) dlsym(handles[i].handle,
 							       funcname);
 					goto got_it;
@@ -297,7 +297,7 @@ load_dynamic_module(name, pathname, fp)
 #endif /* RTLD_NOW */
 		if (handle == NULL) {
 			if (fp != NULL)
-				Py_CRIT_UNLOCK();
+				Py_SUBSYS_UNLOCK(_Py_ImportMutex);
 			err_setstr(ImportError, dlerror());
 			return NULL;
 		}
@@ -308,7 +308,7 @@ load_dynamic_module(name, pathname, fp)
 				handles[nhandles].handle = handle;
 				++nhandles;
 			}
-			Py_CRIT_UNLOCK();
+			Py_SUBSYS_UNLOCK(_Py_ImportMutex);
 		}
 		p = (dl_funcptr) dlsym(handle, funcname);
 	}
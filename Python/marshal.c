@@ -42,10 +42,25 @@ PERFORMANCE OF THIS SOFTWARE.
 
 #include <errno.h>
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifndef MAP_FAILED
+#define MAP_FAILED ((char *)-1)
+#endif
+#define USE_MMAP
+#endif
+
+/* Files with fewer bytes than this left to read are not worth mapping;
+   the stdio reader is as fast for them and avoids the mmap() setup. */
+#define MMAP_THRESHOLD	(16*1024)
+
 #define TYPE_NULL	'0'
 #define TYPE_NONE	'N'
 #define TYPE_ELLIPSIS   '.'
 #define TYPE_INT	'i'
+#define TYPE_INT64	'I'	/* Int that needs more than 32 bits */
 #define TYPE_FLOAT	'f'
 #define TYPE_COMPLEX	'x'
 #define TYPE_LONG	'l'
@@ -55,38 +70,118 @@ PERFORMANCE OF THIS SOFTWARE.
 #define TYPE_DICT	'{'
 #define TYPE_CODE	'c'
 #define TYPE_UNKNOWN	'?'
+#define TYPE_REF	'r'	/* Index of an object read earlier */
+
+/* In format version 1 and up, the type byte of every string and tuple
+   has FLAG_REF set, and the object gets the next index in a table.
+   Later occurrences of the same string (by value) or the same tuple
+   (by identity) are then written as TYPE_REF plus that index, and the
+   reader returns the object it read before.  Strings are matched by
+   value because the compiler makes a new string for each occurrence
+   of a name. */
+#define FLAG_REF	0x80
+
+#define MARSHAL_VERSION	1	/* The latest format version */
+
+/* Lists and dictionaries are never written as references, so one that
+   contains itself would be written forever; give up at this depth. */
+#define MAX_MARSHAL_DEPTH	2000
+
+/* Long ints are always written as 15-bit digits, whatever SHIFT the
+   interpreter was built with, so that .pyc files stay portable.  SHIFT
+   must be a multiple of MARSHAL_SHIFT. */
+#define MARSHAL_SHIFT	15
+#define MARSHAL_MASK	((1 << MARSHAL_SHIFT) - 1)
+#define MARSHAL_RATIO	(SHIFT / MARSHAL_SHIFT)
+
+/* Output always goes through the buffer from ptr to end, so writing a
+   byte costs a single pointer test.  When the buffer is full, w_more()
+   either writes it out to fp and starts over at buf, or, if fp is
+   NULL, doubles the size of the string object str. */
+
+#define WBUFSIZE 4096	/* Size of the buffer for writing to a file */
 
 typedef struct {
 	FILE *fp;
 	int error;
-	/* If fp == NULL, the following are valid: */
 	object *str;
 	char *ptr;
 	char *end;
+	char *buf;	/* Start of the buffer when writing to fp */
+	int version;	/* Format version to write */
+	object *refs;	/* Reference table: dictionary when writing,
+			   list when reading; NULL if none yet */
+	int depth;	/* Nesting depth of the object being written */
 } WFILE;
 
-#define w_byte(c, p) if (((p)->fp)) putc((c), (p)->fp); \
-		      else if ((p)->ptr != (p)->end) *(p)->ptr++ = (c); \
-			   else w_more(c, p)
+#define w_byte(c, p) if ((p)->ptr != (p)->end) *(p)->ptr++ = (c); \
+		     else w_more(c, p)
 
 static void
-w_more(c, p)
-	char c;
+w_init_file(p, fp, buf)
+	WFILE *p;
+	FILE *fp;
+	char *buf;	/* Of WBUFSIZE bytes */
+{
+	p->fp = fp;
+	p->error = 0;
+	p->str = NULL;
+	p->ptr = p->buf = buf;
+	p->end = buf + WBUFSIZE;
+	p->version = 0;
+	p->refs = NULL;
+	p->depth = 0;
+}
+
+static void
+w_flush(p)
+	WFILE *p;
+{
+	if (p->fp != NULL && p->ptr != p->buf) {
+		fwrite(p->buf, 1, (int)(p->ptr - p->buf), p->fp);
+		p->ptr = p->buf;
+	}
+}
+
+/* Make room for at least n more bytes; return 0 if that's impossible
+   (a file buffer can't hold more than WBUFSIZE, and a string may fail
+   to grow) */
+
+static int
+w_reserve(n, p)
+	int n;
 	WFILE *p;
 {
-	int size, newsize;
+	int size, used, newsize;
+	if (p->end - p->ptr >= n)
+		return 1;
+	if (p->fp != NULL) {
+		w_flush(p);
+		return n <= WBUFSIZE;
+	}
 	if (p->str == NULL)
-		return; /* An error already occurred */
+		return 0; /* An error already occurred */
 	size = getstringsize(p->str);
-	newsize = size + 1024;
+	used = p->ptr - GETSTRINGVALUE((stringobject *)p->str);
+	newsize = size + (size > 1024 ? size : 1024);
+	if (newsize < used + n)
+		newsize = used + n;
 	if (resizestring(&p->str, newsize) != 0) {
 		p->ptr = p->end = NULL;
+		return 0;
 	}
-	else {
-		p->ptr = GETSTRINGVALUE((stringobject *)p->str) + size;
-		p->end = GETSTRINGVALUE((stringobject *)p->str) + newsize;
+	p->ptr = GETSTRINGVALUE((stringobject *)p->str) + used;
+	p->end = GETSTRINGVALUE((stringobject *)p->str) + newsize;
+	return 1;
+}
+
+static void
+w_more(c, p)
+	char c;
+	WFILE *p;
+{
+	if (w_reserve(1, p))
 		*p->ptr++ = c;
-	}
 }
 
 static void
@@ -95,14 +190,13 @@ w_string(s, n, p)
 	int n;
 	WFILE *p;
 {
-	if (p->fp != NULL) {
-		fwrite(s, 1, n, p->fp);
+	if (w_reserve(n, p)) {
+		memcpy(p->ptr, s, n);
+		p->ptr += n;
 	}
-	else {
-		while (--n >= 0) {
-			w_byte(*s, p);
-			s++;
-		}
+	else if (p->fp != NULL) {
+		/* Too big for the buffer, which w_reserve() flushed */
+		fwrite(s, 1, n, p->fp);
 	}
 }
 
@@ -126,13 +220,120 @@ w_long(x, p)
 	w_byte((int)((x>>24) & 0xff), p);
 }
 
+/* Write a double as a length byte and its text, with as few digits
+   as read back to the same value; 17 significant digits always do */
+
+static void
+w_double(x, p)
+	double x;
+	WFILE *p;
+{
+	extern double atof PROTO((const char *));
+	char buf[32];
+	int prec, n;
+	for (prec = 12; prec <= 17; prec++) {
+		sprintf(buf, "%.*g", prec, x);
+		if (atof(buf) == x)
+			break;
+	}
+	n = strlen(buf);
+	w_byte(n, p);
+	w_string(buf, n, p);
+}
+
+/* For a string or tuple v, return FLAG_REF after giving v the next
+   index in the reference table; if v is already in the table, write a
+   reference to it and return -1.  For anything else, or when not
+   writing references, return 0.  While a tuple's contents are being
+   written its index is stored as -1-index, so that a tuple reached
+   again from inside itself is caught instead of referring to a slot
+   the reader has not filled yet. */
+
+static int
+w_ref(v, p)
+	object *v;
+	WFILE *p;
+{
+	object *key, *index;
+	long n;
+	int flag = 0;
+	if (p->version < 1 || v == NULL ||
+	    !(is_stringobject(v) || is_tupleobject(v)))
+		return 0;
+	if (p->refs == NULL && (p->refs = newdictobject()) == NULL) {
+		p->error = 1;
+		return 0;
+	}
+	if (is_stringobject(v)) {
+		key = v;
+		INCREF(key);
+	}
+	else if ((key = newintobject((long)v)) == NULL) {
+		p->error = 1;
+		return 0;
+	}
+	index = dict2lookup(p->refs, key);
+	if (index != NULL) {
+		n = getintvalue(index);
+		if (n < 0)
+			p->error = 2;	/* Recursive */
+		else {
+			w_byte(TYPE_REF, p);
+			w_long(n, p);
+		}
+		flag = -1;
+	}
+	else {
+		err_clear();
+		n = (long)getmappingsize(p->refs);
+		index = newintobject(is_tupleobject(v) ? -1-n : n);
+		if (index == NULL || dict2insert(p->refs, key, index) != 0)
+			p->error = 1;
+		XDECREF(index);
+		flag = FLAG_REF;
+	}
+	DECREF(key);
+	return flag;
+}
+
+/* Mark tuple v, given an index by w_ref(), as completely written */
+
+static void
+w_ref_done(v, p)
+	object *v;
+	WFILE *p;
+{
+	object *key, *index;
+	if ((key = newintobject((long)v)) == NULL) {
+		p->error = 1;
+		return;
+	}
+	index = dict2lookup(p->refs, key);
+	if (index == NULL ||
+	    (index = newintobject(-1-getintvalue(index))) == NULL ||
+	    dict2insert(p->refs, key, index) != 0)
+		p->error = 1;
+	else
+		DECREF(index);
+	DECREF(key);
+}
+
 static void
 w_object(v, p)
 	object *v;
 	WFILE *p;
 {
-	int i, n;
+	int i, n, flag;
 	
+	if (p->error == 2)
+		return;
+	if (p->depth > MAX_MARSHAL_DEPTH) {
+		p->error = 2;	/* Too deeply nested */
+		return;
+	}
+	if ((flag = w_ref(v, p)) < 0)
+		return;
+	p->depth++;
 	if (v == NULL)
 		w_byte(TYPE_NULL, p);
 	else if (v == None)
@@ -140,61 +341,73 @@ w_object(v, p)
 	else if (v == Py_Ellipsis)
 	        w_byte(TYPE_ELLIPSIS, p);  
 	else if (is_intobject(v)) {
-		w_byte(TYPE_INT, p);
-		w_long(getintvalue(v), p);
+		long x = getintvalue(v);
+		long y = x >> 31;
+		if (y != 0 && y != -1) {
+			/* Only where a long has more than 32 bits */
+			w_byte(TYPE_INT64, p);
+			w_long(x, p);
+			w_long(y >> 1, p);
+		}
+		else {
+			w_byte(TYPE_INT, p);
+			w_long(x, p);
+		}
 	}
 	else if (is_longobject(v)) {
 		longobject *ob = (longobject *)v;
+		long n15;
+		digit d;
+		int j;
 		w_byte(TYPE_LONG, p);
 		n = ob->ob_size;
-		w_long((long)n, p);
 		if (n < 0)
 			n = -n;
-		for (i = 0; i < n; i++)
-			w_short(ob->ob_digit[i], p);
+		/* Count the 15-bit digits; the top one must be nonzero */
+		n15 = 0;
+		if (n > 0) {
+			n15 = (long)(n-1) * MARSHAL_RATIO;
+			for (d = ob->ob_digit[n-1]; d != 0;
+			     d >>= MARSHAL_SHIFT)
+				n15++;
+		}
+		w_long(ob->ob_size < 0 ? -n15 : n15, p);
+		for (i = 0; i < n; i++) {
+			d = ob->ob_digit[i];
+			for (j = 0; j < MARSHAL_RATIO; j++) {
+				if (i == n-1 && d == 0)
+					break;
+				w_short((int)(d & MARSHAL_MASK), p);
+				d >>= MARSHAL_SHIFT;
+			}
+		}
 	}
 	else if (is_floatobject(v)) {
-		extern void float_buf_repr PROTO((char *, floatobject *));
-		char buf[256]; /* Plenty to format any double */
-		float_buf_repr(buf, (floatobject *)v);
-		n = strlen(buf);
 		w_byte(TYPE_FLOAT, p);
-		w_byte(n, p);
-		w_string(buf, n, p);
+		w_double(getfloatvalue(v), p);
 	}
 #ifndef WITHOUT_COMPLEX
 	else if (is_complexobject(v)) {
-		extern void float_buf_repr PROTO((char *, floatobject *));
-		char buf[256]; /* Plenty to format any double */
-		floatobject *temp;
 		w_byte(TYPE_COMPLEX, p);
-		temp = (floatobject*)newfloatobject(PyComplex_RealAsDouble(v));
-		float_buf_repr(buf, temp);
-		DECREF(temp);
-		n = strlen(buf);
-		w_byte(n, p);
-		w_string(buf, n, p);
-		temp = (floatobject*)newfloatobject(PyComplex_ImagAsDouble(v));
-		float_buf_repr(buf, temp);
-		DECREF(temp);
-		n = strlen(buf);
-		w_byte(n, p);
-		w_string(buf, n, p);
+		w_double(PyComplex_RealAsDouble(v), p);
+		w_double(PyComplex_ImagAsDouble(v), p);
 	}
 #endif
 	else if (is_stringobject(v)) {
-		w_byte(TYPE_STRING, p);
+		w_byte(TYPE_STRING | flag, p);
 		n = getstringsize(v);
 		w_long((long)n, p);
 		w_string(getstringvalue(v), n, p);
 	}
 	else if (is_tupleobject(v)) {
-		w_byte(TYPE_TUPLE, p);
+		w_byte(TYPE_TUPLE | flag, p);
 		n = gettuplesize(v);
 		w_long((long)n, p);
 		for (i = 0; i < n; i++) {
 			w_object(GETTUPLEITEM(v, i), p);
 		}
+		if (flag)
+			w_ref_done(v, p);
 	}
 	else if (is_listobject(v)) {
 		w_byte(TYPE_LIST, p);
@@ -233,6 +446,7 @@ w_object(v, p)
 		w_byte(TYPE_UNKNOWN, p);
 		p->error = 1;
 	}
+	p->depth--;
 }
 
 void
@@ -241,9 +455,10 @@ wr_long(x, fp)
 	FILE *fp;
 {
 	WFILE wf;
-	wf.fp = fp;
-	wf.error = 0;
+	char buf[WBUFSIZE];
+	w_init_file(&wf, fp, buf);
 	w_long(x, &wf);
+	w_flush(&wf);
 }
 
 void
@@ -252,13 +467,18 @@ wr_object(x, fp)
 	FILE *fp;
 {
 	WFILE wf;
-	wf.fp = fp;
-	wf.error = 0;
+	char buf[WBUFSIZE];
+	w_init_file(&wf, fp, buf);
+	wf.version = MARSHAL_VERSION;
 	w_object(x, &wf);
+	w_flush(&wf);
+	XDECREF(wf.refs);
 }
 
 typedef WFILE RFILE; /* Same struct with different invariants */
 
+static object *r_object PROTO((RFILE *));
+
 #define rs_byte(p) (((p)->ptr != (p)->end) ? (unsigned char)*(p)->ptr++ : EOF)
 
 #define r_byte(p) ((p)->fp ? getc((p)->fp) : rs_byte(p))
@@ -283,6 +503,11 @@ r_short(p)
 	RFILE *p;
 {
 	register short x;
+	if (p->fp == NULL && p->end - p->ptr >= 2) {
+		x = (unsigned char)p->ptr[0] | (unsigned char)p->ptr[1] << 8;
+		p->ptr += 2;
+		return x;
+	}
 	x = r_byte(p);
 	x |= r_byte(p) << 8;
 	/* XXX If your short is > 16 bits, add sign-extension here!!! */
@@ -301,23 +526,86 @@ r_long(p)
 		x |= (long)getc(fp) << 16;
 		x |= (long)getc(fp) << 24;
 	}
+	else if (p->end - p->ptr >= 4) {
+		register unsigned char *s = (unsigned char *)p->ptr;
+		x = s[0];
+		x |= (long)s[1] << 8;
+		x |= (long)s[2] << 16;
+		x |= (long)s[3] << 24;
+		p->ptr += 4;
+	}
 	else {
 		x = rs_byte(p);
 		x |= (long)rs_byte(p) << 8;
 		x |= (long)rs_byte(p) << 16;
 		x |= (long)rs_byte(p) << 24;
 	}
-	/* XXX If your long is > 32 bits, add sign-extension here!!! */
+	/* Sign-extend, in case a long is more than 32 bits */
+	x |= -(x & 0x80000000L);
 	return x;
 }
 
+/* Where a long has only 32 bits, a TYPE_INT64 becomes a long int:
+   hi is shifted left by 32 bits and the low 32 bits (lo read as
+   unsigned) are added, 16 bits at a time. */
+
+static object *
+r_int64_long(hi, lo)
+	long hi, lo;
+{
+	object *v, *w, *x;
+	int i;
+	v = newlongobject(hi);
+	for (i = 16; i >= 0 && v != NULL; i -= 16) {
+		w = newlongobject(16L);
+		x = w == NULL ? NULL : PyNumber_Lshift(v, w);
+		XDECREF(w);
+		DECREF(v);
+		if (x == NULL)
+			return NULL;
+		w = newlongobject((lo >> i) & 0xFFFFL);
+		v = w == NULL ? NULL : PyNumber_Or(x, w);
+		XDECREF(w);
+		DECREF(x);
+	}
+	return v;
+}
+
+static object *r_typed_object PROTO((int, RFILE *));
+
 static object *
 r_object(p)
 	RFILE *p;
+{
+	object *v;
+	int index = -1;
+	int type = r_byte(p);
+
+	if (type != EOF && (type & FLAG_REF)) {
+		/* Reserve the object's slot in the reference table
+		   now, as the writer numbered it before its contents */
+		type &= ~FLAG_REF;
+		if (p->refs == NULL && (p->refs = newlistobject(0)) == NULL)
+			return NULL;
+		index = getlistsize(p->refs);
+		if (addlistitem(p->refs, None) != 0)
+			return NULL;
+	}
+	v = r_typed_object(type, p);
+	if (index >= 0 && v != NULL) {
+		INCREF(v);
+		setlistitem(p->refs, index, v);
+	}
+	return v;
+}
+
+static object *
+r_typed_object(type, p)
+	int type;
+	RFILE *p;
 {
 	object *v, *v2;
 	long i, n;
-	int type = r_byte(p);
 	
 	switch (type) {
 	
@@ -325,6 +613,21 @@ r_object(p)
 		err_setstr(EOFError, "EOF read where object expected");
 		return NULL;
 	
+	case TYPE_REF:
+		n = r_long(p);
+		if (p->refs == NULL || n < 0 || n >= getlistsize(p->refs)) {
+			err_setstr(ValueError, "bad marshal data (reference)");
+			return NULL;
+		}
+		v = getlistitem(p->refs, (int)n);
+		if (v == None) {
+			/* Not read yet: it refers to a tuple from inside */
+			err_setstr(ValueError, "bad marshal data (reference)");
+			return NULL;
+		}
+		INCREF(v);
+		return v;
+	
 	case TYPE_NULL:
 		return NULL;
 	
@@ -339,18 +642,35 @@ r_object(p)
 	case TYPE_INT:
 		return newintobject(r_long(p));
 	
+	case TYPE_INT64:
+		{
+			long lo = r_long(p);
+			long hi = r_long(p);
+			if (sizeof(long) > 4)
+				return newintobject((hi << 16 << 16) |
+						    (lo & 0xFFFFFFFFL));
+			return r_int64_long(hi, lo);
+		}
+	
 	case TYPE_LONG:
 		{
 			int size;
+			long n15;
 			longobject *ob;
 			n = r_long(p);
-			size = n<0 ? -n : n;
+			n15 = n<0 ? -n : n;
+			size = (n15 + MARSHAL_RATIO - 1) / MARSHAL_RATIO;
 			ob = alloclongobject(size);
 			if (ob == NULL)
 				return NULL;
-			ob->ob_size = n;
 			for (i = 0; i < size; i++)
-				ob->ob_digit[i] = r_short(p);
+				ob->ob_digit[i] = 0;
+			for (i = 0; i < n15; i++)
+				ob->ob_digit[i / MARSHAL_RATIO] |=
+					(digit)(r_short(p) & MARSHAL_MASK)
+					<< (i % MARSHAL_RATIO * MARSHAL_SHIFT);
+			if (n < 0)
+				ob->ob_size = -size;
 			return (object *)ob;
 		}
 	
@@ -396,6 +716,11 @@ r_object(p)
 	
 	case TYPE_STRING:
 		n = r_long(p);
+		if (p->fp == NULL && (n < 0 || n > p->end - p->ptr)) {
+			/* Don't allocate more than can be there */
+			err_setstr(EOFError, "EOF read where object expected");
+			return NULL;
+		}
 		v = newsizedstringobject((char *)NULL, n);
 		if (v != NULL) {
 			if (r_string(getstringvalue(v), (int)n, p) != n) {
@@ -502,6 +827,20 @@ r_object(p)
 	}
 }
 
+/* Read a complete object; references only refer back within one */
+
+static object *
+r_whole_object(p)
+	RFILE *p;
+{
+	object *v;
+	p->refs = NULL;
+	v = r_object(p);
+	XDECREF(p->refs);
+	p->refs = NULL;
+	return v;
+}
+
 long
 rd_long(fp)
 	FILE *fp;
@@ -522,7 +861,7 @@ rd_object(fp)
 		return NULL;
 	}
 	rf.fp = fp;
-	return r_object(&rf);
+	return r_whole_object(&rf);
 }
 
 object *
@@ -539,12 +878,57 @@ rds_object(str, len)
 	rf.str = NULL;
 	rf.ptr = str;
 	rf.end = str + len;
-	return r_object(&rf);
+	return r_whole_object(&rf);
 }
 
+/* Read an object from the rest of a file.  A regular file with at
+   least MMAP_THRESHOLD bytes left is mapped privately into memory and
+   read with the string reader, which copies string data (e.g. the
+   bytecode) in one go instead of calling getc() for every byte; the
+   private mapping keeps later writes to the file by other processes
+   from showing through.  Anything else is read with stdio.  Afterwards
+   fp is positioned after the object. */
+
 object *
-PyMarshal_WriteObjectToString(x) /* wrs_object() */
+PyMarshal_ReadObjectFromMappedFile(fp)
+	FILE *fp;
+{
+#ifdef USE_MMAP
+	struct stat st;
+	long pos;
+	char *map;
+	RFILE rf;
+	object *v;
+
+	if (err_occurred()) {
+		fprintf(stderr, "XXX rd_object called with exception set\n");
+		return NULL;
+	}
+	if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (pos = ftell(fp)) < 0 || st.st_size - pos < MMAP_THRESHOLD ||
+	    st.st_size != (off_t)(int)st.st_size)
+		return rd_object(fp);
+	map = (char *) mmap(0, (size_t)st.st_size, PROT_READ,
+			    MAP_PRIVATE, fileno(fp), (off_t)0);
+	if (map == (char *)MAP_FAILED)
+		return rd_object(fp);
+	rf.fp = NULL;
+	rf.str = NULL;
+	rf.ptr = map + pos;
+	rf.end = map + st.st_size;
+	v = r_whole_object(&rf);
+	fseek(fp, (long)(rf.ptr - map), 0);
+	munmap(map, (size_t)st.st_size);
+	return v;
+#else
+	return rd_object(fp);
+#endif
+}
+
+static object *
+w_to_string(x, version)
 	object *x;
+	int version;
 {
 	WFILE wf;
 	wf.fp = NULL;
@@ -554,18 +938,31 @@ PyMarshal_WriteObjectToString(x) /* wrs_object() */
 	wf.ptr = GETSTRINGVALUE((stringobject *)wf.str);
 	wf.end = wf.ptr + getstringsize(wf.str);
 	wf.error = 0;
+	wf.version = version;
+	wf.refs = NULL;
+	wf.depth = 0;
 	w_object(x, &wf);
+	XDECREF(wf.refs);
 	if (wf.str != NULL)
 		resizestring(&wf.str,
 		    (int) (wf.ptr - GETSTRINGVALUE((stringobject *)wf.str)));
 	if (wf.error) {
 		XDECREF(wf.str);
-		err_setstr(ValueError, "unmarshallable object");
+		err_setstr(ValueError, wf.error == 2 ?
+			   "object too deeply nested to marshal" :
+			   "unmarshallable object");
 		return NULL;
 	}
 	return wf.str;
 }
 
+object *
+PyMarshal_WriteObjectToString(x) /* wrs_object() */
+	object *x;
+{
+	return w_to_string(x, 0);
+}
+
 /* And an interface for Python programs... */
 
 static object *
@@ -574,21 +971,25 @@ marshal_dump(self, args)
 	object *args;
 {
 	WFILE wf;
+	char buf[WBUFSIZE];
 	object *x;
 	object *f;
-	if (!getargs(args, "(OO)", &x, &f))
+	int version = 0;
+	if (!newgetargs(args, "OO|i:dump", &x, &f, &version))
 		return NULL;
 	if (!is_fileobject(f)) {
 		err_setstr(TypeError, "marshal.dump() 2nd arg must be file");
 		return NULL;
 	}
-	wf.fp = getfilefile(f);
-	wf.str = NULL;
-	wf.ptr = wf.end = NULL;
-	wf.error = 0;
+	w_init_file(&wf, getfilefile(f), buf);
+	wf.version = version;
 	w_object(x, &wf);
+	w_flush(&wf);
+	XDECREF(wf.refs);
 	if (wf.error) {
-		err_setstr(ValueError, "unmarshallable object");
+		err_setstr(ValueError, wf.error == 2 ?
+			   "object too deeply nested to marshal" :
+			   "unmarshallable object");
 		return NULL;
 	}
 	INCREF(None);
@@ -600,7 +1001,6 @@ marshal_load(self, args)
 	object *self;
 	object *args;
 {
-	RFILE rf;
 	object *f;
 	object *v;
 	if (!getargs(args, "O", &f))
@@ -609,11 +1009,10 @@ marshal_load(self, args)
 		err_setstr(TypeError, "marshal.load() arg must be file");
 		return NULL;
 	}
-	rf.fp = getfilefile(f);
-	rf.str = NULL;
-	rf.ptr = rf.end = NULL;
 	err_clear();
-	v = r_object(&rf);
+	/* Regular files are read through a mapping, much faster than
+	   with getc() */
+	v = PyMarshal_ReadObjectFromMappedFile(getfilefile(f));
 	if (err_occurred()) {
 		XDECREF(v);
 		v = NULL;
@@ -627,9 +1026,10 @@ marshal_dumps(self, args)
 	object *args;
 {
 	object *x;
-	if (!getargs(args, "O", &x))
+	int version = 0;
+	if (!newgetargs(args, "O|i:dumps", &x, &version))
 		return NULL;
-	return PyMarshal_WriteObjectToString(x);
+	return w_to_string(x, version);
 }
 
 static object *
@@ -648,7 +1048,7 @@ marshal_loads(self, args)
 	rf.ptr = s;
 	rf.end = s + n;
 	err_clear();
-	v = r_object(&rf);
+	v = r_whole_object(&rf);
 	if (err_occurred()) {
 		XDECREF(v);
 		v = NULL;
@@ -657,9 +1057,9 @@ marshal_loads(self, args)
 }
 
 static struct methodlist marshal_methods[] = {
-	{"dump",	marshal_dump},
+	{"dump",	marshal_dump,	1},
 	{"load",	marshal_load},
-	{"dumps",	marshal_dumps},
+	{"dumps",	marshal_dumps,	1},
 	{"loads",	marshal_loads},
 	{NULL,		NULL}		/* sentinel */
 };
@@ -667,5 +1067,11 @@ static struct methodlist marshal_methods[] = {
 void
 initmarshal()
 {
-	(void) initmodule("marshal", marshal_methods);
+	object *m, *d, *v;
+	m = initmodule("marshal", marshal_methods);
+	d = getmoduledict(m);
+	v = newintobject((long)MARSHAL_VERSION);
+	if (v == NULL || dictinsert(d, "version", v) != 0)
+		fatal("can't initialize marshal module");
+	DECREF(v);
 }
@@ -10,18 +10,39 @@ PyMutex * _Py_RefMutex;
 PyMutex * _Py_ListMutex;
 PyMutex * _Py_MappingMutex;
 PyMutex * _Py_CritMutex;
+PyMutex * _Py_IntMutex;
+PyMutex * _Py_FloatMutex;
+PyMutex * _Py_TupleMutex;
+PyMutex * _Py_FrameMutex;
+PyMutex * _Py_AttrMutex;
+PyMutex * _Py_PendingMutex;
+PyMutex * _Py_ImportMutex;
+PyMutex * _Py_TraceMutex;
+
+struct _Py_NamedMutex _Py_NamedMutexes[] = {
+    { "ref",		&_Py_RefMutex },
+    { "list",		&_Py_ListMutex },
+    { "mapping",	&_Py_MappingMutex },
+    { "crit",		&_Py_CritMutex },
+    { "int",		&_Py_IntMutex },
+    { "float",		&_Py_FloatMutex },
+    { "tuple",		&_Py_TupleMutex },
+    { "frame",		&_Py_FrameMutex },
+    { "attr",		&_Py_AttrMutex },
+    { "pending",	&_Py_PendingMutex },
+    { "import",		&_Py_ImportMutex },
+    { "trace",		&_Py_TraceMutex },
+    { NULL,		NULL }
+};
 
 
 void PyMutex_Init()
 {
-    _Py_RefMutex = PyMutex_New();
-    _Py_ListMutex = PyMutex_New();
-    _Py_MappingMutex = PyMutex_New();
-    _Py_CritMutex = PyMutex_New();
-
-    if ( !_Py_RefMutex || !_Py_ListMutex ||
-	 !_Py_MappingMutex || !_Py_CritMutex )
-	Py_FatalError("could not allocate mutexes");
+    struct _Py_NamedMutex *nm;
+
+    for ( nm = _Py_NamedMutexes; nm->name; ++nm )
+	if ( !(*nm->mutex = PyMutex_New()) )
+	    Py_FatalError("could not allocate mutexes");
 }
 
 PyMutex * PyMutex_New()
@@ -43,6 +64,13 @@ void PyMutex_Free(pm)
     free(pm);
 }
 
+int PyMutex_Stats(pm, stats)
+    PyMutex *pm;
+    long *stats;
+{
+    return _PYMUTEX_STATS(pm, stats);
+}
+
 #ifdef _Py_NEED_SAFE_FUNCS
 
 /*
@@ -72,4 +100,30 @@ int _Py_SafeDecr(pint)
 
 #endif /* _Py_NEED_SAFE_FUNCS */
 
+#ifdef _Py_NEED_ATOMIC_FUNCS
+
+int _Py_AtomicCAS(p, old, new)
+    long *p;
+    long old;
+    long new;
+{
+    int result;
+
+    PyMutex_Lock(_Py_RefMutex);
+    result = *p == old;
+    if ( result )
+	*p = new;
+    PyMutex_Unlock(_Py_RefMutex);
+    return result;
+}
+
+void _Py_MemoryBarrier()
+{
+    /* locking and unlocking a mutex is a barrier */
+    PyMutex_Lock(_Py_RefMutex);
+    PyMutex_Unlock(_Py_RefMutex);
+}
+
+#endif /* _Py_NEED_ATOMIC_FUNCS */
+
 #endif /* WITH_FREE_THREAD */
@@ -120,9 +120,9 @@ sys_settrace(self, args)
 
 	/* if another thread is starting and this thread is the main thread,
 	   then it might read this data. Guard with a lock. */
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_TraceMutex);
 	pts->sys_tracefunc = args;
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_TraceMutex);
 
 	XDECREF(old);
 
@@ -145,9 +145,9 @@ sys_setprofile(self, args)
 
 	/* if another thread is starting and this thread is the main thread,
 	   then it might read this data. Guard with a lock. */
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_TraceMutex);
 	pts->sys_profilefunc = args;
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_TraceMutex);
 
 	XDECREF(old);
 
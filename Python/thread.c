@@ -46,6 +46,7 @@ extern char *getenv();
 #endif
 
 #include "thread.h"
+#include "pyfutex.h"
 
 #ifdef __ksr__
 #define _POSIX_THREADS
@@ -72,11 +73,13 @@ extern char *getenv();
 #define _P0()			(void)
 #define _P1(v,t)		(t)
 #define _P2(v1,t1,v2,t2)	(t1,t2)
+#define _P3(v1,t1,v2,t2,v3,t3)	(t1,t2,t3)
 #else
 #define _P(args)		()
 #define _P0()			()
 #define _P1(v,t)		(v) t;
 #define _P2(v1,t1,v2,t2)	(v1,v2) t1; t2;
+#define _P3(v1,t1,v2,t2,v3,t3)	(v1,v2,v3) t1; t2; t3;
 #endif /* __STDC__ */
 
 #ifdef DEBUG
@@ -111,6 +114,103 @@ void init_thread _P0()
 	_init_thread();
 }
 
+#ifdef Py_FUTEX_LOCKS
+
+/* The slow paths of the futex locks in pyfutex.h.  This is the third
+   mutex of Ulrich Drepper's "Futexes Are Tricky", with a spin in front
+   whose length adapts to each lock, as in glibc's adaptive mutexes:
+   a lock whose holders usually let go quickly is spun on for longer. */
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef FUTEX_PRIVATE_FLAG
+#define FUTEX_PRIVATE_FLAG 0
+#endif
+
+#define SPIN_MIN	10
+#define SPIN_MAX	200
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()	__asm__ __volatile__("pause" : : : "memory")
+#else
+#define cpu_relax()	__sync_synchronize()
+#endif
+
+static int spin_max = -1;	/* Stays 0 on a single processor */
+
+int _PyFutex_Lock _P2(f, PyFutex *f, microseconds, long microseconds)
+{
+	struct timeval now, deadline;
+	struct timespec ts;
+	int i, max, sleeps = 0;
+
+	if (spin_max < 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		spin_max = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_MAX : 0;
+#else
+		spin_max = SPIN_MAX;
+#endif
+	}
+	max = f->f_spin * 2 + SPIN_MIN;
+	if (max > spin_max)
+		max = spin_max;
+	for (i = 0; i < max; i++) {
+		cpu_relax();
+		if (f->f_state == 0 &&
+		    __sync_bool_compare_and_swap(&f->f_state, 0, 1))
+			goto acquired;
+	}
+
+	if (microseconds > 0) {
+		gettimeofday(&deadline, (struct timezone *)0);
+		deadline.tv_sec += microseconds / 1000000;
+		deadline.tv_usec += microseconds % 1000000;
+		if (deadline.tv_usec >= 1000000) {
+			deadline.tv_sec++;
+			deadline.tv_usec -= 1000000;
+		}
+	}
+	/* Mark the lock as waited for, so that it is released with a
+	   wakeup; if it was free, we have it */
+	while (__sync_lock_test_and_set(&f->f_state, 2) != 0) {
+		if (microseconds > 0) {
+			gettimeofday(&now, (struct timezone *)0);
+			ts.tv_sec = deadline.tv_sec - now.tv_sec;
+			ts.tv_nsec = (deadline.tv_usec - now.tv_usec) * 1000;
+			if (ts.tv_nsec < 0) {
+				ts.tv_sec--;
+				ts.tv_nsec += 1000000000;
+			}
+			if (ts.tv_sec < 0)
+				return 0;
+		}
+		syscall(SYS_futex, &f->f_state, FUTEX_WAIT | FUTEX_PRIVATE_FLAG,
+			2, microseconds > 0 ? &ts : (struct timespec *)0,
+			(int *)0, 0);
+		sleeps++;
+	}
+
+  acquired:
+	f->f_spin += (i - f->f_spin) / 8;
+	f->f_locks++;
+	f->f_contended++;
+	f->f_sleeps += sleeps;
+	return 1;
+}
+
+void _PyFutex_Wake _P1(f, PyFutex *f)
+{
+	__sync_lock_release(&f->f_state);
+	syscall(SYS_futex, &f->f_state, FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+		1, (struct timespec *)0, (int *)0, 0);
+}
+
+#endif /* Py_FUTEX_LOCKS */
+
 #ifdef SGI_THREADS
 #include "thread_sgi.h"
 #endif
@@ -140,3 +240,176 @@ void init_thread _P0()
 #include "thread_foobar.h"
 #endif
 */
+
+#ifndef TIMED_LOCKS
+
+/* For systems that can't wait for a lock or semaphore with a timeout:
+   poll, with sleeps that double up to 20 msec.  Without select() to
+   sleep with, the lock is tried only once. */
+
+#ifdef HAVE_SELECT
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#endif
+
+static int poll_timed _P3(try, int (*try) _P((void *)), obj, void *obj, microseconds, long microseconds)
+{
+#ifdef HAVE_SELECT
+	struct timeval t;
+	long delay = 1000;
+#endif
+
+	if ((*try)(obj))
+		return 1;
+#ifdef HAVE_SELECT
+	while (microseconds > 0) {
+		if (delay > microseconds)
+			delay = microseconds;
+		t.tv_sec = delay / 1000000;
+		t.tv_usec = delay % 1000000;
+		(void) select(0, (fd_set *)0, (fd_set *)0, (fd_set *)0, &t);
+		microseconds -= delay;
+		if ((*try)(obj))
+			return 1;
+		if (delay < 20000)
+			delay *= 2;
+	}
+#endif
+	return 0;
+}
+
+static int try_lock _P1(obj, void *obj)
+{
+	return acquire_lock((type_lock) obj, NOWAIT_LOCK);
+}
+
+static int try_sema _P1(obj, void *obj)
+{
+	return down_sema((type_sema) obj, NOWAIT_SEMA);
+}
+
+int acquire_lock_timed _P2(lock, type_lock lock, microseconds, long microseconds)
+{
+	if (microseconds < 0)
+		return acquire_lock(lock, WAIT_LOCK);
+	return poll_timed(try_lock, (void *) lock, microseconds);
+}
+
+int down_sema_timed _P2(sema, type_sema sema, microseconds, long microseconds)
+{
+	if (microseconds < 0)
+		return down_sema(sema, WAIT_SEMA);
+	return poll_timed(try_sema, (void *) sema, microseconds);
+}
+
+#endif /* !TIMED_LOCKS */
+
+#ifndef LOCK_STATS
+
+/* Locks without counters */
+
+int lock_stats _P2(lock, type_lock lock, stats, long *stats)
+{
+	return 0;
+}
+
+#endif /* !LOCK_STATS */
+
+#ifndef RWLOCKS
+
+/* Reader-writer locks from two plain locks: the first reader takes
+   the writers' lock on behalf of all readers, and the last one
+   releases it.  Unlike the pthread version, writers can be kept
+   waiting by a stream of readers.  The first reader waits for a
+   writer with the mutex held, so a writer releases without it. */
+
+typedef struct {
+	type_lock	mutex;		/* Protects readers */
+	type_lock	wlock;		/* Held by a writer or the readers */
+	int		readers;
+	int		writer;		/* Set by the writer holding wlock */
+} rwlock;
+
+type_rwlock allocate_rwlock _P0()
+{
+	rwlock *rw;
+
+	dprintf(("allocate_rwlock called\n"));
+	rw = (rwlock *) malloc(sizeof(rwlock));
+	if (rw) {
+		rw->readers = 0;
+		rw->writer = 0;
+		rw->mutex = allocate_lock();
+		rw->wlock = allocate_lock();
+		if (rw->mutex == 0 || rw->wlock == 0) {
+			if (rw->mutex)
+				free_lock(rw->mutex);
+			if (rw->wlock)
+				free_lock(rw->wlock);
+			free((void *)rw);
+			rw = 0;
+		}
+	}
+	dprintf(("allocate_rwlock() -> %lx\n", (long)rw));
+	return (type_rwlock) rw;
+}
+
+void free_rwlock _P1(lock, type_rwlock lock)
+{
+	rwlock *rw = (rwlock *)lock;
+
+	dprintf(("free_rwlock(%lx) called\n", (long)lock));
+	free_lock(rw->mutex);
+	free_lock(rw->wlock);
+	free((void *)rw);
+}
+
+int acquire_rwlock _P3(lock, type_rwlock lock, writer, int writer, microseconds, long microseconds)
+{
+	rwlock *rw = (rwlock *)lock;
+	int success;
+
+	dprintf(("acquire_rwlock(%lx, %d, %ld) called\n", (long)lock, writer, microseconds));
+	if (writer) {
+		if (!acquire_lock_timed(rw->wlock, microseconds))
+			return 0;
+		rw->writer = 1;
+		return 1;
+	}
+	if (!acquire_lock_timed(rw->mutex, microseconds))
+		return 0;
+	success = rw->readers > 0 ||
+		acquire_lock_timed(rw->wlock, microseconds);
+	if (success)
+		rw->readers++;
+	release_lock(rw->mutex);
+	return success;
+}
+
+int release_rwlock _P1(lock, type_rwlock lock)
+{
+	rwlock *rw = (rwlock *)lock;
+	int success = 1;
+
+	dprintf(("release_rwlock(%lx) called\n", (long)lock));
+	if (rw->writer) {
+		rw->writer = 0;
+		release_lock(rw->wlock);
+		return 1;
+	}
+	acquire_lock(rw->mutex, WAIT_LOCK);
+	if (rw->readers > 0) {
+		if (--rw->readers == 0)
+			release_lock(rw->wlock);
+	}
+	else
+		success = 0;	/* Nobody holds it */
+	release_lock(rw->mutex);
+	return success;
+}
+
+#endif /* !RWLOCKS */
@@ -33,6 +33,8 @@ PERFORMANCE OF THIS SOFTWARE.
 
 #include <stdlib.h>
 #include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #ifdef _AIX
 
@@ -53,6 +55,8 @@ PERFORMANCE OF THIS SOFTWARE.
 #define pthread_condattr_default ((pthread_condattr_t *)0)
 #endif
 
+#ifndef Py_FUTEX_LOCKS
+
 /* A pthread mutex isn't sufficient to model the Python lock type
  * because, according to Draft 5 of the docs (P1003.4a/D5), both of the
  * following are undefined:
@@ -73,8 +77,14 @@ typedef struct {
 	/* a <cond, mutex> pair to handle an acquire of a locked lock */
 	pthread_cond_t   lock_released;
 	pthread_mutex_t  mut;
+	/* counters for lock_stats(), protected by mut */
+	long             locks;
+	long             contended;
+	long             sleeps;
 } pthread_lock;
 
+#endif /* !Py_FUTEX_LOCKS */
+
 #define CHECK_STATUS(name)  if (status < 0) { perror(name); error=1; }
 
 /*
@@ -155,7 +165,96 @@ void _exit_prog _P1(status, int status)
 
 /*
  * Lock support.
+ * Where there are futexes, a lock is a PyFutex (see pyfutex.h), which
+ * only enters the kernel when threads have to wait for each other.
+ * Acquiring with a timeout gives up after a number of microseconds; a
+ * negative number waits forever.
  */
+
+/* Turn a timeout into the absolute time pthread_cond_timedwait() wants */
+static void abs_timeout _P2(microseconds, long microseconds, ts, struct timespec *ts)
+{
+	struct timeval now;
+
+	gettimeofday(&now, (struct timezone *)0);
+	now.tv_sec += microseconds / 1000000;
+	now.tv_usec += microseconds % 1000000;
+	if (now.tv_usec >= 1000000) {
+		now.tv_sec++;
+		now.tv_usec -= 1000000;
+	}
+	ts->tv_sec = now.tv_sec;
+	ts->tv_nsec = now.tv_usec * 1000;
+}
+
+#ifdef Py_FUTEX_LOCKS
+
+type_lock allocate_lock _P0()
+{
+	PyFutex *lock;
+
+	dprintf(("allocate_lock called\n"));
+	if (!initialized)
+		init_thread();
+
+	lock = (PyFutex *) malloc(sizeof(PyFutex));
+	if (lock)
+		PyFutex_INIT(lock);
+
+	dprintf(("allocate_lock() -> %lx\n", (long)lock));
+	return (type_lock) lock;
+}
+
+void free_lock _P1(lock, type_lock lock)
+{
+	dprintf(("free_lock(%lx) called\n", (long)lock));
+	free((void *)lock);
+}
+
+int acquire_lock _P2(lock, type_lock lock, waitflag, int waitflag)
+{
+	PyFutex *thelock = (PyFutex *)lock;
+	int success;
+
+	dprintf(("acquire_lock(%lx, %d) called\n", (long)lock, waitflag));
+	success = PyFutex_LockTimed(thelock, waitflag ? -1L : 0L);
+	dprintf(("acquire_lock(%lx, %d) -> %d\n", (long)lock, waitflag, success));
+	return success;
+}
+
+void release_lock _P1(lock, type_lock lock)
+{
+	dprintf(("release_lock(%lx) called\n", (long)lock));
+	PyFutex_Unlock((PyFutex *)lock);
+}
+
+#define TIMED_LOCKS
+
+int acquire_lock_timed _P2(lock, type_lock lock, microseconds, long microseconds)
+{
+	PyFutex *thelock = (PyFutex *)lock;
+	int success;
+
+	dprintf(("acquire_lock_timed(%lx, %ld) called\n", (long)lock, microseconds));
+	success = PyFutex_LockTimed(thelock, microseconds);
+	dprintf(("acquire_lock_timed(%lx, %ld) -> %d\n", (long)lock, microseconds, success));
+	return success;
+}
+
+#define LOCK_STATS
+
+int lock_stats _P2(lock, type_lock lock, stats, long *stats)
+{
+	PyFutex *thelock = (PyFutex *)lock;
+
+	stats[0] = thelock->f_locks;
+	stats[1] = thelock->f_contended;
+	stats[2] = thelock->f_sleeps;
+	return 1;
+}
+
+#else /* !Py_FUTEX_LOCKS */
+
 type_lock allocate_lock _P0()
 {
 	pthread_lock *lock;
@@ -168,6 +267,7 @@ type_lock allocate_lock _P0()
 	lock = (pthread_lock *) malloc(sizeof(pthread_lock));
 	if (lock) {
 		lock->locked = 0;
+		lock->locks = lock->contended = lock->sleeps = 0;
 
 		status = pthread_mutex_init(&lock->mut,
 					    pthread_mutexattr_default);
@@ -214,7 +314,10 @@ int acquire_lock _P2(lock, type_lock lock, waitflag, int waitflag)
 	status = pthread_mutex_lock( &thelock->mut );
 	CHECK_STATUS("pthread_mutex_lock[1]");
 	success = thelock->locked == 0;
-	if (success) thelock->locked = 1;
+	if (success) {
+		thelock->locked = 1;
+		thelock->locks++;
+	}
 	status = pthread_mutex_unlock( &thelock->mut );
 	CHECK_STATUS("pthread_mutex_unlock[1]");
 
@@ -229,8 +332,11 @@ int acquire_lock _P2(lock, type_lock lock, waitflag, int waitflag)
 			status = pthread_cond_wait(&thelock->lock_released,
 						   &thelock->mut);
 			CHECK_STATUS("pthread_cond_wait");
+			thelock->sleeps++;
 		}
 		thelock->locked = 1;
+		thelock->locks++;
+		thelock->contended++;
 		status = pthread_mutex_unlock( &thelock->mut );
 		CHECK_STATUS("pthread_mutex_unlock[2]");
 		success = 1;
@@ -260,35 +366,352 @@ void release_lock _P1(lock, type_lock lock)
 	CHECK_STATUS("pthread_cond_signal");
 }
 
+#define TIMED_LOCKS
+
+int acquire_lock_timed _P2(lock, type_lock lock, microseconds, long microseconds)
+{
+	int success;
+	pthread_lock *thelock = (pthread_lock *)lock;
+	struct timespec deadline;
+	int status, error = 0;
+
+	dprintf(("acquire_lock_timed(%lx, %ld) called\n", (long)lock, microseconds));
+
+	if (microseconds <= 0)
+		return acquire_lock(lock, microseconds < 0);
+	abs_timeout(microseconds, &deadline);
+
+	status = pthread_mutex_lock( &thelock->mut );
+	CHECK_STATUS("pthread_mutex_lock[4]");
+	success = thelock->locked == 0;
+	while ( thelock->locked ) {
+		status = pthread_cond_timedwait(&thelock->lock_released,
+						&thelock->mut, &deadline);
+		thelock->sleeps++;
+		if (status == ETIMEDOUT)
+			break;
+	}
+	if (!thelock->locked) {
+		thelock->locked = 1;
+		thelock->locks++;
+		if (!success)
+			thelock->contended++;
+		success = 1;
+	}
+	status = pthread_mutex_unlock( &thelock->mut );
+	CHECK_STATUS("pthread_mutex_unlock[4]");
+
+	if (error) success = 0;
+	dprintf(("acquire_lock_timed(%lx, %ld) -> %d\n", (long)lock, microseconds, success));
+	return success;
+}
+
+#define LOCK_STATS
+
+int lock_stats _P2(lock, type_lock lock, stats, long *stats)
+{
+	pthread_lock *thelock = (pthread_lock *)lock;
+	int status, error = 0;
+
+	status = pthread_mutex_lock( &thelock->mut );
+	CHECK_STATUS("pthread_mutex_lock[5]");
+	stats[0] = thelock->locks;
+	stats[1] = thelock->contended;
+	stats[2] = thelock->sleeps;
+	status = pthread_mutex_unlock( &thelock->mut );
+	CHECK_STATUS("pthread_mutex_unlock[5]");
+	return !error;
+}
+
+#endif /* !Py_FUTEX_LOCKS */
+
+
 /*
  * Semaphore support.
+ * A counter with a <cond, mutex> pair, like the locks above.
  */
-/* NOTE: 100% non-functional at this time - tim */
+
+typedef struct {
+	int              value;
+	pthread_cond_t   cond;
+	pthread_mutex_t  mut;
+} pthread_sema;
 
 type_sema allocate_sema _P1(value, int value)
 {
-	char *sema = 0;
+	pthread_sema *sema;
+	int status, error = 0;
+
 	dprintf(("allocate_sema called\n"));
 	if (!initialized)
 		init_thread();
 
+	sema = (pthread_sema *) malloc(sizeof(pthread_sema));
+	if (sema) {
+		sema->value = value;
+
+		status = pthread_mutex_init(&sema->mut,
+					    pthread_mutexattr_default);
+		CHECK_STATUS("pthread_mutex_init");
+
+		status = pthread_cond_init(&sema->cond,
+					   pthread_condattr_default);
+		CHECK_STATUS("pthread_cond_init");
+
+		if (error) {
+			free((void *)sema);
+			sema = 0;
+		}
+	}
+
 	dprintf(("allocate_sema() -> %lx\n", (long) sema));
 	return (type_sema) sema;
 }
 
 void free_sema _P1(sema, type_sema sema)
 {
+	pthread_sema *thesema = (pthread_sema *)sema;
+	int status, error = 0;
+
 	dprintf(("free_sema(%lx) called\n", (long) sema));
+
+	status = pthread_mutex_destroy( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_destroy");
+
+	status = pthread_cond_destroy( &thesema->cond );
+	CHECK_STATUS("pthread_cond_destroy");
+
+	free((void *)thesema);
 }
 
 int down_sema _P2(sema, type_sema sema, waitflag, int waitflag)
 {
+	pthread_sema *thesema = (pthread_sema *)sema;
+	int success;
+	int status, error = 0;
+
 	dprintf(("down_sema(%lx, %d) called\n", (long) sema, waitflag));
-	dprintf(("down_sema(%lx) return\n", (long) sema));
-	return -1;
+
+	status = pthread_mutex_lock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_lock");
+	if (waitflag) {
+		while ( thesema->value <= 0 ) {
+			status = pthread_cond_wait(&thesema->cond,
+						   &thesema->mut);
+			CHECK_STATUS("pthread_cond_wait");
+		}
+	}
+	success = thesema->value > 0;
+	if (success) thesema->value--;
+	status = pthread_mutex_unlock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_unlock");
+
+	if (error) success = 0;
+	dprintf(("down_sema(%lx) return %d\n", (long) sema, success));
+	return success;
+}
+
+int down_sema_timed _P2(sema, type_sema sema, microseconds, long microseconds)
+{
+	pthread_sema *thesema = (pthread_sema *)sema;
+	struct timespec deadline;
+	int success;
+	int status, error = 0;
+
+	dprintf(("down_sema_timed(%lx, %ld) called\n", (long) sema, microseconds));
+
+	if (microseconds <= 0)
+		return down_sema(sema, microseconds < 0);
+	abs_timeout(microseconds, &deadline);
+
+	status = pthread_mutex_lock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_lock");
+	while ( thesema->value <= 0 ) {
+		status = pthread_cond_timedwait(&thesema->cond,
+						&thesema->mut, &deadline);
+		if (status == ETIMEDOUT)
+			break;
+	}
+	success = thesema->value > 0;
+	if (success) thesema->value--;
+	status = pthread_mutex_unlock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_unlock");
+
+	if (error) success = 0;
+	dprintf(("down_sema_timed(%lx) return %d\n", (long) sema, success));
+	return success;
 }
 
 void up_sema _P1(sema, type_sema sema)
 {
+	pthread_sema *thesema = (pthread_sema *)sema;
+	int status, error = 0;
+
 	dprintf(("up_sema(%lx)\n", (long) sema));
+
+	status = pthread_mutex_lock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_lock");
+
+	thesema->value++;
+
+	status = pthread_mutex_unlock( &thesema->mut );
+	CHECK_STATUS("pthread_mutex_unlock");
+
+	status = pthread_cond_signal( &thesema->cond );
+	CHECK_STATUS("pthread_cond_signal");
+}
+
+/*
+ * Reader-writer lock support.
+ * Any number of readers or one writer; readers wait while a writer is
+ * waiting, so that writers aren't kept out by a stream of readers.
+ */
+#define RWLOCKS
+
+typedef struct {
+	int              readers;	/* Number of readers holding it */
+	char             writer;	/* 1 if a writer holds it */
+	int              waiting;	/* Number of writers waiting */
+	pthread_cond_t   readable;
+	pthread_cond_t   writable;
+	pthread_mutex_t  mut;
+} pthread_rwlk;
+
+type_rwlock allocate_rwlock _P0()
+{
+	pthread_rwlk *rw;
+	int status, error = 0;
+
+	dprintf(("allocate_rwlock called\n"));
+	if (!initialized)
+		init_thread();
+
+	rw = (pthread_rwlk *) malloc(sizeof(pthread_rwlk));
+	if (rw) {
+		rw->readers = 0;
+		rw->writer = 0;
+		rw->waiting = 0;
+
+		status = pthread_mutex_init(&rw->mut,
+					    pthread_mutexattr_default);
+		CHECK_STATUS("pthread_mutex_init");
+
+		status = pthread_cond_init(&rw->readable,
+					   pthread_condattr_default);
+		CHECK_STATUS("pthread_cond_init");
+
+		status = pthread_cond_init(&rw->writable,
+					   pthread_condattr_default);
+		CHECK_STATUS("pthread_cond_init");
+
+		if (error) {
+			free((void *)rw);
+			rw = 0;
+		}
+	}
+
+	dprintf(("allocate_rwlock() -> %lx\n", (long)rw));
+	return (type_rwlock) rw;
+}
+
+void free_rwlock _P1(lock, type_rwlock lock)
+{
+	pthread_rwlk *rw = (pthread_rwlk *)lock;
+	int status, error = 0;
+
+	dprintf(("free_rwlock(%lx) called\n", (long)lock));
+
+	status = pthread_mutex_destroy( &rw->mut );
+	CHECK_STATUS("pthread_mutex_destroy");
+
+	status = pthread_cond_destroy( &rw->readable );
+	CHECK_STATUS("pthread_cond_destroy");
+
+	status = pthread_cond_destroy( &rw->writable );
+	CHECK_STATUS("pthread_cond_destroy");
+
+	free((void *)rw);
+}
+
+int acquire_rwlock _P3(lock, type_rwlock lock, writer, int writer, microseconds, long microseconds)
+{
+	pthread_rwlk *rw = (pthread_rwlk *)lock;
+	struct timespec deadline;
+	pthread_cond_t *cond;
+	int success;
+	int status, error = 0;
+
+	dprintf(("acquire_rwlock(%lx, %d, %ld) called\n", (long)lock, writer, microseconds));
+
+	if (microseconds > 0)
+		abs_timeout(microseconds, &deadline);
+	cond = writer ? &rw->writable : &rw->readable;
+
+	status = pthread_mutex_lock( &rw->mut );
+	CHECK_STATUS("pthread_mutex_lock");
+	if (writer)
+		rw->waiting++;
+	for (;;) {
+		if (writer)
+			success = !rw->writer && rw->readers == 0;
+		else
+			success = !rw->writer && rw->waiting == 0;
+		if (success || microseconds == 0)
+			break;
+		if (microseconds < 0) {
+			status = pthread_cond_wait(cond, &rw->mut);
+			CHECK_STATUS("pthread_cond_wait");
+		}
+		else if (pthread_cond_timedwait(cond, &rw->mut,
+						&deadline) == ETIMEDOUT)
+			microseconds = 0;	/* One last look */
+	}
+	if (writer) {
+		rw->waiting--;
+		if (success)
+			rw->writer = 1;
+		else if (rw->waiting == 0 && !rw->writer) {
+			/* Readers were waiting for this writer */
+			status = pthread_cond_broadcast( &rw->readable );
+			CHECK_STATUS("pthread_cond_broadcast");
+		}
+	}
+	else if (success)
+		rw->readers++;
+	status = pthread_mutex_unlock( &rw->mut );
+	CHECK_STATUS("pthread_mutex_unlock");
+
+	if (error) success = 0;
+	dprintf(("acquire_rwlock(%lx) -> %d\n", (long)lock, success));
+	return success;
+}
+
+int release_rwlock _P1(lock, type_rwlock lock)
+{
+	pthread_rwlk *rw = (pthread_rwlk *)lock;
+	int success = 1;
+	int status, error = 0;
+
+	dprintf(("release_rwlock(%lx) called\n", (long)lock));
+
+	status = pthread_mutex_lock( &rw->mut );
+	CHECK_STATUS("pthread_mutex_lock");
+
+	if (rw->writer)
+		rw->writer = 0;
+	else if (rw->readers > 0)
+		rw->readers--;
+	else
+		success = 0;	/* Nobody holds it */
+	if (success && rw->readers == 0 && rw->waiting > 0)
+		status = pthread_cond_signal( &rw->writable );
+	else if (success && rw->waiting == 0)
+		status = pthread_cond_broadcast( &rw->readable );
+	CHECK_STATUS("pthread_cond_signal");
+
+	status = pthread_mutex_unlock( &rw->mut );
+	CHECK_STATUS("pthread_mutex_unlock");
+
+	dprintf(("release_rwlock(%lx) -> %d\n", (long)lock, success));
+	return success;
 }
@@ -138,12 +138,12 @@ void PyThreadState_New()
 	/* inherit some values from the main thread */
 
 	/* we need a lock since we're dealing with another thread's data */
-	Py_CRIT_LOCK();
+	Py_SUBSYS_LOCK(_Py_TraceMutex);
 	pts->state.sys_profilefunc = ptsMain->state.sys_profilefunc;
 	Py_XINCREF(pts->state.sys_profilefunc);
 	pts->state.sys_tracefunc = ptsMain->state.sys_tracefunc;
 	Py_XINCREF(pts->state.sys_tracefunc);
-	Py_CRIT_UNLOCK();
+	Py_SUBSYS_UNLOCK(_Py_TraceMutex);
 
 	pts->state.sys_checkinterval = ptsMain->state.sys_checkinterval;
     }
@@ -215,6 +215,9 @@ void PyThreadState_Free()
     Py_XDECREF(pts->state.last_exception);
     Py_XDECREF(pts->state.last_exc_val);
     Py_XDECREF(pts->state.last_traceback);
+#ifdef WITH_FREE_THREAD
+    _PyFloat_ReleaseFreeList(&pts->state.float_free_list);
+#endif
     free(pts);
 }
 
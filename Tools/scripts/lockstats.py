@@ -0,0 +1,79 @@
+#! /usr/local/bin/python
+
+# Report lock contention while pystone runs in several threads.
+#
+# Usage: lockstats.py [threads [loops]]
+#
+# Starts the given number of threads (default 4), each running pystone
+# with the given number of loops (default 10000), and prints the
+# elapsed time and, for each of the interpreter's locks that was used,
+# how often it was taken, how often it was found held by another
+# thread, and how often a thread had to sleep waiting for it (see
+# thread.lock_stats()).  In free-threaded builds these are the mutexes
+# of the subsystems; otherwise there is just the interpreter lock.
+# pystone.py is looked for next to this script.
+
+import sys
+import os
+import string
+import thread
+from time import time
+
+sys.path.insert(0, os.path.dirname(sys.argv[0]))
+import pystone
+
+class Discard:
+	def write(self, s):
+		pass
+
+done = thread.allocate_lock()
+mutex = thread.allocate_lock()
+left = 0
+
+def run():
+	global left
+	pystone.Proc0()
+	mutex.acquire()
+	left = left - 1
+	if left == 0:
+		done.release()
+	mutex.release()
+
+def main():
+	global left
+	nthreads = 4
+	loops = 10000
+	if sys.argv[1:]:
+		nthreads = string.atoi(sys.argv[1])
+	if sys.argv[2:]:
+		loops = string.atoi(sys.argv[2])
+	pystone.LOOPS = loops
+	left = nthreads
+	before = thread.lock_stats()
+	done.acquire()
+	stdout = sys.stdout
+	sys.stdout = Discard()		# pystone's own report
+	t0 = time()
+	for i in range(nthreads):
+		thread.start_new_thread(run, ())
+	done.acquire()
+	t = time() - t0
+	sys.stdout = stdout
+	after = thread.lock_stats()
+	print '%d threads x %d pystone loops: %.3f sec' % (nthreads, loops, t)
+	print '%-12s %10s %10s %8s %8s' % \
+	      ('lock', 'acquired', 'contended', '%', 'sleeps')
+	names = after.keys()
+	names.sort()
+	for name in names:
+		locks, contended, sleeps = after[name]
+		if before.has_key(name):
+			locks = locks - before[name][0]
+			contended = contended - before[name][1]
+			sleeps = sleeps - before[name][2]
+		if locks == 0:
+			continue
+		print '%-12s %10d %10d %8.3f %8d' % \
+		      (name, locks, contended, 100.0 * contended / locks, sleeps)
+
+main()
@@ -0,0 +1,91 @@
+#! /usr/local/bin/python
+
+# Benchmark long integer arithmetic, against the mpz module if present.
+#
+# Usage: longbench.py [bits ...]
+#
+# For each size (default 1024, 4096, 8192 and 16384 bits) this times
+# multiplication, squaring, conversion to decimal and back, and
+# modular exponentiation, and prints the time per operation in
+# milliseconds.  If the mpz module (GNU MP) was built, the same
+# operations are timed for mpz numbers so the two can be compared;
+# mpz has no conversion from a decimal string, so that column is left
+# empty.
+
+import sys
+import string
+from time import clock
+
+try:
+	import mpz
+except ImportError:
+	mpz = None
+
+DEFAULT_SIZES = [1024, 4096, 8192, 16384]
+
+# Run the function until at least this many seconds have passed
+MINTIME = 0.5
+
+def randlong(bits):
+	import whrandom
+	x = 0L
+	while bits > 0:
+		x = (x << 15) | whrandom.randint(0, 32767)
+		bits = bits - 15
+	return x | 1L
+
+def timeit(func, args):
+	n = 1
+	while 1:
+		t0 = clock()
+		for i in range(n):
+			apply(func, args)
+		t = clock() - t0
+		if t >= MINTIME:
+			return t * 1000.0 / n
+		n = n * 2
+
+def mul(a, b): return a * b
+def square(a): return a * a
+def tostring(a): return `a`
+def fromstring(s): return string.atol(s)
+
+def bench(bits):
+	a = randlong(bits)
+	b = randlong(bits)
+	e = randlong(bits)
+	m = randlong(bits)
+	s = `a`[:-1]
+	results = []
+	results.append(('mul', timeit(mul, (a, b)), None))
+	results.append(('square', timeit(square, (a,)), None))
+	results.append(('repr', timeit(tostring, (a,)), None))
+	results.append(('atol', timeit(fromstring, (s,)), None))
+	results.append(('pow', timeit(pow, (a, e, m)), None))
+	if mpz:
+		ma, mb, me, mm = mpz.mpz(a), mpz.mpz(b), mpz.mpz(e), mpz.mpz(m)
+		results[0] = results[0][:2] + (timeit(mul, (ma, mb)),)
+		results[1] = results[1][:2] + (timeit(square, (ma,)),)
+		results[2] = results[2][:2] + (timeit(tostring, (ma,)),)
+		results[4] = results[4][:2] + \
+			(timeit(mpz.powm, (ma, me, mm)),)
+	return results
+
+def main():
+	sizes = map(string.atoi, sys.argv[1:]) or DEFAULT_SIZES
+	if mpz:
+		print '%6s %-8s %12s %12s' % ('bits', 'op', 'long (ms)', 'mpz (ms)')
+	else:
+		print '%6s %-8s %12s' % ('bits', 'op', 'long (ms)')
+	for bits in sizes:
+		for name, tlong, tmpz in bench(bits):
+			line = '%6d %-8s %12.3f' % (bits, name, tlong)
+			if mpz:
+				if tmpz is None:
+					line = line + ' %12s' % '-'
+				else:
+					line = line + ' %12.3f' % tmpz
+			print line
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,88 @@
+#! /usr/local/bin/python
+
+# Benchmark marshal.dumps(), marshal.loads(), marshal.dump() and
+# marshal.load() on some large objects.
+#
+# Usage: marshalbench.py [n]
+#
+# The objects are a list of n ints (default 100000), a dictionary of
+# n/10 string keys, a list of n/10 short strings, a list of n/10 floats
+# and one string of n*10 bytes.  For each, the time per operation and
+# the throughput in Kbytes of marshalled data per second are printed.
+
+import sys
+import os
+import string
+import marshal
+import tempfile
+from time import clock
+
+# Run the function until at least this many seconds have passed
+MINTIME = 0.5
+
+def timeit(func, args):
+	n = 1
+	while 1:
+		t0 = clock()
+		for i in range(n):
+			apply(func, args)
+		t = clock() - t0
+		if t >= MINTIME:
+			return t / n
+		n = n * 2
+
+def dumpfile(x, filename):
+	f = open(filename, 'wb')
+	marshal.dump(x, f)
+	f.close()
+
+def loadfile(filename):
+	f = open(filename, 'rb')
+	x = marshal.load(f)
+	f.close()
+	return x
+
+def objects(n):
+	ints = range(n)
+	dict = {}
+	strings = []
+	floats = []
+	for i in range(n/10):
+		dict['key%d' % i] = i
+		strings.append('string %d' % i)
+		floats.append(i * 0.5)
+	big = 'x' * (n*10)
+	return [('ints', ints), ('dict', dict), ('strings', strings),
+		('floats', floats), ('string', big)]
+
+def main():
+	if sys.argv[1:]:
+		n = string.atoi(sys.argv[1])
+	else:
+		n = 100000
+	filename = tempfile.mktemp()
+	print '%-8s %8s %10s %10s %10s %10s' % \
+	      ('object', 'Kbytes', 'dumps', 'loads', 'dump', 'load')
+	try:
+		for name, x in objects(n):
+			s = marshal.dumps(x)
+			dumpfile(x, filename)
+			if loadfile(filename) <> x or marshal.loads(s) <> x:
+				print name, 'does not survive marshal'
+			k = len(s) / 1024.0
+			line = '%-8s %8d' % (name, k)
+			for func, args in ((marshal.dumps, (x,)),
+					   (marshal.loads, (s,)),
+					   (dumpfile, (x, filename)),
+					   (loadfile, (filename,))):
+				t = timeit(func, args)
+				line = line + ' %10s' % ('%d K/s' % (k / t))
+			print line
+	finally:
+		try:
+			os.unlink(filename)
+		except os.error:
+			pass
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,167 @@
+#! /usr/local/bin/python
+
+# Compile all .py files in directory trees, using several processes.
+#
+# Usage: pcompileall.py [-j jobs] [-l] [-f] [-q] [directory ...]
+#
+# Like Lib/compileall.py, but files whose .pyc file is up to date (it
+# has the right magic number and the source's mtime) are skipped, and
+# the remaining files are divided over a number of worker processes
+# (default 4) that compile them with py_compile.  Each file is printed
+# with the time it took to compile, unless -q is given.  Biggest files
+# are handed out first, so the workers finish at about the same time.
+#
+# -j jobs: number of worker processes (1 compiles in this process)
+# -l: don't recurse down
+# -f: compile all files, even those with an up-to-date .pyc file
+# -q: only print errors and the total
+# If no directories are given, sys.path is used (except the current
+# directory), without recursion, as compileall does.
+
+import sys
+import os
+import string
+import getopt
+import time
+import py_compile
+
+DEFAULT_JOBS = 4
+
+def usage(msg = None):
+	if msg: sys.stderr.write(msg + '\n')
+	sys.stderr.write(
+		'usage: pcompileall.py [-j jobs] [-l] [-f] [-q] [dir ...]\n')
+	sys.exit(2)
+
+# Return the list of .py files in a directory tree
+def findfiles(dir, maxlevels):
+	try:
+		names = os.listdir(dir)
+	except os.error:
+		sys.stderr.write("Can't list %s\n" % dir)
+		return []
+	files = []
+	for name in names:
+		fullname = os.path.join(dir, name)
+		if name[-3:] == '.py' and os.path.isfile(fullname):
+			files.append(fullname)
+		elif maxlevels > 0 and \
+		     name != os.curdir and name != os.pardir and \
+		     os.path.isdir(fullname) and \
+		     not os.path.islink(fullname):
+			files = files + findfiles(fullname, maxlevels - 1)
+	return files
+
+# Check whether the .pyc file exists and matches the source.
+# This mirrors check_compiled_module() in Python/import.c.
+def uptodate(file):
+	try:
+		mtime = os.stat(file)[8]
+		f = open(file + 'c', 'rb')
+		header = f.read(8)
+		f.close()
+	except (IOError, os.error):
+		return 0
+	if len(header) < 8 or header[:4] <> py_compile.MAGIC:
+		return 0
+	t = 0L
+	for c in header[7], header[6], header[5], header[4]:
+		t = (t << 8) | ord(c)
+	return t == long(mtime) & 0xffffffffL
+
+# Compile a list of files; return the number of failures.  The output
+# for a file is written in one piece so the workers don't mix lines.
+def compilefiles(files, quiet):
+	errors = 0
+	for file in files:
+		t0 = time.time()
+		try:
+			py_compile.compile(file)
+		except KeyboardInterrupt:
+			raise KeyboardInterrupt
+		except:
+			if type(sys.exc_type) == type(''):
+				exc_type_name = sys.exc_type
+			else: exc_type_name = sys.exc_type.__name__
+			msg = 'Sorry: %s: %s: %s\n' % \
+			      (file, exc_type_name, sys.exc_value)
+			os.write(2, msg)
+			errors = errors + 1
+			continue
+		if not quiet:
+			os.write(1, '%7.3fs %s\n' % (time.time() - t0, file))
+	return errors
+
+# Divide the files over the workers, biggest first, and wait for them
+def runjobs(files, jobs, quiet):
+	bysize = []
+	for file in files:
+		bysize.append((-os.stat(file)[6], file))
+	bysize.sort()
+	shares = []
+	for i in range(jobs):
+		shares.append([])
+	for i in range(len(bysize)):
+		shares[i % jobs].append(bysize[i][1])
+	sys.stdout.flush()
+	pids = []
+	for share in shares:
+		pid = os.fork()
+		if pid == 0:
+			try:
+				errors = compilefiles(share, quiet)
+			except KeyboardInterrupt:
+				os._exit(2)
+			os._exit(errors > 0)
+		pids.append(pid)
+	failed = 0
+	while pids:
+		pid, sts = os.wait()
+		if pid in pids:
+			pids.remove(pid)
+			if sts: failed = failed + 1
+	return failed
+
+def main():
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], 'j:lfq')
+	except getopt.error, msg:
+		usage(str(msg))
+	jobs = DEFAULT_JOBS
+	maxlevels = 10
+	force = quiet = 0
+	for o, a in opts:
+		if o == '-j':
+			try:
+				jobs = string.atoi(a)
+			except string.atoi_error:
+				usage('bad number of jobs: ' + a)
+		if o == '-l': maxlevels = 0
+		if o == '-f': force = 1
+		if o == '-q': quiet = 1
+	if not args:
+		maxlevels = 0
+		for dir in sys.path:
+			if dir and dir != os.curdir:
+				args.append(dir)
+	t0 = time.time()
+	files = []
+	for dir in args:
+		files = files + findfiles(dir, maxlevels)
+	todo = []
+	for file in files:
+		if force or not uptodate(file):
+			todo.append(file)
+	jobs = max(1, min(jobs, len(todo)))
+	if jobs == 1 or not hasattr(os, 'fork'):
+		failed = compilefiles(todo, quiet)
+	else:
+		failed = runjobs(todo, jobs, quiet)
+	print '%d files, %d up to date, %d compiled with %d jobs in %.2fs' % \
+	      (len(files), len(files) - len(todo), len(todo), jobs,
+	       time.time() - t0)
+	if failed:
+		sys.exit(1)
+
+if __name__ == '__main__':
+	main()
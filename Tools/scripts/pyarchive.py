@@ -0,0 +1,129 @@
+#! /usr/local/bin/python
+
+# Build a module archive for $PYTHONARCHIVE.
+#
+# Usage: pyarchive.py [-o archive] [-s script] [file|directory] ...
+#
+# Each .py file named on the command line, and each .py file in each
+# directory named, is compiled and its code object stored in the
+# archive under the file's base name.  With -s, the modules imported
+# by the script are found the way Tools/freeze does it and added as
+# well (modules that can't be found or are built in are skipped).
+# The archive is written to the file given with -o, default
+# "modules.pya".
+#
+# When $PYTHONARCHIVE names the archive, the interpreter imports these
+# modules from it without searching sys.path.  The archive is not
+# checked against the source files; rebuild it when they change.  See
+# the comments in Python/import.c for the format.
+
+import sys
+import os
+import string
+import getopt
+import marshal
+import imp
+
+DEFAULT_ARCHIVE = 'modules.pya'
+
+def usage(msg = None):
+	if msg: sys.stderr.write(msg + '\n')
+	sys.stderr.write(
+		'usage: pyarchive.py [-o archive] [-s script] [file|dir] ...\n')
+	sys.exit(2)
+
+# Encode a number as 4 bytes, little-endian, like marshal does
+def long4(x):
+	s = ''
+	for i in range(4):
+		s = s + chr(x & 0xff)
+		x = x >> 8
+	return s
+
+def compilefile(filename):
+	f = open(filename, 'r')
+	source = f.read()
+	f.close()
+	if source and source[-1] != '\n': source = source + '\n'
+	co = compile(source, filename, 'exec')
+	return marshal.dumps(co, marshal.version)
+
+def addfile(modules, filename):
+	name = os.path.basename(filename)
+	if name[-3:] == '.py': name = name[:-3]
+	modules[name] = filename
+
+def adddir(modules, dirname):
+	for name in os.listdir(dirname):
+		if name[-3:] == '.py':
+			addfile(modules, os.path.join(dirname, name))
+
+def addscript(modules, script):
+	freezedir = os.path.join(os.path.dirname(sys.argv[0]), os.pardir)
+	freezedir = os.path.join(freezedir, 'freeze')
+	sys.path.insert(0, freezedir)
+	import findmodules
+	del sys.path[0]
+	found = findmodules.findmodules(script)
+	for name, filename in found.items():
+		if name != '__main__' and filename[-3:] == '.py':
+			modules[name] = filename
+
+def writearchive(archive, modules):
+	names = modules.keys()
+	names.sort()
+	codes = []
+	for name in names:
+		codes.append(compilefile(modules[name]))
+	n = len(names)
+	offset = 12 + 12*n
+	index = []
+	for name in names:
+		index.append(offset)
+		offset = offset + len(name) + 1
+	for code in codes:
+		index.append(offset)
+		offset = offset + len(code)
+	# Running interpreters may have the old archive mapped, so it
+	# mustn't be changed in place: write a new file and rename it
+	tmp = '%s.%d' % (archive, os.getpid())
+	f = open(tmp, 'wb')
+	try:
+		f.write('PYAR' + imp.get_magic() + long4(n))
+		for i in range(n):
+			f.write(long4(index[i]) + long4(index[n+i]) +
+				long4(len(codes[i])))
+		for name in names:
+			f.write(name + '\0')
+		for code in codes:
+			f.write(code)
+		f.close()
+		os.rename(tmp, archive)
+	except:
+		f.close()
+		os.unlink(tmp)
+		raise sys.exc_type, sys.exc_value
+	return offset
+
+def main():
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], 'o:s:')
+	except getopt.error, msg:
+		usage(str(msg))
+	archive = DEFAULT_ARCHIVE
+	modules = {}
+	for o, a in opts:
+		if o == '-o': archive = a
+		if o == '-s': addscript(modules, a)
+	for arg in args:
+		if os.path.isdir(arg):
+			adddir(modules, arg)
+		else:
+			addfile(modules, arg)
+	if not modules:
+		usage('no modules to archive')
+	size = writearchive(archive, modules)
+	print '%s: %d modules, %d bytes' % (archive, len(modules), size)
+
+if __name__ == '__main__':
+	main()
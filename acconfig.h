@@ -81,6 +81,12 @@
 /* Define if you want to compile in rudimentary thread support */
 #undef WITH_THREAD
 
+/* Define if you want long ints built from 30-bit digits (64-bit hosts) */
+#undef WITH_BIG_DIGITS
+
+/* Define to the number of small ints (0 .. NSMALLPOSINTS-1) to cache */
+#undef NSMALLPOSINTS
+
 /* Define if you want to use the GNU readline library */
 #undef WITH_READLINE
 